@@ -9,9 +9,12 @@
 #include <Urho3D/Audio/SoundSource.h>
 #include <Urho3D/Resource/ResourceCache.h>
 #include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/FileSystem.h>
 #include <stdio.h>
+#include <limits>
 
 #include "Theora.h"
+#include "TheoraEvents.h"
 
 #include <Urho3D/DebugNew.h>
 //=============================================================================
@@ -19,44 +22,214 @@
 static const int SyncBufferSize = 4096;
 static const float VideoAdvanceFrames = 10.0f;
 static const float AudioAdvanceFrames = VideoAdvanceFrames + 1.0f;
+// asynchronous opens and prepared instances are done once the first frame is in, the
+// decoder fills the rest of the advance window after StartProcess()
+static const float FirstFramePreroll = 1.0f;
+static const unsigned VideoQueueCapacity = 32;
+static const unsigned AudioQueueCapacity = 32;
+static const unsigned VideoPoolCapacity = VideoQueueCapacity * 2;
+static const unsigned AudioPoolCapacity = AudioQueueCapacity * 2;
+static const unsigned MaxConversionBands = 16;
 const int RGBAComponentSize = 4;
+// post-processing controller: steps down when the smoothed decode time uses more than
+// PostProcessBehindRatio of the frame interval or the queue lead drops under
+// PostProcessMinLeadFrames, steps up under PostProcessHeadroomRatio with a healthy lead
+static const float DecodeTimeSmoothing = 0.125f;
+static const float PostProcessBehindRatio = 0.75f;
+static const float PostProcessHeadroomRatio = 0.4f;
+static const float PostProcessMinLeadFrames = 2.0f;
+static const int PostProcessCooldownFrames = 30;
+// late frames: a frame is dropped (decoded, not converted) once the frame after it is
+// due as well, and the decoder skips to the next keyframe when more than
+// CatchUpLagFrames behind
+static const int64_t CatchUpLagFrames = 15;
+// bisection stops once the interval is this small and scans the rest linearly
+static const int64_t SeekLinearBytes = SyncBufferSize * 4;
+// read from the end of the file to find the duration
+static const int64_t DurationScanBytes = SyncBufferSize * 16;
+// fixed page header part and the largest segment table
+static const unsigned OggPageHeaderSize = 27;
+static const unsigned OggPageHeaderMaxSize = OggPageHeaderSize + 255;
+// clock value that never wakes the decoder, only queue space or exit do
+static const int64_t NeverWakeTime = std::numeric_limits<int64_t>::max();
+// managed step priority handicap per decode LOD below full
+static const int64_t LodStepSlackMSec = 100;
+// read-ahead pipeline
+static const unsigned DefaultPrefetchWindow = 2 * 1024 * 1024;
+static const unsigned PageQueueCapacity = 64;
+static const unsigned PagePoolCapacity = PageQueueCapacity * 2;
+
+//=============================================================================
+//=============================================================================
+// runs one stage of the pipeline
+class TheoraStageThread : public Thread, public RefCounted
+{
+public:
+    TheoraStageThread(Theora *owner, void (Theora::*function)())
+        : owner_(owner)
+        , function_(function)
+    {
+    }
+
+    virtual void ThreadFunction()
+    {
+        (owner_->*function_)();
+    }
+
+private:
+    Theora *owner_;
+    void (Theora::*function_)();
+};
+
+//=============================================================================
+//=============================================================================
+// events go out from the main thread, this polls an asynchronous open at the
+// start of each frame and sends E_THEORAFIRSTFRAME once it is done
+class TheoraOpenNotifier : public Object
+{
+    URHO3D_OBJECT(TheoraOpenNotifier, Object);
+
+public:
+    TheoraOpenNotifier(Context *context, Theora *owner)
+        : Object(context)
+        , owner_(owner)
+    {
+        SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(TheoraOpenNotifier, HandleBeginFrame));
+    }
+
+private:
+    void HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+    {
+        if (owner_->IsOpening())
+        {
+            return;
+        }
+
+        UnsubscribeFromEvent(E_BEGINFRAME);
+
+        using namespace TheoraFirstFrame;
+
+        VariantMap& data = GetEventDataMap();
+        data[P_THEORA] = owner_;
+        data[P_RESULT] = owner_->GetOpenResult();
+        data[P_LATENCY] = owner_->GetStats().openMSec_;
+
+        // last, the receiver may destroy the owner and this with it
+        SendEvent(E_THEORAFIRSTFRAME, data);
+    }
+
+    Theora *owner_;
+};
 
 //=============================================================================
 //=============================================================================
 Theora::Theora()
-    : elapsedTime_(0)
-    , fnExited_(false)
-    , threadEnabled_(true)
-    , file_(0)
+    : file_(0)
+    , elapsedTime_(0)
     , videoAdvanceTime_(0)
     , audioAdvanceTime_(0)
+    , videoBufferQueue_(VideoQueueCapacity)
+    , audioBufferQueue_(AudioQueueCapacity)
+    , videoDataPool_(VideoPoolCapacity)
+    , audioDataPool_(AudioPoolCapacity)
+    , wakeTime_(NeverWakeTime)
+    , waitingForSpace_(false)
+    , threadEnabled_(true)
     , stopAV_(false)
 
     , thDecCtx_(NULL)
-    , thSetupInfo_(NULL)
+    , vbInfo_(NULL)
 
     , thPacket_(0)
     , vbPacket_(0)
+    , skPacket_(0)
+    , skVersionMajor_(0)
     , stateFlag_(0)
 
     , videobufReady_(0)
     , videobufGranulePos_(-1)
     , videobufTime_(0)
 
+    , audioFdFragSize_(0)
     , audiobufFill_(0)
     , audiobufReady_(0)
     , audiobufGranulePos_(0)
-    , audioFdFragSize_(0)
     , audioTime_(0)
 
     , postProcessLevelMax_(0)
     , postProcessLevel_(0)
     , postProcessIncrement_(0)
+    , postProcessCooldown_(0)
+    , adaptivePostProcess_(true)
+    , decodeUSecAvg_(0.0f)
 
+    , audioFills_(0)
     , frames_(0)
     , dropped_(0)
-    , audioFills_(0)
+    , skipped_(0)
+    , reduced_(0)
+    , lastFrameIndex_(-1)
+    , dropFrame_(false)
+    , reducedFrame_(false)
+    , catchingUp_(false)
+    , seekOffset_(0)
+    , seekReads_(0)
+    , seekFrame_(-1)
+    , seekKeyframe_(-1)
+    , seekSample_(-1)
+    , seekAudioGranulePos_(-1)
+    , seekAudioPageSeen_(false)
+    , frameIndexKnown_(true)
+    , seekIndex_(true)
+    , indexEnabled_(false)
+    , indexReady_(false)
+    , looping_(false)
+    , dataOffset_(-1)
+    , inputPass_(0)
+    , videoPass_(0)
+    , audioPass_(0)
+    , mappedInput_(true)
+    , mappedPosition_(0)
+    , mappedEnd_(0)
+    , pageQueue_(PageQueueCapacity)
+    , freePages_(PagePoolCapacity)
+    , demuxEnabled_(false)
+    , demuxFinished_(false)
+    , waitingForPages_(false)
+    , demuxStallUSec_(0)
+    , prefetchWindow_(DefaultPrefetchWindow)
+    , pipelineRunning_(false)
+    , audioPageQueue_(PageQueueCapacity)
+    , freeAudioPages_(PagePoolCapacity)
+    , audioWakeTime_(NeverWakeTime)
+    , audioEnabled_(false)
+    , audioWaitingForPages_(false)
+    , audioWaitingForSpace_(false)
+    , audioFinished_(false)
+    , audioStallUSec_(0)
+    , audioStalls_(0)
+    , audioSerialNo_(0)
+    , audioLeadMSec_(0)
+    , audioPriority_(0)
+    , audioThreadRunning_(false)
+    , stripeConversion_(true)
+    , conversionBands_(1)
+    , requestedLod_(DECODE_LOD_FULL)
+    , resumePending_(false)
+    , decodeLod_(DECODE_LOD_FULL)
+    , opening_(false)
+    , openResult_(INIT_OK)
+    , useManager_(true)
+    , managed_(false)
+    , decodedTime_(0)
 {
+    // the destructor clears it whether or not a file was ever opened
+    ogg_sync_init(&oggSyncState_);
+
+    demuxThread_ = new TheoraStageThread(this, &Theora::DemuxFunction);
+    audioThread_ = new TheoraStageThread(this, &Theora::AudioFunction);
+    openThread_ = new TheoraStageThread(this, &Theora::OpenFunction);
+    indexThread_ = new TheoraStageThread(this, &Theora::IndexFunction);
 }
 
 Theora::~Theora()
@@ -64,10 +237,11 @@ Theora::~Theora()
     // force exit thread fn
     WaitExit();
 
-    if (thSetupInfo_)
+    // a seek only stops the decoding threads, an unfinished scan is abandoned here
+    indexEnabled_ = false;
+    if (indexThread_->IsStarted())
     {
-        th_setup_free(thSetupInfo_);
-        thSetupInfo_ = NULL;
+        indexThread_->Stop();
     }
 
     if (vbPacket_)
@@ -75,45 +249,157 @@ Theora::~Theora()
       ogg_stream_clear(&oggVbStreamState_);
       vorbis_block_clear(&vbBlock_);
       vorbis_dsp_clear(&vbDspState_);
-      vorbis_comment_clear(&vbComment_);
-      vorbis_info_clear(&vbInfo_);
+    }
+
+    if (skPacket_)
+    {
+      ogg_stream_clear(&oggSkStreamState_);
     }
 
     if (thPacket_)
     {
       ogg_stream_clear(&oggThStreamState_);
       th_decode_free(thDecCtx_);
-      th_comment_clear(&thComment_);
       th_info_clear(&thInfo_);
     }
 
+    // after the decoders, which were allocated from them
+    if (headerCache_)
+    {
+        headerCache_->Release(headers_);
+    }
+
     ogg_sync_clear(&oggSyncState_);
 }
 
 int Theora::Initialize(Context *context, const String& filename)
 {
-    int result = 0;
-    context_ = context;
+    return Open(context, 0, filename, VideoAdvanceFrames);
+}
+
+int Theora::Prepare(Context *context, const String& filename)
+{
+    return Open(context, 0, filename, FirstFramePreroll);
+}
+
+int Theora::Prepare(Context *context, File *file)
+{
+    return Open(context, file, file ? file->GetName() : String::EMPTY, FirstFramePreroll);
+}
 
-    if (OpenFile(filename))
+int Theora::Open(Context *context, File *file, const String& filename, float prerollFrames)
+{
+    if (IsOpening() || theoraAVInfo_.initialized_)
     {
-      result = InitTheora();
+        return OPEN_BUSY_ERROR;
     }
-    else
+
+    openTimer_.Reset();
+    SetContext(context);
+    openResult_ = OpenStream(file, filename, prerollFrames);
+
+    return openResult_;
+}
+
+bool Theora::InitializeAsync(Context *context, const String& filename)
+{
+    if (IsOpening() || theoraAVInfo_.initialized_ || openThread_->IsStarted())
+    {
+        return false;
+    }
+
+    openTimer_.Reset();
+    SetContext(context);
+    openFileName_ = filename;
+    opening_ = true;
+
+    if (!openThread_->Run())
+    {
+        opening_ = false;
+        URHO3D_LOGERRORF("Theora: failed to start the open thread for '%s'", filename.CString());
+        return false;
+    }
+
+    openNotifier_ = new TheoraOpenNotifier(context, this);
+    return true;
+}
+
+bool Theora::IsOpening() const
+{
+    return opening_.load(std::memory_order_acquire);
+}
+
+int Theora::GetOpenResult() const
+{
+    return openResult_;
+}
+
+void Theora::SetContext(Context *context)
+{
+    // subsystems are looked up by the caller, an asynchronous open only uses them
+    context_ = context;
+    workQueue_ = context->GetSubsystem<TheoraWorkQueue>();
+    manager_ = context->GetSubsystem<TheoraManager>();
+    headerCache_ = context->GetSubsystem<TheoraHeaderCache>();
+}
+
+int Theora::OpenStream(File *file, const String& filename, float prerollFrames)
+{
+    bool opened = file ? OpenFile(file, filename) : OpenFile(filename);
+    int result = opened ? InitTheora(prerollFrames) : FILE_ERROR;
+
+    if (result == INIT_OK)
     {
-      result = FILE_ERROR;
+        stats_.openMSec_ = openTimer_.GetUSec(false) * 0.001f;
     }
+    PublishStats();
 
     return result;
 }
 
+void Theora::OpenFunction()
+{
+    openResult_ = OpenStream(0, openFileName_, FirstFramePreroll);
+
+    // everything the open wrote is visible to whoever sees it done
+    opening_.store(false, std::memory_order_release);
+}
+
 bool Theora::StartProcess()
 {
     bool result = false;
 
+    if (IsOpening())
+    {
+        return false;
+    }
+
+    // the open thread has returned, reap it
+    if (openThread_->IsStarted())
+    {
+        openThread_->Stop();
+    }
+
     if (theoraAVInfo_.initialized_)
     {
-        result = Thread::Run();
+        if (managed_ || IsStarted())
+        {
+            // already decoding, like Thread::Run()
+        }
+        else if (useManager_ && manager_ && manager_->GetNumThreads())
+        {
+            // ready for a first step straight away
+            decodedTime_ = GetElapsedTime();
+            wakeTime_ = std::numeric_limits<int64_t>::min();
+            managed_ = true;
+            manager_->AddStream(this);
+            result = true;
+        }
+        else
+        {
+            StartPipeline();
+            result = Thread::Run();
+        }
     }
 
     return result;
@@ -124,15 +410,30 @@ bool Theora::Run()
 	return false;
 }
 
-void Theora::SetElapsedTime(float elapsedTime)
+void Theora::SetElapsedTime(int64_t timeMSec)
 {
-    MutexLock lock(mutexTimer_);
-    elapsedTime_ = static_cast<int64_t>(elapsedTime * 1000.0f);
+    elapsedTime_ = timeMSec;
+
+    // only wake the decoders once they have something to do
+    if (timeMSec >= wakeTime_)
+    {
+        if (managed_)
+        {
+            manager_->Wake();
+        }
+        else
+        {
+            wakeSignal_.Set();
+        }
+    }
+    if (timeMSec >= audioWakeTime_)
+    {
+        audioSignal_.Set();
+    }
 }
 
 int64_t Theora::GetElapsedTime()
 {
-    MutexLock lock(mutexTimer_);
     return elapsedTime_;
 }
 
@@ -140,7 +441,11 @@ void Theora::UpdateTimer()
 {
   int64_t elapsedTime = GetElapsedTime();
   videoAdvanceTime_ = elapsedTime + static_cast<int64_t>(1000.0f * VideoAdvanceFrames/theoraAVInfo_.videoFrameRate_);
-  audioAdvanceTime_ = elapsedTime + static_cast<int64_t>(1000.0f * AudioAdvanceFrames/theoraAVInfo_.videoFrameRate_);
+  // the audio thread keeps its own
+  if (!audioThreadRunning_)
+  {
+    audioAdvanceTime_ = elapsedTime + GetAudioLead();
+  }
 }
 
 const TheoraAVInfo& Theora::GetTheoraAVInfo() const
@@ -148,53 +453,136 @@ const TheoraAVInfo& Theora::GetTheoraAVInfo() const
     return theoraAVInfo_;
 }
 
-void Theora::StoreVideoQueueData(SharedPtr<VideoData> theoraData)
+void Theora::StoreVideoQueueData(SharedPtr<VideoData> &theoraData)
+{
+    // bounded queue - hold the decoder back until the consumer frees a slot
+    while (!videoBufferQueue_.Push(theoraData) && GetThreadEnabled())
+    {
+        waitingForSpace_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // the consumer may have popped before seeing the flag
+        if (videoBufferQueue_.Push(theoraData))
+        {
+            break;
+        }
+
+        wakeSignal_.Wait();
+    }
+}
+
+VideoData* Theora::PeekVideoQueueData() const
 {
-    MutexLock lock(mutexVideoBuff_);
-    videoBufferContainer_.Push(theoraData);
+    return videoBufferQueue_.Front();
 }
 
 SharedPtr<VideoData> Theora::GetVideoQueueData()
 {
-    MutexLock lock(mutexVideoBuff_);
-    SharedPtr<VideoData> ptr(0);
-    if (videoBufferContainer_.Size() > 0)
+    SharedPtr<VideoData> ptr = videoBufferQueue_.Pop();
+    SignalQueueSpace();
+
+    // hand frames the caller has finished with back to the decoder
+    videoDataPool_.Track(ptr);
+    videoDataPool_.Collect();
+    return ptr;
+}
+
+void Theora::StoreAudioQueueData(SharedPtr<AudioData> &theoraData)
+{
+    // on the audio thread it has a flag and signal of its own
+    std::atomic<bool> &waitingForSpace = audioThreadRunning_ ? audioWaitingForSpace_ : waitingForSpace_;
+    TheoraSignal &signal = audioThreadRunning_ ? audioSignal_ : wakeSignal_;
+    const std::atomic<bool> &enabled = audioThreadRunning_ ? audioEnabled_ : threadEnabled_;
+
+    while (!audioBufferQueue_.Push(theoraData) && enabled)
     {
-        ptr = videoBufferContainer_[0];
-        videoBufferContainer_.Erase(0);
+        waitingForSpace = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (audioBufferQueue_.Push(theoraData))
+        {
+            break;
+        }
+
+        signal.Wait();
     }
-    return ptr;
 }
 
-void Theora::StoreAudioQueueData(SharedPtr<AudioData> theoraData)
+AudioData* Theora::PeekAudioQueueData() const
 {
-    MutexLock lock(mutexAudioBuff_);
-    audioBufferContainer_.Push(theoraData);
+    return audioBufferQueue_.Front();
 }
 
-SharedPtr<AudioData> Theora::GetAudioQueueData()
+void Theora::SignalQueueSpace()
 {
-    MutexLock lock(mutexAudioBuff_);
-    SharedPtr<AudioData> ptr(0);
-    if (audioBufferContainer_.Size() > 0)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (waitingForSpace_.exchange(false))
+    {
+        if (managed_)
+        {
+            manager_->Wake();
+        }
+        else
+        {
+            wakeSignal_.Set();
+        }
+    }
+    if (audioWaitingForSpace_.exchange(false))
     {
-        ptr = audioBufferContainer_[0];
-        audioBufferContainer_.Erase(0);
+        audioSignal_.Set();
     }
+}
+
+SharedPtr<AudioData> Theora::GetAudioQueueData()
+{
+    SharedPtr<AudioData> ptr = audioBufferQueue_.Pop();
+    SignalQueueSpace();
+
+    audioDataPool_.Track(ptr);
+    audioDataPool_.Collect();
     return ptr;
 }
 
-int Theora::InitTheora()
+void Theora::SetStripeConversion(bool enable)
+{
+    stripeConversion_ = enable;
+    SetStripeCallback();
+}
+
+bool Theora::GetStripeConversion() const
+{
+    return stripeConversion_;
+}
+
+void Theora::SetConversionBands(unsigned numBands)
+{
+    conversionBands_ = Clamp(numBands, 1U, MaxConversionBands);
+    SetStripeCallback();
+}
+
+unsigned Theora::GetConversionBands() const
+{
+    return conversionBands_;
+}
+
+const VideoDataPool& Theora::GetVideoDataPool() const
+{
+    return videoDataPool_;
+}
+
+const AudioDataPool& Theora::GetAudioDataPool() const
+{
+    return audioDataPool_;
+}
+
+int Theora::InitTheora(float prerollFrames)
 {
     /* start up Ogg stream synchronization layer */
     ogg_sync_init(&oggSyncState_);
 
-    /* init supporting Vorbis structures needed in header parsing */
-    vorbis_info_init(&vbInfo_);
-    vorbis_comment_init(&vbComment_);
-
-    /* init supporting Theora structures needed in header parsing */
-    th_comment_init(&thComment_);
+    /* header packets are collected and parsed once all are in, or shared */
+    headers_ = new TheoraHeaders();
     th_info_init(&thInfo_);
 
     /* Ogg file open; parse the headers */
@@ -207,7 +595,7 @@ int Theora::InitTheora()
           break;
       }
 
-      while (ogg_sync_pageout(&oggSyncState_, &oggPage_) > 0)
+      while (PageOut(&oggPage_) > 0)
       {
         ogg_stream_state test;
 
@@ -225,18 +613,27 @@ int Theora::InitTheora()
         ogg_stream_packetout(&test, &oggPacket_);
 
         /* identify the codec: try theora */
-        if (!thPacket_ && th_decode_headerin(&thInfo_, &thComment_, &thSetupInfo_, &oggPacket_) >= 0)
+        if (!thPacket_ && TheoraHeaders::ReadTheoraInfo(&oggPacket_, &thInfo_))
         {
           /* it is theora */
           memcpy(&oggThStreamState_, &test, sizeof(test));
+          headers_->AddTheoraPacket(&oggPacket_);
           thPacket_ = 1;
         }
-        else if (!vbPacket_ && vorbis_synthesis_headerin(&vbInfo_, &vbComment_, &oggPacket_) >= 0)
+        else if (!vbPacket_ && vorbis_synthesis_idheader(&oggPacket_))
         {
           /* it is vorbis */
           memcpy(&oggVbStreamState_, &test, sizeof(test));
+          headers_->AddVorbisPacket(&oggPacket_);
           vbPacket_ = 1;
         }
+        else if (!skPacket_ && oggPacket_.bytes >= 12 && memcmp(oggPacket_.packet, "fishead", 8) == 0)
+        {
+          /* it is skeleton, kept for its keyframe index */
+          memcpy(&oggSkStreamState_, &test, sizeof(test));
+          skPacket_ = 1;
+          skVersionMajor_ = oggPacket_.packet[8] | (oggPacket_.packet[9] << 8);
+        }
         else
         {
           /* whatever it is, we don't care about it */
@@ -260,11 +657,7 @@ int Theora::InitTheora()
           return TH_PACKET_ERROR;
         }
 
-        if (!th_decode_headerin(&thInfo_, &thComment_, &thSetupInfo_, &oggPacket_))
-        {
-          URHO3D_LOGERROR("Error parsing Theora stream headers; corrupt stream?");
-          return TH_PACKET_ERROR;
-        }
+        headers_->AddTheoraPacket(&oggPacket_);
         ++thPacket_;
       }
 
@@ -277,18 +670,14 @@ int Theora::InitTheora()
           return VB_PACKET_ERROR;
         }
 
-        if (vorbis_synthesis_headerin(&vbInfo_, &vbComment_, &oggPacket_))
-        {
-          URHO3D_LOGERROR("Error parsing Vorbis stream headers; corrupt stream?");
-          return VB_PACKET_ERROR;
-        }
+        headers_->AddVorbisPacket(&oggPacket_);
         ++vbPacket_;
       }
 
       /* The header pages/packets will arrive before anything else we
          care about, or the stream is not obeying spec */
 
-      if (ogg_sync_pageout(&oggSyncState_, &oggPage_) > 0)
+      if (PageOut(&oggPage_) > 0)
       {
         QueuePage(&oggPage_); /* demux into the appropriate stream */
       }
@@ -303,12 +692,36 @@ int Theora::InitTheora()
       }
     }
 
-    /* and now we have it all.  initialize decoders */
+    /* and now we have it all, parse it unless the same headers were parsed before */
+    HiresTimer headerTimer;
+    // only compared, a cached entry's reference count changes under the cache lock alone
+    // as other instances may be opening on their own threads
+    const TheoraHeaders *collected = headers_.Get();
+    int result = headerCache_ ? headerCache_->Acquire(headers_) : headers_->Parse();
+    stats_.headerMSec_ = headerTimer.GetUSec(false) * 0.001f;
+    stats_.sharedHeaders_ = headers_.Get() != collected;
+    if (result == TH_PACKET_ERROR)
+    {
+      URHO3D_LOGERROR("Error parsing Theora stream headers; corrupt stream?");
+      return result;
+    }
+    else if (result == VB_PACKET_ERROR)
+    {
+      URHO3D_LOGERROR("Error parsing Vorbis stream headers; corrupt stream?");
+      return result;
+    }
+
+    /* initialize decoders */
     if (thPacket_)
     {
-      thDecCtx_ = th_decode_alloc(&thInfo_, thSetupInfo_);
+      thInfo_ = headers_->GetTheoraInfo();
+      thDecCtx_ = th_decode_alloc(&thInfo_, headers_->GetTheoraSetup());
 
       thPixelFmt_ = thInfo_.pixel_fmt;
+      yuvConverter_.SetPixelFormat(thPixelFmt_);
+      yuvConverter_.SetColorSpace(thInfo_.colorspace);
+      yuvConverter_.SetPictureRegion(thInfo_.pic_x, thInfo_.pic_y, thInfo_.pic_width, thInfo_.pic_height);
+      SetStripeCallback();
 
       DumpInfo();
 
@@ -316,6 +729,8 @@ int Theora::InitTheora()
       postProcessLevel_ = postProcessLevelMax_;
       th_decode_ctl(thDecCtx_, TH_DECCTL_SET_PPLEVEL, &postProcessLevel_, sizeof(postProcessLevel_));
       postProcessIncrement_ = 0;
+      stats_.postProcessLevel_ = postProcessLevel_;
+      stats_.postProcessLevelMax_ = postProcessLevelMax_;
 
       // error if the denom is near zero
       if (thInfo_.fps_denominator < M_EPSILON)
@@ -323,37 +738,36 @@ int Theora::InitTheora()
         return CODEC_FRAMERATE_ERROR;
       }
 
-      // error if not the right video encoding
-      if (thInfo_.pixel_fmt != TH_PF_420)
+      // error if the chroma layout is reserved/unknown
+      if (!YuvConverter::IsPixelFormatSupported(thInfo_.pixel_fmt))
       {
           return CODEC_YUV_ERROR;
       }
 
-      // populate av info
-      theoraAVInfo_.videoFrameWidth_ = thInfo_.frame_width;
-      theoraAVInfo_.videoFrameHeight_ = thInfo_.frame_height;
+      // populate av info, frames only hold the visible picture
+      theoraAVInfo_.videoFrameWidth_ = yuvConverter_.GetPictureWidth();
+      theoraAVInfo_.videoFrameHeight_ = yuvConverter_.GetPictureHeight();
+
+      halfConverter_.SetPixelFormat(TH_PF_444);
+      halfConverter_.SetColorSpace(thInfo_.colorspace);
+      halfPicture_.Resize(YuvConverter::GetHalfPictureSize(theoraAVInfo_.videoFrameWidth_, theoraAVInfo_.videoFrameHeight_));
       theoraAVInfo_.videoFrameRate_ = (float)thInfo_.fps_numerator/(float)thInfo_.fps_denominator;
+      videoDataPool_.SetBufferSize(theoraAVInfo_.videoFrameWidth_ * theoraAVInfo_.videoFrameHeight_ * RGBAComponentSize);
     }
     else
     {
       /* tear down the partial theora setup */
       th_info_clear(&thInfo_);
-      th_comment_clear(&thComment_);
     }
 
     if (vbPacket_)
     {
-      vorbis_synthesis_init(&vbDspState_, &vbInfo_);
+      vbInfo_ = headers_->GetVorbisInfo();
+      vorbis_synthesis_init(&vbDspState_, vbInfo_);
       vorbis_block_init(&vbDspState_, &vbBlock_);
 
       URHO3D_LOGINFOF("Ogg logical stream 0x%x is Vorbis: %d channel, %d Hz audio.",
-                      oggVbStreamState_.serialno, vbInfo_.channels, vbInfo_.rate);
-    }
-    else
-    {
-      /* tear down the partial vorbis setup */
-      vorbis_info_clear(&vbInfo_);
-      vorbis_comment_clear(&vbComment_);
+                      oggVbStreamState_.serialno, vbInfo_->channels, vbInfo_->rate);
     }
 
     if (vbPacket_)
@@ -361,38 +775,47 @@ int Theora::InitTheora()
         audioFdFragSize_ = vbDspState_.pcm_storage * 2;
         audiobuf_ = new int16_t[audioFdFragSize_];
         audiobufFill_ = 0;
-        int audioFillGranuleSize = audioFdFragSize_/2/vbInfo_.channels;
-        audioFillGranuleTime_ = static_cast<int64_t>(1000.0 * audioFillGranuleSize / vbInfo_.rate);
+        audioDataPool_.SetBufferSize(audioFdFragSize_ / sizeof(int16_t));
+        int audioFillGranuleSize = audioFdFragSize_/2/vbInfo_->channels;
+        audioFillGranuleTime_ = static_cast<int64_t>(1000.0 * audioFillGranuleSize / vbInfo_->rate);
 
-        theoraAVInfo_.audioFrequencey_ = vbInfo_.rate;
+        theoraAVInfo_.audioFrequencey_ = vbInfo_->rate;
         theoraAVInfo_.audioSixteenBits_ = true;
-        theoraAVInfo_.audioStereo_ = vbInfo_.channels > 1 ? true : false;
+        theoraAVInfo_.audioStereo_ = vbInfo_->channels > 1 ? true : false;
     }
 
+    ScanDuration();
+    FindDataOffset();
+
     // set as initialized
     theoraAVInfo_.initialized_ = true;
     elapsedTime_ = 0;
 
     stateFlag_ = 0; /* playback has not begun */
 
-    videoAdvanceTime_ = static_cast<int64_t>(1000.0f * VideoAdvanceFrames/theoraAVInfo_.videoFrameRate_);
-    audioAdvanceTime_ = static_cast<int64_t>(1000.0f * AudioAdvanceFrames/theoraAVInfo_.videoFrameRate_);
+    videoAdvanceTime_ = static_cast<int64_t>(1000.0f * prerollFrames/theoraAVInfo_.videoFrameRate_);
+    audioAdvanceTime_ = static_cast<int64_t>(1000.0f * (prerollFrames + AudioAdvanceFrames - VideoAdvanceFrames)/theoraAVInfo_.videoFrameRate_);
     UpdateFrames();
 
+    // Skeleton pages all come before the first data page, so any index has been read by now
+    SetupKeyframeIndex();
+
     return INIT_OK;
 }
 
 void Theora::ThreadFunction()
 {
-    unsigned sleepMS = static_cast<unsigned>(1000.0f / (theoraAVInfo_.videoFrameRate_ * 2.0f));
-
-    while (true)
+    while (GetThreadEnabled())
     {
         UpdateTimer();
 
-        if (videobufTime_ < videoAdvanceTime_ || audioTime_ < audioAdvanceTime_)
+        bool decodedAll = false;
+
+        if (NeedsFrames())
         {
+            int progress = GetDecodeProgress();
             UpdateFrames();
+            decodedAll = FileEof() && GetDecodeProgress() == progress;
         }
 
         if (!GetThreadEnabled())
@@ -400,95 +823,97 @@ void Theora::ThreadFunction()
             break;
         }
 
-        Time::Sleep(sleepMS);
+        UpdateTimer();
+
+        if (!NeedsFrames() || decodedAll)
+        {
+            WaitForClock(decodedAll);
+        }
+    }
+}
+
+bool Theora::NeedsFrames() const
+{
+    if (requestedLod_ == DECODE_LOD_PAUSED)
+    {
+        return false;
     }
 
-    SetFnExit(true);
+    return videobufTime_ < videoAdvanceTime_ || (DecodesAudio() && audioTime_ < audioAdvanceTime_);
 }
 
-void Theora::UpdateFrames()
+int Theora::GetDecodeProgress() const
 {
-    int processOggPackets = 0;
+    return frames_ + skipped_ + reduced_ + (DecodesAudio() ? audioFills_ : 0);
+}
 
-    // see the note about this at the bottom of this loop
-	while (processOggPackets < 2)
-	{
-		/* we want a video and audio frame ready to go at all times.  If
-		   we have to buffer incoming, buffer the compressed data (ie, let
-		   ogg do the buffering) */
-		while (vbPacket_ && !audiobufReady_)
-		{
-			int ret;
-			float **pcm;
+int64_t Theora::GetWakeTime(bool decodedAll)
+{
+    if (decodedAll || requestedLod_ == DECODE_LOD_PAUSED)
+    {
+        return NeverWakeTime;
+    }
 
-			/* if there's pending, decoded audio, grab it */
-			if ((ret = vorbis_synthesis_pcmout(&vbDspState_, &pcm)) > 0)
-			{
-                int countIdx = audiobufFill_/2;
-                int maxsamples = (audioFdFragSize_ - audiobufFill_)/2/vbInfo_.channels;
-                int i;
-                for (i = 0; i < ret && i < maxsamples; ++i)
-                {
-                    for (int j = 0; j < vbInfo_.channels; ++j)
-                    {
-                        audiobuf_[countIdx++] = Clamp(FloorToInt(pcm[j][i] * 32767.0f), -32768, 32767);
-                    }
-                }
+    // the clock value at which the decoder falls behind its advance window again, NeedsFrames()
+    // compares strictly
+    int64_t videoAdvance = videoAdvanceTime_ - GetElapsedTime();
+    if (!DecodesAudio())
+    {
+        return videobufTime_ - videoAdvance + 1;
+    }
 
-                vorbis_synthesis_read(&vbDspState_, i);
-                audiobufFill_ += i * vbInfo_.channels * 2;
-                ++audioFills_;
+    // the audio thread owns the audio times while it runs
+    int64_t audioAdvance = audioAdvanceTime_ - GetElapsedTime();
+    return Min(videobufTime_ - videoAdvance, audioTime_ - audioAdvance) + 1;
+}
 
-				if (vbDspState_.granulepos >= 0)
-				{
-					audiobufGranulePos_ = (long)vbDspState_.granulepos - ret + i;
-				}
-				else
-				{
-					audiobufGranulePos_ += i;
-				}
+void Theora::WaitForClock(bool decodedAll)
+{
+    wakeTime_ = GetWakeTime(decodedAll);
 
-                audioTime_ = static_cast<int64_t>(1000.0 * vorbis_granule_time(&vbDspState_, audiobufGranulePos_));
+    // the consumer may have moved the clock before seeing the new wake time
+    if (GetElapsedTime() < wakeTime_ && GetThreadEnabled())
+    {
+        wakeSignal_.Wait();
+    }
 
-                if (audiobufFill_ == audioFdFragSize_)
-                {
-                    audiobufReady_ = 1;
+    wakeTime_ = NeverWakeTime;
+}
 
-                    // buffer audio
-                    SharedPtr<AudioData> audioData(new AudioData());
-                    audioData->time_ = audioTime_ - audioFillGranuleTime_;
-                    audioData->size_ = audiobufFill_;
-                    audioData->buf_ = new int16_t[audiobufFill_];
-                    memcpy(audioData->buf_.Get(), audiobuf_, audiobufFill_ * sizeof(int16_t));
+void Theora::UpdateFrames(bool singleStep)
+{
+    // raised from DECODE_LOD_PAUSED, see SetDecodeLod()
+    if (resumePending_.exchange(false))
+    {
+        ResumeDecoding();
+    }
 
-                    StoreAudioQueueData(audioData);
+    int processOggPackets = 0;
+    int progress = GetDecodeProgress();
 
-                    // clear buffer idx position
-                    audiobufFill_ = 0;
-                }
-			}
-			else
-			{
-				/* no pending audio; is there a pending packet to decode? */
-				if (ogg_stream_packetout(&oggVbStreamState_, &oggPacket_) > 0)
-				{
-					if (vorbis_synthesis(&vbBlock_, &oggPacket_) == 0) /* test for success! */
-					{
-						vorbis_synthesis_blockin(&vbDspState_, &vbBlock_);
-					}
-				}
-				else   /* we need more data; break out to suck in another page */
-				{
-					break;
-				}
-			}
-		}
+    // see the note about this at the bottom of this loop
+	while (processOggPackets < 2 && GetThreadEnabled())
+	{
+        if (requestedLod_ != decodeLod_)
+        {
+            ApplyDecodeLod();
+        }
+
+        if (DecodesAudio())
+        {
+            DecodeAudio();
+        }
 
         while (thPacket_ && !videobufReady_)
         {
           /* theora is one in, one out... */
           if (ogg_stream_packetout(&oggThStreamState_, &oggPacket_) > 0)
           {
+            if (SkipToKeyframe(&oggPacket_))
+            {
+              continue;
+            }
+
             if (postProcessIncrement_)
             {
               postProcessLevel_ += postProcessIncrement_;
@@ -501,9 +926,23 @@ void Theora::UpdateFrames()
               th_decode_ctl(thDecCtx_, TH_DECCTL_SET_GRANPOS, &oggPacket_.granulepos, sizeof(oggPacket_.granulepos));
             }
 
-            if (th_decode_packetin(thDecCtx_, &oggPacket_, &videobufGranulePos_) == 0)
+            // behind the clock - still decoded as a reference, but not converted
+            bool late = IsFrameLate(lastFrameIndex_ + 1);
+            reducedFrame_ = !late && decodeLod_ == DECODE_LOD_REDUCED && ((lastFrameIndex_ + 1) & 1);
+            dropFrame_ = late || reducedFrame_;
+
+            // covers stripe conversion, which runs inside th_decode_packetin()
+            decodeTimer_.Reset();
+
+            int ret = th_decode_packetin(thDecCtx_, &oggPacket_, &videobufGranulePos_);
+            if (ret >= 0)
+            {
+              lastFrameIndex_ = th_granule_frame(thDecCtx_, videobufGranulePos_);
+            }
+
+            if (ret == 0)
             {
-              videobufTime_ = static_cast<int64_t>(1000.0 * th_granule_time(thDecCtx_, videobufGranulePos_));
+              videobufTime_ = static_cast<int64_t>(1000.0 * th_granule_time(thDecCtx_, videobufGranulePos_)) + GetPassTime(videoPass_);
               frames_++;
 
               // write buffer
@@ -517,24 +956,19 @@ void Theora::UpdateFrames()
           }
         }
 
-        if (videobufTime_ > videoAdvanceTime_ && audioTime_ > audioAdvanceTime_)
+        if (videobufTime_ > videoAdvanceTime_ && (!DecodesAudio() || audioTime_ > audioAdvanceTime_))
         {
             break;
         }
 
-		if (!videobufReady_ || !audiobufReady_)
+		if (!videobufReady_ || !DecodesAudio() || !audiobufReady_)
 		{
 			/* no data yet for somebody.  Grab another page */
-            BufferData();
-
-			while (ogg_sync_pageout(&oggSyncState_, &oggPage_) > 0)
-			{
-				QueuePage(&oggPage_);
-			}
+            FetchPages();
 		}
 
 		// post clear (to prevent continuous buffer fetching above)
-        if (audiobufReady_)
+        if (DecodesAudio() && audiobufReady_)
         {
             audiobufReady_ = 0;
         }
@@ -550,155 +984,1986 @@ void Theora::UpdateFrames()
         {
             ++processOggPackets;
         }
+
+        if (singleStep && GetDecodeProgress() != progress)
+        {
+            break;
+        }
 	}
-}
+
+    if (processOggPackets >= 2 && DecodesAudio())
+    {
+        audioFinished_ = true;
+    }
+}
+
+void Theora::DecodeAudio()
+{
+	/* we want a video and audio frame ready to go at all times.  If
+	   we have to buffer incoming, buffer the compressed data (ie, let
+	   ogg do the buffering) */
+	while (vbPacket_ && !audiobufReady_)
+	{
+		int ret;
+		// the video decoder's oggPacket_ may be in use on another thread
+		ogg_packet packet;
+
+		/* if there's pending, decoded audio, grab it */
+		if ((ret = vorbis_synthesis_pcmout(&vbDspState_, 0)) > 0)
+		{
+            // after a seek, drop samples until the granule position is known and then up to the target
+            if (seekSample_ >= 0)
+            {
+                int skip = ret;
+                if (vbDspState_.granulepos >= 0)
+                {
+                    int64_t firstSample = vbDspState_.granulepos - ret;
+                    skip = static_cast<int>(Clamp(seekSample_ - firstSample, (int64_t)0, (int64_t)ret));
+                    if (skip < ret)
+                    {
+                        seekSample_ = -1;
+                    }
+                }
+
+                vorbis_synthesis_read(&vbDspState_, skip);
+                continue;
+            }
+
+            // interleaved, clamped and consumed in one pass by libvorbis
+            int maxsamples = (audioFdFragSize_ - audiobufFill_)/2/vbInfo_->channels;
+            int i = vorbis_synthesis_pcmout_int16(&vbDspState_, audiobuf_.Get() + audiobufFill_/2, maxsamples);
+            audiobufFill_ += i * vbInfo_->channels * 2;
+            ++audioFills_;
+
+			if (vbDspState_.granulepos >= 0)
+			{
+				audiobufGranulePos_ = (long)vbDspState_.granulepos - ret + i;
+			}
+			else
+			{
+				audiobufGranulePos_ += i;
+			}
+
+            audioTime_ = static_cast<int64_t>(1000.0 * vorbis_granule_time(&vbDspState_, audiobufGranulePos_)) + GetPassTime(audioPass_);
+
+            if (audiobufFill_ == audioFdFragSize_)
+            {
+                audiobufReady_ = 1;
+
+                // buffer audio
+                SharedPtr<AudioData> audioData = audioDataPool_.Acquire();
+                audioData->time_ = audioTime_ - audioFillGranuleTime_;
+                audioData->size_ = audiobufFill_;
+                memcpy(audioData->buf_, audiobuf_.Get(), audiobufFill_);
+
+                StoreAudioQueueData(audioData);
+
+                // clear buffer idx position
+                audiobufFill_ = 0;
+            }
+		}
+		else
+		{
+			/* no pending audio; is there a pending packet to decode? */
+			if (ogg_stream_packetout(&oggVbStreamState_, &packet) > 0)
+			{
+                // lets the samples before the page's granule position be placed rather than dropped
+                if (seekAudioGranulePos_ >= 0 && packet.granulepos < 0)
+                {
+                    packet.granulepos = seekAudioGranulePos_;
+                }
+                seekAudioGranulePos_ = -1;
+
+				if (vorbis_synthesis(&vbBlock_, &packet) == 0) /* test for success! */
+				{
+					vorbis_synthesis_blockin(&vbDspState_, &vbBlock_);
+				}
+			}
+			else   /* we need more data; break out to suck in another page */
+			{
+				break;
+			}
+		}
+	}
+}
 
 void Theora::WaitExit()
 {
     SetThreadEnable(false);
 
-    do 
-    { 
-        Time::Sleep(1); 
+    // an unfinished open stops pre-rolling, the first frames are the last thing it does
+    if (openThread_->IsStarted())
+    {
+        openThread_->Stop();
+    }
+    opening_ = false;
+
+    if (managed_)
+    {
+        // a step never waits on a full queue, but unblock one anyway before
+        // waiting for it to return
+        wakeSignal_.Set();
+        manager_->RemoveStream(this);
+        managed_ = false;
+        wakeTime_ = NeverWakeTime;
+    }
+
+    // not started when init failed or driven synchronously
+    if (IsStarted())
+    {
+        // whatever the decoder is blocked on, it checks the enable flag once woken
+        wakeSignal_.Set();
+        Stop();
     }
-    while (!GetFnExited());
+
+    StopPipeline();
 }
 
-void Theora::SetThreadEnable(bool enable)
+void Theora::StartPipeline()
 {
-    MutexLock lock(mutexThreadEnable_);
-    threadEnabled_ = enable;
+    if (!prefetchWindow_ || pipelineRunning_ || !file_ || !file_->IsOpen())
+    {
+        return;
+    }
+
+    // picks up after the inline reads, whatever they left in the sync layer is demuxed first
+    unsigned offset = mappedFile_.IsOpen() ? mappedEnd_ : file_->GetPosition();
+    reader_.SetLooping(CanLoop(), (unsigned)Max(dataOffset_, (int64_t)0));
+    demuxFinished_ = false;
+    demuxEnabled_ = true;
+    waitingForPages_ = false;
+
+    if (!reader_.StartReading(file_, &mappedFile_, offset, prefetchWindow_, &demuxSignal_))
+    {
+        return;
+    }
+
+    // Vorbis pages are routed to the audio thread, a long video frame no longer holds audio back
+    if (vbPacket_)
+    {
+        audioSerialNo_ = oggVbStreamState_.serialno;
+        audioAdvanceTime_ = GetElapsedTime() + GetAudioLead();
+        audioWaitingForPages_ = false;
+        audioWaitingForSpace_ = false;
+        audioEnabled_ = true;
+        audioThreadRunning_ = true;
+        audioThread_->Run();
+        audioThread_->SetPriority(audioPriority_);
+    }
+
+    demuxThread_->Run();
+    pipelineRunning_ = true;
 }
 
-bool Theora::GetThreadEnabled()
+void Theora::StopPipeline()
 {
-    MutexLock lock(mutexThreadEnable_);
-    return threadEnabled_;
+    if (!pipelineRunning_)
+    {
+        return;
+    }
+
+    if (audioThreadRunning_)
+    {
+        audioEnabled_ = false;
+        audioSignal_.Set();
+        audioThread_->Stop();
+    }
+
+    demuxEnabled_ = false;
+    demuxSignal_.Set();
+    demuxThread_->Stop();
+    reader_.StopReading();
+
+    // the demuxer routes pages by it until it has stopped
+    audioThreadRunning_ = false;
+
+    while (SharedPtr<TheoraPage> page = pageQueue_.Pop())
+    {
+        ReleasePage(page, freePages_);
+    }
+    while (SharedPtr<TheoraPage> page = audioPageQueue_.Pop())
+    {
+        ReleasePage(page, freeAudioPages_);
+    }
+    if (heldPage_)
+    {
+        ReleasePage(heldPage_, freePages_);
+    }
+    if (heldAudioPage_)
+    {
+        ReleasePage(heldAudioPage_, freeAudioPages_);
+    }
+
+    pipelineRunning_ = false;
 }
 
-void Theora::SetFnExit(bool bset)
+void Theora::DemuxFunction()
 {
-    MutexLock lock(mutexExit_);
-    fnExited_ = bset;
+    SharedPtr<TheoraPage> page;
+    bool audioPage = false;
+
+    while (demuxEnabled_)
+    {
+        if (!page)
+        {
+            ogg_page oggPage;
+            if (PageOut(&oggPage) > 0)
+            {
+                page = AcquirePage(oggPage);
+                audioPage = audioThreadRunning_ && ogg_page_serialno(&oggPage) == audioSerialNo_;
+            }
+            else if (SharedPtr<TheoraChunk> chunk = reader_.Pop())
+            {
+                WriteChunk(chunk);
+                reader_.Release(chunk);
+                continue;
+            }
+            else if (reader_.IsFinished())
+            {
+                // the decoder drains what is queued, this stage idles until stopped
+                demuxFinished_ = true;
+                SignalPages();
+                demuxSignal_.Wait();
+                continue;
+            }
+            else
+            {
+                // starved by the I/O stage
+                HiresTimer timer;
+                demuxSignal_.Wait();
+                demuxStallUSec_ += timer.GetUSec(false);
+                continue;
+            }
+        }
+
+        if ((audioPage ? audioPageQueue_ : pageQueue_).Push(page))
+        {
+            SignalPages();
+        }
+        else
+        {
+            // the audio thread takes pages even while ahead of the clock, make sure it looks.
+            // the video decoder is far enough ahead, wait for it to take a page
+            if (audioPage)
+            {
+                audioSignal_.Set();
+            }
+            demuxSignal_.Wait();
+        }
+    }
+
+    if (page)
+    {
+        ReleasePage(page, freePages_);
+    }
 }
 
-bool Theora::GetFnExited()
+void Theora::WriteChunk(const TheoraChunk *chunk)
 {
-    MutexLock lock(mutexExit_);
-    return fnExited_;
+    // the reader looped, a page cut off by the end of the file is dropped
+    if (chunk->rewound_)
+    {
+        ++inputPass_;
+        mappedPosition_ = chunk->offset_;
+        ogg_sync_reset(&oggSyncState_);
+    }
+
+    // mapped chunks are consecutive spans of the mapping, the pages are cut in place
+    if (mappedFile_.IsOpen())
+    {
+        mappedEnd_ = chunk->offset_ + chunk->size_;
+        return;
+    }
+
+    char *buffer = ogg_sync_buffer(&oggSyncState_, chunk->size_);
+    memcpy(buffer, chunk->data_, chunk->size_);
+    ogg_sync_wrote(&oggSyncState_, chunk->size_);
 }
 
-bool Theora::OpenFile(const String& fileName)
+SharedPtr<TheoraPage> Theora::AcquirePage(const ogg_page &oggPage)
 {
-    file_ = new File(context_, fileName, FILE_READ);
-    return (file_ != 0 && file_->IsOpen());
+    SharedPtr<TheoraPage> page = freePages_.Pop();
+    if (!page)
+    {
+        page = freeAudioPages_.Pop();
+    }
+    if (!page)
+    {
+        page = new TheoraPage();
+    }
+
+    page->page_ = oggPage;
+    page->pass_ = inputPass_;
+
+    // the sync buffer is reused for the next chunk, the mapping stays
+    if (!mappedFile_.IsOpen())
+    {
+        page->buffer_.Resize(oggPage.header_len + oggPage.body_len);
+        memcpy(&page->buffer_[0], oggPage.header, oggPage.header_len);
+        memcpy(&page->buffer_[oggPage.header_len], oggPage.body, oggPage.body_len);
+        page->page_.header = &page->buffer_[0];
+        page->page_.body = &page->buffer_[oggPage.header_len];
+    }
+
+    return page;
 }
 
-bool Theora::FileEof() const
+void Theora::ReleasePage(SharedPtr<TheoraPage> &page, TheoraRingBuffer<TheoraPage> &freePages)
 {
-    if (!file_ || !file_->IsOpen())
+    // pool full - let it go
+    freePages.Push(page);
+    page.Reset();
+    demuxSignal_.Set();
+}
+
+void Theora::SignalPages()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (waitingForPages_.exchange(false))
     {
-      return true;
+        wakeSignal_.Set();
+    }
+    if (audioWaitingForPages_.exchange(false))
+    {
+        audioSignal_.Set();
     }
+}
 
-    return file_->IsEof();
+void Theora::FetchPages()
+{
+    if (!pipelineRunning_)
+    {
+        // pages of the next pass stay in the sync layer until each stream is done with this one
+        bool videoWaits = inputPass_ != videoPass_ && !StartVideoPass(inputPass_);
+        bool audioWaits = DecodesAudio() && inputPass_ != audioPass_ && !StartAudioPass(inputPass_);
+        if (videoWaits || audioWaits)
+        {
+            return;
+        }
+
+        if (!BufferData() && CanLoop())
+        {
+            // the end of the file, the next pass starts at the first data page
+            SeekFile(dataOffset_);
+            ++inputPass_;
+            return;
+        }
+
+        while (PageOut(&oggPage_) > 0)
+        {
+            QueuePage(&oggPage_);
+        }
+        return;
+    }
+
+    // about a read's worth of pages at a time, waiting only if the demuxer has none yet
+    SharedPtr<TheoraPage> page = heldPage_;
+    heldPage_.Reset();
+    if (!page)
+    {
+        page = pageQueue_.Pop();
+    }
+    if (!page)
+    {
+        page = WaitForPage();
+    }
+
+    for (long bytes = 0; page; page = pageQueue_.Pop())
+    {
+        // the first page of the next pass waits for the video stream to drain
+        if (page->pass_ != videoPass_ && !StartVideoPass(page->pass_))
+        {
+            heldPage_ = page;
+            break;
+        }
+
+        QueuePage(&page->page_);
+        bytes += page->page_.header_len + page->page_.body_len;
+        ReleasePage(page, freePages_);
+
+        if (bytes >= SyncBufferSize)
+        {
+            break;
+        }
+    }
 }
 
-int Theora::BufferData()
+SharedPtr<TheoraPage> Theora::WaitForPage()
 {
-    if (!file_ || !file_->IsOpen())
+    SharedPtr<TheoraPage> page;
+    HiresTimer timer;
+    bool stalled = false;
+
+    while (!demuxFinished_ && GetThreadEnabled())
     {
-      return 0;
+        waitingForPages_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // the demuxer may have pushed or finished before seeing the flag
+        if ((page = pageQueue_.Pop()) || demuxFinished_)
+        {
+            break;
+        }
+
+        stalled = true;
+        wakeSignal_.Wait();
+
+        if ((page = pageQueue_.Pop()))
+        {
+            break;
+        }
     }
 
-    // ask some buffer for putting data into stream
-    char* buffer = ogg_sync_buffer(&oggSyncState_, SyncBufferSize);
-    // read data from file
-    int bytes = file_->Read(buffer, SyncBufferSize);
-    // put readed data into Ogg stream
-    if (ogg_sync_wrote(&oggSyncState_, bytes) < 0)
+    waitingForPages_ = false;
+
+    // pages pushed before the demuxer finished
+    if (!page)
     {
-        bytes = 0;
+        page = pageQueue_.Pop();
     }
 
-    return bytes;
+    if (stalled)
+    {
+        ++stats_.decodeStalls_;
+        stats_.decodeStallMSec_ += timer.GetUSec(false) * 0.001f;
+    }
+
+    return page;
 }
 
-int Theora::QueuePage(ogg_page *page)
+void Theora::SetThreadEnable(bool enable)
 {
-  if (thPacket_)
-  {
-      ogg_stream_pagein(&oggThStreamState_, page);
-  }
-  if (vbPacket_)
-  {
-      ogg_stream_pagein(&oggVbStreamState_, page);
-  }
-  return 0;
+    threadEnabled_ = enable;
 }
 
-void Theora::VideoWrite()
+bool Theora::GetThreadEnabled() const
 {
-    th_ycbcr_buffer yuv;
-    th_decode_ycbcr_out(thDecCtx_, yuv);
+    return threadEnabled_;
+}
 
-    SharedPtr<VideoData> ptr(new VideoData());
-    ptr->size_ = theoraAVInfo_.videoFrameWidth_ * theoraAVInfo_.videoFrameHeight_ * RGBAComponentSize;
-    ptr->buf_ = new unsigned char[ptr->size_];
-    ptr->time_ = videobufTime_;
+bool Theora::OpenFile(const String& fileName)
+{
+    SharedPtr<File> file;
 
-    // convert
-    Yuv420pToRgba8888(yuv, ptr);
+    // not on disk, look in the resource directories and packages
+    FileSystem *fileSystem = context_->GetSubsystem<FileSystem>();
+    ResourceCache *cache = context_->GetSubsystem<ResourceCache>();
+    if (fileSystem && cache && !fileSystem->FileExists(fileName))
+    {
+        file = cache->GetFile(fileName, false);
+    }
+    else
+    {
+        file = new File(context_, fileName, FILE_READ);
+    }
 
-    // queue buffer
-    StoreVideoQueueData(ptr);
+    return OpenFile(file, fileName);
 }
 
-//=============================================================================
-// Function ref - below function is a modified version of nativeYuv420pToRgba8888
-// function found in Android Open Source Project (AOSP), APACHE LICENSE 2.0
-//=============================================================================
-void Theora::Yuv420pToRgba8888(const th_ycbcr_buffer &yuv, SharedPtr<VideoData> ptr) 
+bool Theora::OpenFile(File *file, const String& fileName)
 {
-    uint8* pInY = yuv[0].data;
-    uint8* pInU = yuv[1].data;
-    uint8* pInV = yuv[2].data;
-    Rgba* pOutColor = (Rgba*)ptr->buf_.Get();
-    int width = yuv[1].width;
-    int height = yuv[1].height;
+    fileName_ = fileName;
+    file_ = file;
 
-    if (!pInY || !pInU || !pInV || !pOutColor)
+    if (!file_ || !file_->IsOpen())
     {
-        return;
+        return false;
+    }
+
+    // a handle passed in may have been read from already
+    file_->Seek(0);
+
+    // a resource name found in a resource directory, map it and keep its keyframe index
+    // sidecar by the path it was found at
+    if (!file_->IsPackaged())
+    {
+        fileName_ = file_->GetName();
     }
 
-    for (int y = 0; y < height; ++y)
+    // package entries share the package file, and may be compressed
+    if (mappedInput_ && !file_->IsPackaged() && mappedFile_.Open(fileName_) && mappedFile_.GetSize() == file_->GetSize())
     {
-      for (int x = 0; x < width; ++x)
-      {
-        int u, v, y1, y2, y3, y4;
+        mappedEnd_ = 0;
+        mappedPosition_ = 0;
+    }
+    else
+    {
+        mappedFile_.Close();
+    }
+
+    return true;
+}
+
+void Theora::AudioFunction()
+{
+    while (audioEnabled_)
+    {
+        // compressed data is cheap to hold, taking every page keeps the demuxer from waiting on audio.
+        // the first page of the next pass waits for the Vorbis stream to drain
+        SharedPtr<TheoraPage> page = heldAudioPage_;
+        heldAudioPage_.Reset();
+        for (page = page ? page : audioPageQueue_.Pop(); page; page = audioPageQueue_.Pop())
+        {
+            if (page->pass_ != audioPass_ && !StartAudioPass(page->pass_))
+            {
+                heldAudioPage_ = page;
+                break;
+            }
 
-        y1 = pInY[x*2];
-        y2 = pInY[x*2 + 1];
-        y3 = pInY[x*2 + yuv[0].stride];
-        y4 = pInY[x*2 + yuv[0].stride + 1];
+            QueueAudioPage(&page->page_);
+            ReleasePage(page, freeAudioPages_);
+        }
 
-        u = pInU[x] - 128;
-        v = pInV[x] - 128;
+        audioAdvanceTime_ = GetElapsedTime() + GetAudioLead();
 
-        pOutColor[x*2] = convertYuvToRgba(y1, u, v);
-        pOutColor[x*2 + 1] = convertYuvToRgba(y2, u, v);
-        pOutColor[x*2 + yuv[0].width] = convertYuvToRgba(y3, u, v);
-        pOutColor[x*2 + yuv[0].width + 1] = convertYuvToRgba(y4, u, v);
-      }
+        if (!audioFinished_ && audioTime_ < audioAdvanceTime_)
+        {
+            audiobufReady_ = 0;
+            DecodeAudio();
 
-      pInU += yuv[1].stride;
-      pInV += yuv[2].stride;
-      pInY += yuv[0].stride * 2;
-      pOutColor += yuv[0].width * 2;
+            // out of packets
+            if (!audiobufReady_)
+            {
+                WaitForAudioPages();
+            }
+            continue;
+        }
+
+        // ahead of the clock, or done - sleep until audio falls behind its lead again
+        int64_t wakeTime = audioFinished_ ? NeverWakeTime : audioTime_ - GetAudioLead();
+        audioWakeTime_ = wakeTime;
+
+        if (GetElapsedTime() < wakeTime && audioEnabled_)
+        {
+            audioSignal_.Wait();
+        }
+
+        audioWakeTime_ = NeverWakeTime;
     }
 }
 
+void Theora::WaitForAudioPages()
+{
+    // out of packets with a page of the next pass held, it can go in now
+    if (heldAudioPage_)
+    {
+        return;
+    }
+
+    audioWaitingForPages_ = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // finished first, pages pushed before it are still queued
+    if (demuxFinished_ && !audioPageQueue_.Size())
+    {
+        audioFinished_ = true;
+    }
+    else if (!audioPageQueue_.Size() && audioEnabled_)
+    {
+        // audio is due and the demuxer has not got that far
+        HiresTimer timer;
+        audioSignal_.Wait();
+        audioStallUSec_ += timer.GetUSec(false);
+        ++audioStalls_;
+    }
+
+    audioWaitingForPages_ = false;
+}
+
+bool Theora::FileEof() const
+{
+    if (!file_ || !file_->IsOpen())
+    {
+      return true;
+    }
+
+    // the file itself belongs to the I/O stage
+    if (pipelineRunning_)
+    {
+        return demuxFinished_ && !pageQueue_.Size();
+    }
+
+    if (mappedFile_.IsOpen())
+    {
+        return mappedEnd_ >= mappedFile_.GetSize();
+    }
+
+    return file_->IsEof();
+}
+
+int Theora::BufferData()
+{
+    if (!file_ || !file_->IsOpen())
+    {
+      return 0;
+    }
+
+    // mapped - only widen the span pages are cut from, at the same pace as reads
+    if (mappedFile_.IsOpen())
+    {
+        unsigned bytes = Min((unsigned)SyncBufferSize, mappedFile_.GetSize() - mappedEnd_);
+        mappedEnd_ += bytes;
+        stats_.inputBytes_ += bytes;
+        return (int)bytes;
+    }
+
+    // ask some buffer for putting data into stream
+    char* buffer = ogg_sync_buffer(&oggSyncState_, SyncBufferSize);
+    // read data from file
+    int bytes = file_->Read(buffer, SyncBufferSize);
+    // put readed data into Ogg stream
+    if (ogg_sync_wrote(&oggSyncState_, bytes) < 0)
+    {
+        bytes = 0;
+    }
+
+    stats_.inputBytes_ += bytes;
+    ++stats_.inputReads_;
+
+    return bytes;
+}
+
+long Theora::PageSeek(ogg_page *page)
+{
+    if (!mappedFile_.IsOpen())
+    {
+        return ogg_sync_pageseek(&oggSyncState_, page);
+    }
+
+    // same contract as ogg_sync_pageseek(), but the page points into the mapping
+    const unsigned char *data = mappedFile_.GetData() + mappedPosition_;
+    unsigned available = mappedEnd_ - mappedPosition_;
+
+    if (available < OggPageHeaderSize)
+    {
+        return 0;
+    }
+
+    if (memcmp(data, "OggS", 4) == 0)
+    {
+        unsigned headerSize = OggPageHeaderSize + data[26];
+        if (available < headerSize)
+        {
+            return 0;
+        }
+
+        unsigned bodySize = 0;
+        for (unsigned i = OggPageHeaderSize; i < headerSize; ++i)
+        {
+            bodySize += data[i];
+        }
+        if (available < headerSize + bodySize)
+        {
+            return 0;
+        }
+
+        page->header = const_cast<unsigned char*>(data);
+        page->header_len = headerSize;
+        page->body = const_cast<unsigned char*>(data + headerSize);
+        page->body_len = bodySize;
+
+        if (GetPageChecksum(page) == (unsigned)(data[22] | (data[23] << 8) | (data[24] << 16) | ((unsigned)data[25] << 24)))
+        {
+            mappedPosition_ += headerSize + bodySize;
+            return (long)(headerSize + bodySize);
+        }
+    }
+
+    // not a page, skip to the next capture pattern candidate
+    const unsigned char *next = static_cast<const unsigned char*>(memchr(data + 1, 'O', available - 1));
+    unsigned skipped = next ? (unsigned)(next - data) : available;
+    mappedPosition_ += skipped;
+    return -(long)skipped;
+}
+
+int Theora::PageOut(ogg_page *page)
+{
+    if (!mappedFile_.IsOpen())
+    {
+        return ogg_sync_pageout(&oggSyncState_, page);
+    }
+
+    long ret;
+    while ((ret = PageSeek(page)) < 0)
+    {
+    }
+    return ret > 0 ? 1 : 0;
+}
+
+// Ogg CRC-32, polynomial 0x04c11db7, no reflection - sliced by 8 like libogg, the
+// byte-at-a-time loop costs more than the read and copy mapping saves
+static unsigned UpdatePageChecksum(unsigned crc, const unsigned char *data, long size)
+{
+    static const struct ChecksumTables
+    {
+        ChecksumTables()
+        {
+            for (unsigned i = 0; i < 256; ++i)
+            {
+                unsigned r = i << 24;
+                for (int j = 0; j < 8; ++j)
+                {
+                    r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : r << 1;
+                }
+                values_[0][i] = r;
+            }
+            for (unsigned i = 0; i < 256; ++i)
+            {
+                for (int j = 1; j < 8; ++j)
+                {
+                    values_[j][i] = values_[0][values_[j - 1][i] >> 24] ^ (values_[j - 1][i] << 8);
+                }
+            }
+        }
+        unsigned values_[8][256];
+    } tables;
+    const unsigned (*t)[256] = tables.values_;
+
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        crc ^= ((unsigned)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+        crc = t[7][crc >> 24] ^ t[6][(crc >> 16) & 0xff] ^ t[5][(crc >> 8) & 0xff] ^ t[4][crc & 0xff] ^
+              t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+    for (; size > 0; --size)
+    {
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+unsigned Theora::GetPageChecksum(const ogg_page *page)
+{
+    // the checksum field is taken as zero
+    static const unsigned char zeroChecksum[4] = { 0, 0, 0, 0 };
+
+    unsigned crc = UpdatePageChecksum(0, page->header, 22);
+    crc = UpdatePageChecksum(crc, zeroChecksum, 4);
+    crc = UpdatePageChecksum(crc, page->header + 26, page->header_len - 26);
+    return UpdatePageChecksum(crc, page->body, page->body_len);
+}
+
+void Theora::SetPrefetchWindow(unsigned bytes)
+{
+    prefetchWindow_ = bytes;
+}
+
+unsigned Theora::GetPrefetchWindow() const
+{
+    return prefetchWindow_;
+}
+
+void Theora::SetAudioLead(unsigned msec)
+{
+    audioLeadMSec_ = msec;
+}
+
+unsigned Theora::GetAudioLead() const
+{
+    return audioLeadMSec_ ? audioLeadMSec_ : static_cast<unsigned>(1000.0f * AudioAdvanceFrames / theoraAVInfo_.videoFrameRate_);
+}
+
+void Theora::SetAudioPriority(int priority)
+{
+    audioPriority_ = priority;
+}
+
+int Theora::GetAudioPriority() const
+{
+    return audioPriority_;
+}
+
+bool Theora::IsAudioFinished() const
+{
+    return audioFinished_;
+}
+
+void Theora::SetManaged(bool enable)
+{
+    useManager_ = enable;
+}
+
+bool Theora::GetManaged() const
+{
+    return useManager_;
+}
+
+bool Theora::IsManaged() const
+{
+    return managed_;
+}
+
+bool Theora::IsStepReady()
+{
+    if (!GetThreadEnabled())
+    {
+        return false;
+    }
+
+    // a resume is ready whatever the wake time a step in flight left
+    if (resumePending_)
+    {
+        return true;
+    }
+
+    if (GetElapsedTime() < wakeTime_)
+    {
+        return false;
+    }
+
+    if (!HasQueueSpace())
+    {
+        waitingForSpace_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // the consumer may have popped before seeing the flag
+        return HasQueueSpace();
+    }
+
+    return true;
+}
+
+int64_t Theora::GetStepSlack() const
+{
+    // each LOD below full counts as this much further ahead, so small and hidden
+    // streams fall behind first when the pool can't keep up
+    return decodedTime_ - elapsedTime_ + requestedLod_ * LodStepSlackMSec;
+}
+
+void Theora::DecodeStep()
+{
+    UpdateTimer();
+
+    bool decodedAll = false;
+
+    if (NeedsFrames())
+    {
+        int progress = GetDecodeProgress();
+        UpdateFrames(true);
+        decodedAll = FileEof() && GetDecodeProgress() == progress;
+    }
+
+    UpdateTimer();
+
+    decodedTime_ = DecodesAudio() ? Min(videobufTime_, audioTime_) : videobufTime_;
+    // ready again straight away while behind, otherwise once the clock gets there
+    wakeTime_ = NeedsFrames() && !decodedAll ? std::numeric_limits<int64_t>::min() : GetWakeTime(decodedAll);
+}
+
+bool Theora::HasQueueSpace() const
+{
+    // a step queues at most one of each
+    return videoBufferQueue_.Size() < VideoQueueCapacity &&
+           audioBufferQueue_.Size() < AudioQueueCapacity;
+}
+
+void Theora::SetMappedInput(bool enable)
+{
+    mappedInput_ = enable;
+}
+
+bool Theora::GetMappedInput() const
+{
+    return mappedInput_;
+}
+
+bool Theora::IsInputMapped() const
+{
+    return mappedFile_.IsOpen();
+}
+
+int Theora::QueuePage(ogg_page *page)
+{
+  if (skPacket_)
+  {
+      ogg_stream_pagein(&oggSkStreamState_, page);
+      ReadSkeletonPackets();
+  }
+  if (thPacket_)
+  {
+      ogg_stream_pagein(&oggThStreamState_, page);
+  }
+  if (DecodesAudio())
+  {
+      QueueAudioPage(page);
+  }
+  return 0;
+}
+
+void Theora::QueueAudioPage(ogg_page *page)
+{
+    // the first Vorbis data page after a seek, its packets carry no positions until the
+    // last. header pages, read again when seeking near the start, have granule position 0
+    if (seekSample_ >= 0 && !seekAudioPageSeen_ && ogg_page_serialno(page) == oggVbStreamState_.serialno &&
+        ogg_page_granulepos(page) != 0)
+    {
+        seekAudioPageSeen_ = true;
+        seekAudioGranulePos_ = GetFirstPacketGranulePos(page);
+    }
+
+    ogg_stream_pagein(&oggVbStreamState_, page);
+}
+
+bool Theora::DecodesAudio() const
+{
+    return vbPacket_ && !audioThreadRunning_;
+}
+
+void Theora::VideoWrite()
+{
+    SharedPtr<VideoData> ptr;
+
+    if (dropFrame_)
+    {
+        // frames before a seek target are expected, not late
+        if (reducedFrame_)
+        {
+            ++reduced_;
+        }
+        else if (seekFrame_ < 0)
+        {
+            ++dropped_;
+        }
+        stats_.frames_ = frames_;
+        stats_.framesDropped_ = dropped_;
+        stats_.framesReduced_ = reduced_;
+        PublishStats();
+        return;
+    }
+
+    if (UseStripeConversion())
+    {
+        // already converted stripe by stripe inside th_decode_packetin()
+        ptr = stripeFrame_;
+        stripeFrame_.Reset();
+
+        if (!ptr)
+        {
+            return;
+        }
+    }
+    else
+    {
+        th_ycbcr_buffer frame, yuv;
+        th_decode_ycbcr_out(thDecCtx_, frame);
+        yuvConverter_.CropPicture(frame, yuv);
+
+        // convert
+        ptr = videoDataPool_.Acquire();
+        if (decodeLod_ == DECODE_LOD_FULL)
+        {
+            YuvToRgba8888(yuv, ptr);
+        }
+        else
+        {
+            // a quarter of the pixels to convert and upload
+            th_ycbcr_buffer half;
+            YuvConverter::HalvePicture(yuv, half, &halfPicture_[0]);
+            ConvertBands(workQueue_, halfConverter_, half, ptr->buf_, half[0].width * RGBAComponentSize, conversionBands_);
+
+            ptr->width_ = half[0].width;
+            ptr->height_ = half[0].height;
+        }
+    }
+
+    if (!ptr->width_ || decodeLod_ == DECODE_LOD_FULL)
+    {
+        ptr->width_ = theoraAVInfo_.videoFrameWidth_;
+        ptr->height_ = theoraAVInfo_.videoFrameHeight_;
+    }
+    ptr->size_ = ptr->width_ * ptr->height_ * RGBAComponentSize;
+    ptr->time_ = videobufTime_;
+
+    // before queueing, a full queue is not decode time
+    UpdatePostProcess(decodeTimer_.GetUSec(false));
+
+    // queue buffer
+    StoreVideoQueueData(ptr);
+}
+
+void Theora::SetStripeCallback()
+{
+    if (thDecCtx_)
+    {
+        th_stripe_callback cb;
+        cb.ctx = this;
+        cb.stripe_decoded = UseStripeConversion() ? &Theora::StripeDecoded : NULL;
+        th_decode_ctl(thDecCtx_, TH_DECCTL_SET_STRIPE_CB, &cb, sizeof(cb));
+    }
+}
+
+void Theora::StripeDecoded(void *ctx, th_ycbcr_buffer frame, int yfrag0, int yfragEnd)
+{
+    Theora *theora = static_cast<Theora*>(ctx);
+
+    if (theora->dropFrame_)
+    {
+        return;
+    }
+
+    // fragment rows are 8 pixels high and the picture starts on a chroma row,
+    // so for 4:2:0 each stripe starts on a chroma row pair and 4:2:2/4:4:4
+    // stripes map 1:1 onto chroma rows
+    int rowBegin = yfrag0 * 8;
+    int rowEnd = Min(yfragEnd * 8, frame[0].height);
+
+    // stripes of padding only
+    if (!theora->yuvConverter_.ClipRows(rowBegin, rowEnd))
+    {
+        return;
+    }
+
+    // first stripe of a new frame; 0-byte (duplicate) frames make no callbacks
+    if (!theora->stripeFrame_)
+    {
+        theora->stripeFrame_ = theora->videoDataPool_.Acquire();
+    }
+
+    th_ycbcr_buffer yuv;
+    theora->yuvConverter_.CropPicture(frame, yuv);
+    theora->yuvConverter_.Convert(yuv, theora->stripeFrame_->buf_, yuv[0].width * RGBAComponentSize, rowBegin, rowEnd);
+}
+
+bool Theora::UseStripeConversion() const
+{
+    // half resolution output is filtered from the whole frame
+    return stripeConversion_ && (conversionBands_ <= 1 || !workQueue_) && decodeLod_ == DECODE_LOD_FULL;
+}
+
+void Theora::ApplyDecodeLod()
+{
+    decodeLod_ = static_cast<TheoraDecodeLod>(requestedLod_.load());
+
+    // post-processing doesn't show at half size, UpdatePostProcess() raises it again at full
+    if (decodeLod_ != DECODE_LOD_FULL && postProcessLevel_ + postProcessIncrement_ > 0)
+    {
+        postProcessIncrement_ = -postProcessLevel_;
+    }
+
+    SetStripeCallback();
+}
+
+void Theora::ResumeDecoding()
+{
+    HiresTimer timer;
+
+    // the pipeline threads read on from where they stopped, they are restarted at the keyframe
+    bool pipeline = pipelineRunning_;
+    StopPipeline();
+
+    // the consumer owns the clock, decoding lands on the time it had when the resume was seen
+    Reposition(GetElapsedTime());
+    UpdateTimer();
+
+    if (pipeline)
+    {
+        StartPipeline();
+    }
+
+    stats_.lastSeekMSec_ = timer.GetUSec(false) * 0.001f;
+    PublishStats();
+}
+
+void Theora::SetDecodeLod(TheoraDecodeLod lod)
+{
+    // nothing was read while paused, the decoder would be catching up from where it stopped.
+    // what it queued before the pause is dropped here on the consumer side, the seek is left
+    // to the decode thread or manager step, ahead of its next packet
+    if (requestedLod_ == DECODE_LOD_PAUSED && lod != DECODE_LOD_PAUSED && (IsStarted() || managed_))
+    {
+        while (GetVideoQueueData())
+        {
+        }
+        while (GetAudioQueueData())
+        {
+        }
+
+        resumePending_ = true;
+        requestedLod_ = lod;
+
+        if (managed_)
+        {
+            manager_->Wake();
+        }
+        else
+        {
+            wakeSignal_.Set();
+        }
+        return;
+    }
+
+    requestedLod_ = lod;
+}
+
+TheoraDecodeLod Theora::GetDecodeLod() const
+{
+    return static_cast<TheoraDecodeLod>(requestedLod_.load());
+}
+
+void Theora::YuvToRgba8888(const th_ycbcr_buffer &yuv, SharedPtr<VideoData> ptr) 
+{
+    ConvertBands(workQueue_, yuvConverter_, yuv, ptr->buf_, yuv[0].width * RGBAComponentSize, conversionBands_);
+}
+
+void Theora::ConvertBands(TheoraWorkQueue *workQueue, const YuvConverter &converter, const th_img_plane yuv[3],
+                          unsigned char *rgba, int rgbaStride, unsigned numBands)
+{
+    if (!workQueue || numBands <= 1)
+    {
+        converter.Convert(yuv, rgba, rgbaStride, 0, yuv[0].height);
+        return;
+    }
+
+    YuvBand bands[MaxConversionBands];
+    TheoraWorkItem items[MaxConversionBands];
+    unsigned count = converter.SetupBands(yuv, rgba, rgbaStride, bands, Min(numBands, MaxConversionBands));
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        items[i].workFunction_ = ConvertBandWork;
+        items[i].aux_ = &bands[i];
+    }
+
+    // returns once every band is converted
+    workQueue->Run(items, count);
+}
+
+void Theora::ConvertBandWork(const TheoraWorkItem *item, unsigned)
+{
+    YuvConverter::ConvertBand(*static_cast<const YuvBand*>(item->aux_));
+}
+
+bool Theora::SkipToKeyframe(ogg_packet *packet)
+{
+    int64_t frameIndex = packet->granulepos >= 0 ? th_granule_frame(thDecCtx_, packet->granulepos) : lastFrameIndex_ + 1;
+    bool keyframe = th_packet_iskeyframe(packet) == 1;
+
+    if (packet->granulepos >= 0)
+    {
+        frameIndexKnown_ = true;
+    }
+    else if (keyframe && !frameIndexKnown_ && seekKeyframe_ >= 0)
+    {
+        // an index seek can land after the last granule position before the keyframe
+        frameIndex = seekKeyframe_;
+        frameIndexKnown_ = true;
+    }
+
+    // decoding towards a seek target is not falling behind
+    if (seekFrame_ >= 0 && frameIndex >= seekFrame_)
+    {
+        seekFrame_ = -1;
+    }
+
+    // not shown at this LOD, skipped the same way as catching up
+    bool lodSkip = decodeLod_ >= DECODE_LOD_AUDIO || (decodeLod_ == DECODE_LOD_KEYFRAMES && !keyframe);
+
+    if (!catchingUp_)
+    {
+        if (!lodSkip && (keyframe || seekFrame_ >= 0 || !IsFrameLate(frameIndex + CatchUpLagFrames)))
+        {
+            return false;
+        }
+
+        catchingUp_ = true;
+        if (!lodSkip)
+        {
+            ++stats_.catchUps_;
+        }
+    }
+
+    // a keyframe needs a known frame index to restart from
+    if (keyframe && frameIndexKnown_ && !lodSkip)
+    {
+        // the decoder never saw the skipped packets, move its frame count on to the keyframe
+        catchingUp_ = false;
+        ogg_int64_t granulePos = (frameIndex + GetGranuleBias()) << thInfo_.keyframe_granule_shift;
+        th_decode_ctl(thDecCtx_, TH_DECCTL_SET_GRANPOS, &granulePos, sizeof(granulePos));
+        return false;
+    }
+
+    lastFrameIndex_ = frameIndex;
+    if (frameIndexKnown_)
+    {
+        videobufTime_ = GetFrameTime(frameIndex) + GetPassTime(videoPass_);
+    }
+
+    // skipping to a seek target's keyframe is not catching up
+    if (lodSkip)
+    {
+        ++reduced_;
+        stats_.framesReduced_ = reduced_;
+        PublishStats();
+    }
+    else if (seekFrame_ < 0)
+    {
+        ++skipped_;
+        stats_.framesSkipped_ = skipped_;
+        PublishStats();
+    }
+    return true;
+}
+
+bool Theora::Seek(int64_t timeMSec)
+{
+    if (!theoraAVInfo_.initialized_ || !thPacket_)
+    {
+        return false;
+    }
+
+    HiresTimer timer;
+
+    // the decode thread or a manager worker owns the decoder and file state, park it
+    bool wasRunning = IsStarted() || managed_;
+    if (wasRunning)
+    {
+        WaitExit();
+    }
+
+    // this is the consumer side, drop everything queued before the seek
+    while (GetVideoQueueData())
+    {
+    }
+    while (GetAudioQueueData())
+    {
+    }
+
+    // covers a resume the decode side didn't get to
+    resumePending_ = false;
+
+    // decoding up to the target is left to the decode thread, with nobody consuming
+    // audio here the queue could fill before the target frame is reached
+    elapsedTime_ = Reposition(timeMSec);
+    SetThreadEnable(true);
+    UpdateTimer();
+
+    stats_.lastSeekMSec_ = timer.GetUSec(false) * 0.001f;
+    PublishStats();
+
+    if (wasRunning)
+    {
+        StartProcess();
+    }
+
+    return true;
+}
+
+int64_t Theora::Reposition(int64_t timeMSec)
+{
+    // looping, the clock runs on across passes - seek within the clip, in the pass of the time
+    unsigned pass = 0;
+    if (CanLoop() && timeMSec > 0)
+    {
+        pass = static_cast<unsigned>(timeMSec / theoraAVInfo_.durationMSec_);
+        timeMSec -= GetPassTime(pass);
+    }
+
+    if (theoraAVInfo_.durationMSec_)
+    {
+        timeMSec = Clamp(timeMSec, (int64_t)0, (int64_t)theoraAVInfo_.durationMSec_);
+    }
+    int64_t targetFrame = timeMSec * thInfo_.fps_numerator / (1000 * (int64_t)thInfo_.fps_denominator);
+
+    seekReads_ = 0;
+
+    int64_t offset = 0;
+    int64_t keyframeIndex = -1;
+    // frames are shown from the time they end, the one on screen at the target is the frame before
+    const TheoraKeyframe *keyframe = seekIndex_ && IsKeyframeIndexReady() ?
+                                     keyframeIndex_.Find(Max(targetFrame - 1, (int64_t)0)) : 0;
+    if (keyframe)
+    {
+        offset = keyframe->offset_;
+        keyframeIndex = keyframe->frame_;
+    }
+    else if (targetFrame > 0)
+    {
+        // the keyframe of the last frame before the target, then the page that frame
+        // completes on - the keyframe packet starts after it
+        int64_t granulePos = -1;
+        if (FindPageBefore(targetFrame, &granulePos) >= 0 && granulePos >= 0)
+        {
+            keyframeIndex = (granulePos >> thInfo_.keyframe_granule_shift) - GetGranuleBias();
+            offset = keyframeIndex > 0 ? Max(FindPageBefore(keyframeIndex, &granulePos), (int64_t)0) : 0;
+        }
+    }
+
+    SeekFile(offset);
+    ResetDecoders();
+
+    // the one read an indexed seek needs, decoding continues from this buffer
+    if (BufferData())
+    {
+        ++seekReads_;
+    }
+
+    // decode from the keyframe, discarding up to the target
+    seekFrame_ = targetFrame;
+    seekKeyframe_ = keyframeIndex;
+    seekSample_ = vbPacket_ ? timeMSec * vbInfo_->rate / 1000 : -1;
+    seekAudioGranulePos_ = -1;
+    seekAudioPageSeen_ = false;
+    catchingUp_ = true;
+    frameIndexKnown_ = false;
+    lastFrameIndex_ = -1;
+    inputPass_ = pass;
+    videoPass_ = pass;
+    audioPass_ = pass;
+
+    stats_.seeks_++;
+    stats_.lastSeekReads_ = seekReads_;
+    stats_.lastSeekIndexed_ = keyframe != 0;
+
+    return timeMSec + GetPassTime(pass);
+}
+
+void Theora::SeekFile(int64_t offset)
+{
+    if (mappedFile_.IsOpen())
+    {
+        mappedPosition_ = mappedEnd_ = static_cast<unsigned>(Min(offset, (int64_t)mappedFile_.GetSize()));
+    }
+    else
+    {
+        file_->Seek(static_cast<unsigned>(offset));
+    }
+    ogg_sync_reset(&oggSyncState_);
+    seekOffset_ = offset;
+}
+
+int64_t Theora::GetNextPage(ogg_page *page, int64_t boundary)
+{
+    while (true)
+    {
+        if (boundary > 0 && seekOffset_ >= boundary)
+        {
+            return -1;
+        }
+
+        long more = PageSeek(page);
+        if (more < 0)
+        {
+            // skipped bytes while looking for a capture pattern
+            seekOffset_ -= more;
+        }
+        else if (more == 0)
+        {
+            if (!BufferData())
+            {
+                return -1;
+            }
+            ++seekReads_;
+        }
+        else
+        {
+            int64_t pageOffset = seekOffset_;
+            seekOffset_ += more;
+            return pageOffset;
+        }
+    }
+}
+
+bool Theora::IsTheoraPage(ogg_page *page) const
+{
+    return ogg_page_serialno(page) == oggThStreamState_.serialno && ogg_page_granulepos(page) >= 0;
+}
+
+int64_t Theora::FindPageBefore(int64_t frameIndex, int64_t *granulePos)
+{
+    int64_t begin = 0;
+    int64_t end = file_->GetSize();
+    int64_t best = -1;
+    ogg_page page;
+
+    // bisect on the first Theora page with a granule position after the midpoint
+    while (end - begin > SeekLinearBytes)
+    {
+        int64_t mid = begin + (end - begin) / 2;
+        int64_t pageOffset;
+
+        SeekFile(mid);
+        while ((pageOffset = GetNextPage(&page, end)) >= 0 && !IsTheoraPage(&page))
+        {
+        }
+
+        if (pageOffset >= 0 && th_granule_frame(thDecCtx_, ogg_page_granulepos(&page)) < frameIndex)
+        {
+            begin = seekOffset_;
+            best = pageOffset;
+            *granulePos = ogg_page_granulepos(&page);
+        }
+        else
+        {
+            end = mid;
+        }
+    }
+
+    // the last Theora page before the frame is within a short scan of begin
+    SeekFile(begin);
+    int64_t pageOffset;
+    while ((pageOffset = GetNextPage(&page, 0)) >= 0)
+    {
+        if (IsTheoraPage(&page))
+        {
+            if (th_granule_frame(thDecCtx_, ogg_page_granulepos(&page)) >= frameIndex)
+            {
+                break;
+            }
+
+            best = pageOffset;
+            *granulePos = ogg_page_granulepos(&page);
+        }
+    }
+
+    return best;
+}
+
+void Theora::ResetDecoders()
+{
+    ogg_stream_reset(&oggThStreamState_);
+    if (vbPacket_)
+    {
+        ogg_stream_reset(&oggVbStreamState_);
+        vorbis_synthesis_restart(&vbDspState_);
+    }
+
+    stripeFrame_.Reset();
+    dropFrame_ = false;
+    videobufReady_ = 0;
+    videobufTime_ = 0;
+    audiobufReady_ = 0;
+    audiobufFill_ = 0;
+    audiobufGranulePos_ = 0;
+    audioTime_ = 0;
+    audioFinished_ = false;
+}
+
+int64_t Theora::GetFirstPacketGranulePos(ogg_page *page)
+{
+    if (ogg_page_granulepos(page) < 0)
+    {
+        return -1;
+    }
+
+    // walk the page's packets in a scratch stream, each one after the first
+    // ends half of its own and of the previous block later
+    ogg_stream_state streamState;
+    ogg_stream_init(&streamState, ogg_page_serialno(page));
+    ogg_stream_pagein(&streamState, page);
+
+    ogg_packet packet;
+    int64_t samples = 0;
+    long lastBlockSize = -1;
+    int result;
+    while ((result = ogg_stream_packetout(&streamState, &packet)) != 0)
+    {
+        // a fresh stream reports a gap before the first packet
+        if (result < 0)
+        {
+            continue;
+        }
+
+        long blockSize = vorbis_packet_blocksize(vbInfo_, &packet);
+        if (blockSize > 0)
+        {
+            if (lastBlockSize > 0)
+            {
+                samples += (lastBlockSize + blockSize) / 4;
+            }
+            lastBlockSize = blockSize;
+        }
+    }
+
+    ogg_stream_clear(&streamState);
+
+    return lastBlockSize > 0 ? ogg_page_granulepos(page) - samples : -1;
+}
+
+void Theora::ScanDuration()
+{
+    if (!thPacket_ || !file_)
+    {
+        return;
+    }
+
+    // the last Theora granule position near the end of the file, read through a
+    // separate sync state so the decoder's buffered pages stay as they are
+    unsigned position = file_->GetPosition();
+    unsigned size = file_->GetSize();
+    unsigned start = size > DurationScanBytes ? size - (unsigned)DurationScanBytes : 0;
+
+    ogg_sync_state syncState;
+    ogg_sync_init(&syncState);
+    file_->Seek(start);
+
+    int64_t lastFrame = -1;
+    ogg_page page;
+    int bytes;
+    do
+    {
+        char *buffer = ogg_sync_buffer(&syncState, SyncBufferSize);
+        bytes = file_->Read(buffer, SyncBufferSize);
+        ogg_sync_wrote(&syncState, bytes);
+
+        while (ogg_sync_pageout(&syncState, &page) > 0)
+        {
+            if (ogg_page_serialno(&page) == oggThStreamState_.serialno && ogg_page_granulepos(&page) >= 0)
+            {
+                lastFrame = Max(lastFrame, (int64_t)th_granule_frame(thDecCtx_, ogg_page_granulepos(&page)));
+            }
+        }
+    }
+    while (bytes > 0);
+
+    ogg_sync_clear(&syncState);
+    file_->Seek(position);
+
+    if (lastFrame >= 0)
+    {
+        theoraAVInfo_.durationMSec_ = static_cast<unsigned>(GetFrameTime(lastFrame));
+    }
+}
+
+void Theora::ReadSkeletonPackets()
+{
+    ogg_packet packet;
+    int ret;
+    while (skPacket_ && (ret = ogg_stream_packetout(&oggSkStreamState_, &packet)) != 0)
+    {
+        if (ret < 0)
+        {
+            continue;
+        }
+
+        // index packets are only defined from Skeleton 4.0 on
+        if (thPacket_ && skVersionMajor_ >= 4 &&
+            keyframeIndex_.ReadSkeletonIndex(&packet, oggThStreamState_.serialno, thInfo_.fps_numerator, thInfo_.fps_denominator))
+        {
+            URHO3D_LOGINFOF("Skeleton index: %u keyframes.", keyframeIndex_.GetSize());
+        }
+
+        if (packet.e_o_s)
+        {
+            ogg_stream_clear(&oggSkStreamState_);
+            skPacket_ = 0;
+        }
+    }
+}
+
+void Theora::SetupKeyframeIndex()
+{
+    // read with the Skeleton headers
+    if (!keyframeIndex_.IsEmpty())
+    {
+        indexReady_ = true;
+        return;
+    }
+
+    if (!seekIndex_ || !thPacket_ || !file_ || indexThread_->IsStarted())
+    {
+        return;
+    }
+
+    // a sidecar written for another version of the file is not used. package entries have
+    // no modification time of their own, they are scanned each time
+    if (!file_->IsPackaged())
+    {
+        FileSystem *fileSystem = context_ ? context_->GetSubsystem<FileSystem>() : 0;
+        unsigned modified = fileSystem ? fileSystem->GetLastModifiedTime(fileName_) : 0;
+        String indexName = TheoraKeyframeIndex::GetSidecarName(context_, fileName_);
+
+        if (!indexName.Empty() && keyframeIndex_.Load(indexName, file_->GetSize(), modified))
+        {
+            indexReady_ = true;
+            URHO3D_LOGINFOF("Keyframe index: %u keyframes mapped from %s.", keyframeIndex_.GetSize(), indexName.CString());
+            return;
+        }
+    }
+
+    // the scan reads every page header of the file, seeks bisect until it is done
+    indexEnabled_ = true;
+    indexThread_->Run();
+}
+
+void Theora::IndexFunction()
+{
+    HiresTimer timer;
+    if (!BuildKeyframeIndex())
+    {
+        return;
+    }
+
+    // seeks use it from here on
+    indexReady_.store(true, std::memory_order_release);
+    float scanMSec = timer.GetUSec(false) * 0.001f;
+
+    String indexName = file_->IsPackaged() ? String::EMPTY : TheoraKeyframeIndex::GetSidecarName(context_, fileName_);
+    if (indexName.Empty())
+    {
+        URHO3D_LOGINFOF("Keyframe index: %u keyframes from a page scan in %.1f ms.", keyframeIndex_.GetSize(), scanMSec);
+        return;
+    }
+
+    FileSystem *fileSystem = context_->GetSubsystem<FileSystem>();
+    unsigned modified = fileSystem ? fileSystem->GetLastModifiedTime(fileName_) : 0;
+    bool saved = keyframeIndex_.Save(context_, indexName, file_->GetSize(), modified);
+    URHO3D_LOGINFOF("Keyframe index: %u keyframes from a page scan in %.1f ms, %s %s.", keyframeIndex_.GetSize(),
+                    scanMSec, saved ? "saved to" : "could not save", indexName.CString());
+}
+
+bool Theora::BuildKeyframeIndex()
+{
+    keyframeIndex_.Clear();
+
+    // the decoder reads file_, the scan has its own handle unless the file is mapped
+    SharedPtr<File> file;
+    if (!mappedFile_.IsOpen())
+    {
+        ResourceCache *cache = context_->GetSubsystem<ResourceCache>();
+        if (file_->IsPackaged())
+        {
+            file = cache ? cache->GetFile(fileName_, false) : SharedPtr<File>();
+        }
+        else
+        {
+            file = new File(context_, fileName_, FILE_READ);
+        }
+
+        if (!file || !file->IsOpen())
+        {
+            return false;
+        }
+    }
+
+    // only page headers are read, bodies are seeked over
+    unsigned size = file_->GetSize();
+    unsigned offset = 0;
+    int64_t lastKeyframe = -1;
+    int64_t lastPageOffset = 0;
+    unsigned char headerBuffer[OggPageHeaderMaxSize];
+    bool complete = false;
+
+    while (indexEnabled_)
+    {
+        if (offset >= size)
+        {
+            complete = true;
+            break;
+        }
+
+        const unsigned char *header = headerBuffer;
+        unsigned bytes;
+        if (mappedFile_.IsOpen())
+        {
+            header = mappedFile_.GetData() + offset;
+            bytes = Min(OggPageHeaderMaxSize, size - offset);
+        }
+        else
+        {
+            file->Seek(offset);
+            bytes = file->Read(headerBuffer, OggPageHeaderMaxSize);
+        }
+
+        if (bytes < OggPageHeaderSize || memcmp(header, "OggS", 4) != 0 || bytes < OggPageHeaderSize + header[26])
+        {
+            break;
+        }
+
+        ogg_page page;
+        page.header = const_cast<unsigned char*>(header);
+        page.header_len = OggPageHeaderSize + header[26];
+        page.body = 0;
+        page.body_len = 0;
+        for (long i = OggPageHeaderSize; i < page.header_len; ++i)
+        {
+            page.body_len += header[i];
+        }
+
+        // a new keyframe starts after the last Theora page of the previous one
+        if (IsTheoraPage(&page))
+        {
+            int64_t keyframe = (ogg_page_granulepos(&page) >> thInfo_.keyframe_granule_shift) - GetGranuleBias();
+            if (keyframe > lastKeyframe)
+            {
+                if (keyframe >= 0)
+                {
+                    keyframeIndex_.Add(lastPageOffset, keyframe);
+                }
+                lastKeyframe = keyframe;
+            }
+            lastPageOffset = offset;
+        }
+
+        offset += page.header_len + page.body_len;
+    }
+
+    // no page where one should start - the index would stop short of corrupt data,
+    // bisect instead
+    if (!complete)
+    {
+        if (!indexEnabled_)
+        {
+            keyframeIndex_.Clear();
+            return false;
+        }
+
+        URHO3D_LOGWARNINGF("Keyframe index: no page at offset %u, seeking without an index.", offset);
+        keyframeIndex_.Clear();
+    }
+
+    return !keyframeIndex_.IsEmpty();
+}
+
+void Theora::SetSeekIndex(bool enable)
+{
+    seekIndex_ = enable;
+}
+
+bool Theora::GetSeekIndex() const
+{
+    return seekIndex_;
+}
+
+bool Theora::IsKeyframeIndexReady() const
+{
+    return indexReady_.load(std::memory_order_acquire);
+}
+
+const TheoraKeyframeIndex& Theora::GetKeyframeIndex() const
+{
+    return keyframeIndex_;
+}
+
+bool Theora::IsFrameLate(int64_t frameIndex)
+{
+    // the frame after is due already
+    return GetFrameTime(frameIndex + 1) + GetPassTime(videoPass_) <= GetElapsedTime();
+}
+
+int64_t Theora::GetFrameTime(int64_t frameIndex) const
+{
+    // same as th_granule_time(), in msec
+    return (frameIndex + 1) * 1000 * thInfo_.fps_denominator / thInfo_.fps_numerator;
+}
+
+void Theora::SetLooping(bool enable)
+{
+    looping_ = enable;
+    reader_.SetLooping(CanLoop(), (unsigned)Max(dataOffset_, (int64_t)0));
+}
+
+bool Theora::GetLooping() const
+{
+    return looping_;
+}
+
+bool Theora::CanLoop() const
+{
+    return looping_ && dataOffset_ >= 0 && theoraAVInfo_.durationMSec_ > 0;
+}
+
+int64_t Theora::GetPassTime(unsigned pass) const
+{
+    return (int64_t)pass * theoraAVInfo_.durationMSec_;
+}
+
+void Theora::FindDataOffset()
+{
+    if (!thPacket_ || !file_)
+    {
+        return;
+    }
+
+    // the first page starting with a Theora or Vorbis packet that is not a header - the last
+    // header ends a page, read through a separate sync state like ScanDuration()
+    unsigned position = file_->GetPosition();
+    file_->Seek(0);
+
+    ogg_sync_state syncState;
+    ogg_sync_init(&syncState);
+
+    int64_t offset = 0;
+    ogg_page page;
+    while (dataOffset_ < 0)
+    {
+        long more = ogg_sync_pageseek(&syncState, &page);
+        if (more < 0)
+        {
+            offset -= more;
+        }
+        else if (more == 0)
+        {
+            char *buffer = ogg_sync_buffer(&syncState, SyncBufferSize);
+            int bytes = file_->Read(buffer, SyncBufferSize);
+            if (!bytes)
+            {
+                break;
+            }
+            ogg_sync_wrote(&syncState, bytes);
+        }
+        else
+        {
+            int serialNo = ogg_page_serialno(&page);
+            bool stream = serialNo == oggThStreamState_.serialno || (vbPacket_ && serialNo == oggVbStreamState_.serialno);
+            if (stream && !ogg_page_continued(&page) && page.body_len > 0 && !(page.body[0] & 0x80))
+            {
+                dataOffset_ = offset;
+            }
+            offset += more;
+        }
+    }
+
+    ogg_sync_clear(&syncState);
+    file_->Seek(position);
+}
+
+bool Theora::StartVideoPass(unsigned pass)
+{
+    // every packet of the pass before is decoded first
+    if (ogg_stream_packetpeek(&oggThStreamState_, NULL))
+    {
+        return false;
+    }
+
+    HiresTimer timer;
+    ogg_stream_reset(&oggThStreamState_);
+
+    // the decoder would count frames on from the last one, they are numbered again from
+    // the first keyframe as after a seek to the start
+    seekFrame_ = -1;
+    seekKeyframe_ = 0;
+    frameIndexKnown_ = false;
+    catchingUp_ = true;
+    lastFrameIndex_ = -1;
+    videoPass_ = pass;
+
+    ++stats_.loops_;
+    stats_.lastLoopMSec_ = timer.GetUSec(false) * 0.001f;
+    PublishStats();
+
+    return true;
+}
+
+bool Theora::StartAudioPass(unsigned pass)
+{
+    // every sample of the pass before is queued first
+    if (ogg_stream_packetpeek(&oggVbStreamState_, NULL) || vorbis_synthesis_pcmout(&vbDspState_, NULL) > 0)
+    {
+        return false;
+    }
+
+    ogg_stream_reset(&oggVbStreamState_);
+    vorbis_synthesis_restart(&vbDspState_);
+
+    // a partly filled chunk carries on with the first samples of the pass
+    audiobufGranulePos_ = 0;
+    audioPass_ = pass;
+
+    return true;
+}
+
+int Theora::GetGranuleBias() const
+{
+    // 3.2.1 and later streams store the frame count rather than the index in the granule position
+    return (thInfo_.version_major > 3 ||
+            (thInfo_.version_major == 3 && (thInfo_.version_minor > 2 ||
+                                            (thInfo_.version_minor == 2 && thInfo_.version_subminor >= 1)))) ? 1 : 0;
+}
+
+void Theora::UpdatePostProcess(long long decodeUSec)
+{
+    decodeUSecAvg_ += ((float)decodeUSec - decodeUSecAvg_) * DecodeTimeSmoothing;
+
+    float intervalUSec = 1000000.0f / theoraAVInfo_.videoFrameRate_;
+    float leadUSec = 1000.0f * (float)(videobufTime_ - GetElapsedTime());
+    // none below full LOD
+    int levelMax = decodeLod_ == DECODE_LOD_FULL ? postProcessLevelMax_ : 0;
+
+    if (adaptivePostProcess_ && --postProcessCooldown_ <= 0)
+    {
+        bool behind = decodeUSecAvg_ > intervalUSec * PostProcessBehindRatio ||
+                      leadUSec < intervalUSec * PostProcessMinLeadFrames;
+        bool headroom = decodeUSecAvg_ < intervalUSec * PostProcessHeadroomRatio &&
+                        leadUSec > intervalUSec * VideoAdvanceFrames * 0.5f;
+
+        if (behind && postProcessLevel_ > 0)
+        {
+            postProcessIncrement_ = -1;
+            ++stats_.postProcessStepsDown_;
+        }
+        else if (headroom && postProcessLevel_ < levelMax)
+        {
+            postProcessIncrement_ = 1;
+            ++stats_.postProcessStepsUp_;
+        }
+
+        if (postProcessIncrement_)
+        {
+            // let the average settle at the new level before judging it
+            postProcessCooldown_ = PostProcessCooldownFrames;
+
+            if (stats_.postProcessHistorySize_ == PostProcessHistorySize)
+            {
+                memmove(stats_.postProcessHistory_, stats_.postProcessHistory_ + 1,
+                        (PostProcessHistorySize - 1) * sizeof(TheoraPostProcessChange));
+                --stats_.postProcessHistorySize_;
+            }
+
+            TheoraPostProcessChange &change = stats_.postProcessHistory_[stats_.postProcessHistorySize_++];
+            change.frame_ = frames_;
+            change.level_ = postProcessLevel_ + postProcessIncrement_;
+            change.decodeMSec_ = decodeUSecAvg_ * 0.001f;
+            change.leadMSec_ = leadUSec * 0.001f;
+        }
+    }
+    else if (!adaptivePostProcess_ && postProcessLevel_ != levelMax)
+    {
+        postProcessIncrement_ = levelMax - postProcessLevel_;
+    }
+
+    stats_.frames_ = frames_;
+    stats_.decodeMSec_ = decodeUSecAvg_ * 0.001f;
+    stats_.frameIntervalMSec_ = intervalUSec * 0.001f;
+    stats_.postProcessLevel_ = postProcessLevel_ + postProcessIncrement_;
+    PublishStats();
+}
+
+void Theora::PublishStats()
+{
+    MutexLock lock(statsMutex_);
+    statsSnapshot_ = stats_;
+}
+
+TheoraStats Theora::GetStats() const
+{
+    TheoraStats stats;
+    {
+        MutexLock lock(statsMutex_);
+        stats = statsSnapshot_;
+    }
+
+    // pipeline stages keep their own counters
+    stats.inputBytes_ += reader_.GetBytesRead();
+    stats.inputReads_ += reader_.GetNumReads();
+    stats.prefetchedBytes_ = reader_.GetBufferedBytes();
+    stats.ioStallMSec_ = reader_.GetStallUSec() * 0.001f;
+    stats.demuxStallMSec_ = demuxStallUSec_ * 0.001f;
+    stats.audioStallMSec_ = audioStallUSec_ * 0.001f;
+    stats.audioStalls_ = audioStalls_;
+    return stats;
+}
+
+void Theora::SetAdaptivePostProcess(bool enable)
+{
+    adaptivePostProcess_ = enable;
+}
+
+bool Theora::GetAdaptivePostProcess() const
+{
+    return adaptivePostProcess_;
+}
+
 void Theora::DumpInfo()
 {
     URHO3D_LOGINFOF("Ogg logical stream 0x%x is Theora %d x %d, fps=%f",
@@ -707,8 +2972,8 @@ void Theora::DumpInfo()
     switch (thInfo_.pixel_fmt)
     {
     case TH_PF_420: URHO3D_LOGINFO(" 4:2:0 video"); break;
-    case TH_PF_422: URHO3D_LOGINFO(" 4:2:2 video - not supported"); break;
-    case TH_PF_444: URHO3D_LOGINFO(" 4:4:4 video - not supported"); break;
+    case TH_PF_422: URHO3D_LOGINFO(" 4:2:2 video"); break;
+    case TH_PF_444: URHO3D_LOGINFO(" 4:4:4 video"); break;
     case TH_PF_RSVD:
     default:
         URHO3D_LOGINFO(" video -- (UNKNOWN Chroma sampling!)");
@@ -717,8 +2982,9 @@ void Theora::DumpInfo()
 
     if (thInfo_.pic_width != thInfo_.frame_width || thInfo_.pic_height != thInfo_.frame_height)
     {
-        URHO3D_LOGINFOF("  Frame content is %d x %d with offset (%d, %d).",
-                        thInfo_.frame_width, thInfo_.frame_height, thInfo_.pic_x, thInfo_.pic_y);
+        URHO3D_LOGINFOF("  Frame content is %d x %d with offset (%d, %d), converting %d x %d.",
+                        thInfo_.frame_width, thInfo_.frame_height, thInfo_.pic_x, thInfo_.pic_y,
+                        yuvConverter_.GetPictureWidth(), yuvConverter_.GetPictureHeight());
     }
 
     switch(thInfo_.colorspace)
@@ -738,16 +3004,17 @@ void Theora::DumpInfo()
         break;
     }
 
-    URHO3D_LOGINFOF("Encoded by %s", thComment_.vendor);
+    const th_comment &thComment = headers_->GetTheoraComment();
+    URHO3D_LOGINFOF("Encoded by %s", thComment.vendor);
 
-    if (thComment_.comments)
+    if (thComment.comments)
     {
         URHO3D_LOGINFO("theora comment header:");
-        for (int i = 0; i < thComment_.comments; ++i)
+        for (int i = 0; i < thComment.comments; ++i)
         {
-            if (thComment_.user_comments[i])
+            if (thComment.user_comments[i])
             {
-                String comment(thComment_.user_comments[i], thComment_.comment_lengths[i]);
+                String comment(thComment.user_comments[i], thComment.comment_lengths[i]);
                 URHO3D_LOGINFOF("\t%s", comment.CString());
             }
         }
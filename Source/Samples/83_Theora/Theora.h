@@ -1,6 +1,8 @@
 #pragma once
 
 #include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Timer.h>
 #include <Urho3D/Container/RefCounted.h>
 
 #include <ogg/ogg.h>
@@ -9,6 +11,17 @@
 #include <vorbis/codec.h>
 
 #include "TheoraData.h"
+#include "TheoraRingBuffer.h"
+#include "TheoraBufferPool.h"
+#include "TheoraYuv.h"
+#include "TheoraWorkQueue.h"
+#include "TheoraManager.h"
+#include "TheoraSignal.h"
+#include "TheoraKeyframeIndex.h"
+#include "TheoraReader.h"
+#include "TheoraHeaderCache.h"
+
+#include <atomic>
 
 //=============================================================================
 //=============================================================================
@@ -18,25 +31,141 @@ namespace Urho3D
 class Context;
 }
 
+class TheoraStageThread;
+class TheoraOpenNotifier;
+
+//=============================================================================
+// a page cut by the demux stage, copied into buffer_ unless it points into the mapped file
+//=============================================================================
+class TheoraPage : public RefCounted
+{
+public:
+    ogg_page                    page_;
+    PODVector<unsigned char>    buffer_;
+    // times the input looped back to the first data page before it was cut
+    unsigned                    pass_;
+};
+
 //=============================================================================
 //=============================================================================
 class URHO3D_API Theora : public Thread, public RefCounted
 {
+    friend class TheoraBenchmark;
+    friend class TheoraManager;
+
 public:
     Theora();
     virtual ~Theora();
 
     int Initialize(Context *context, const String& filename);
+    // opens the file, parses the headers and decodes up to the first frames on a thread of
+    // its own, E_THEORAFIRSTFRAME follows from the main thread once done. only what is set
+    // before Initialize() may be set while opening, anything else waits for the event.
+    // false if the open couldn't be started
+    bool InitializeAsync(Context *context, const String& filename);
+    // Initialize() that stops at the first frame, for instances opened ahead of playback
+    // on a resource loading thread
+    int Prepare(Context *context, const String& filename);
+    // Prepare() from a handle already open, playback keeps reading it
+    int Prepare(Context *context, File *file);
+    bool IsOpening() const;
+    // INIT_OK or the error of the last open
+    int GetOpenResult() const;
     const TheoraAVInfo& GetTheoraAVInfo() const;
 
     // control and buffer
     bool StartProcess();
-    void SetElapsedTime(float timer);
+    // presentation clock in msec, frames and audio are decoded ahead of it
+    void SetElapsedTime(int64_t timeMSec);
+    VideoData* PeekVideoQueueData() const;
     SharedPtr<VideoData> GetVideoQueueData();
+    AudioData* PeekAudioQueueData() const;
     SharedPtr<AudioData> GetAudioQueueData();
+    // jumps to timeMSec, the first frame queued after it is the one shown at that time.
+    // blocks while the decode thread is stopped, queues flushed and the file bisected
+    bool Seek(int64_t timeMSec);
+    // seek through a keyframe index - the stream's Skeleton index, else a sidecar file in
+    // the app preferences directory, written after scanning the pages once (default),
+    // otherwise bisect the file on every seek. the scan runs in the background after the
+    // open and seeks bisect until it is done, videos in a package are scanned on every
+    // open. set before Initialize()
+    void SetSeekIndex(bool enable);
+    bool GetSeekIndex() const;
+    // the index seeks go through, complete once IsKeyframeIndexReady()
+    bool IsKeyframeIndexReady() const;
+    const TheoraKeyframeIndex& GetKeyframeIndex() const;
+
+    // at the end of the file carry on from the first data page, without reopening it
+    // or reallocating anything - the headers, decoders, buffers and threads are kept and
+    // the stream is reset only once what was decoded before is drained. frame and audio
+    // times and the clock run on across passes, a seek lands in the pass of its time.
+    // needs a known duration, takes effect at the next end of the file
+    void SetLooping(bool enable);
+    bool GetLooping() const;
+
+    // cut Ogg pages straight out of a memory mapping of the file instead of reading
+    // it into the sync buffer (default), package files are always read. set before
+    // Initialize(), IsInputMapped() tells if the mapping is in use
+    void SetMappedInput(bool enable);
+    bool GetMappedInput() const;
+    bool IsInputMapped() const;
+
+    // bytes the I/O stage reads ahead of demuxing on its own thread, 0 reads inline
+    // on the decode thread. set before StartProcess()
+    void SetPrefetchWindow(unsigned bytes);
+    unsigned GetPrefetchWindow() const;
+
+    // with the pipeline running Vorbis is decoded on its own thread, this far ahead
+    // of the clock (0 - the video lead plus a frame) and at this Thread::SetPriority()
+    // priority. set before StartProcess()
+    void SetAudioLead(unsigned msec);
+    unsigned GetAudioLead() const;
+    void SetAudioPriority(int priority);
+    int GetAudioPriority() const;
+    // every Vorbis packet is decoded and queued
+    bool IsAudioFinished() const;
+
+    // decode on the workers of the TheoraManager subsystem, when one is registered and
+    // has threads (default), instead of on a thread of its own. managed streams read
+    // and decode audio inline, without the pipeline threads. set before StartProcess()
+    void SetManaged(bool enable);
+    bool GetManaged() const;
+    bool IsManaged() const;
+
+    // decode LOD, DECODE_LOD_FULL by default. lower LODs take effect from the next packet,
+    // raising a paused stream drops what it had queued and has the decode side seek it to
+    // the clock. under load the TheoraManager steps fuller streams first
+    void SetDecodeLod(TheoraDecodeLod lod);
+    TheoraDecodeLod GetDecodeLod() const;
+
+    // convert each decoded stripe while still in cache (default) or the whole frame afterwards,
+    // set before Initialize()
+    void SetStripeConversion(bool enable);
+    bool GetStripeConversion() const;
+    // split conversion into row bands run on the TheoraWorkQueue subsystem,
+    // more than one band converts the whole frame after decode
+    void SetConversionBands(unsigned numBands);
+    unsigned GetConversionBands() const;
+
+    // step the post-processing level down when decoding falls behind and back up
+    // when there is headroom (default), otherwise decode at the max level
+    void SetAdaptivePostProcess(bool enable);
+    bool GetAdaptivePostProcess() const;
+
+    // buffer pool stats
+    const VideoDataPool& GetVideoDataPool() const;
+    const AudioDataPool& GetAudioDataPool() const;
+    // decoder stats, safe to call while the decode thread runs
+    TheoraStats GetStats() const;
 
 private:
-    int InitTheora();
+    int Open(Context *context, File *file, const String& filename, float prerollFrames);
+    void SetContext(Context *context);
+    // the file, its headers and the first frames, for either initialize. file may be
+    // null, then filename is opened
+    int OpenStream(File *file, const String& filename, float prerollFrames);
+    void OpenFunction();
+    int InitTheora(float prerollFrames);
 
     // threaded background fn
     virtual void ThreadFunction();
@@ -44,24 +173,106 @@ private:
     bool Run();
     int64_t GetElapsedTime();
     void UpdateTimer();
-    void UpdateFrames();
+    // singleStep returns once a frame or audio chunk is decoded
+    void UpdateFrames(bool singleStep = false);
+    bool NeedsFrames() const;
+    // frames decoded or skipped and audio fills, unchanged after a pass means nothing was left
+    int GetDecodeProgress() const;
+    // clock value at which the decoder falls behind its advance window again
+    int64_t GetWakeTime(bool decodedAll);
+    // blocks until the consumer advances the clock past the point more data is needed,
+    // or forever (until woken) when nothing more can be decoded
+    void WaitForClock(bool decodedAll);
+    // managed decoding, from TheoraManager workers - a step decodes at most a frame and
+    // an audio chunk and never blocks, it is only run while there is queue space
+    bool IsStepReady();
+    // how far the decoded audio and video lead the clock, the most urgent stream has the least
+    int64_t GetStepSlack() const;
+    void DecodeStep();
+    bool HasQueueSpace() const;
+    // consumer side - wakes the decoder if it is waiting on a full queue
+    void SignalQueueSpace();
 
     // buffer container methods
-    void StoreVideoQueueData(SharedPtr<VideoData> theoraData);
-    void StoreAudioQueueData(SharedPtr<AudioData> theoraData);
+    void StoreVideoQueueData(SharedPtr<VideoData> &theoraData);
+    void StoreAudioQueueData(SharedPtr<AudioData> &theoraData);
 
     void WaitExit();
+    // I/O and demux stages, run alongside the decode thread from where the file was left
+    void StartPipeline();
+    // drops what was read ahead, only a seek restarts it
+    void StopPipeline();
+    // demux stage - cuts the I/O stage's chunks into pages for the decode thread
+    void DemuxFunction();
+    void WriteChunk(const TheoraChunk *chunk);
+    SharedPtr<TheoraPage> AcquirePage(const ogg_page &oggPage);
+    // each consumer hands pages back through its own free queue
+    void ReleasePage(SharedPtr<TheoraPage> &page, TheoraRingBuffer<TheoraPage> &freePages);
+    void SignalPages();
+    // audio stage - decodes Vorbis pages routed to it by the demuxer
+    void AudioFunction();
+    void WaitForAudioPages();
+    // decode thread - feeds the stream states from the pipeline, or reads inline
+    void FetchPages();
+    SharedPtr<TheoraPage> WaitForPage();
     void SetThreadEnable(bool enable);
-    bool GetThreadEnabled();
-    void SetFnExit(bool bset);
-    bool GetFnExited();
+    bool GetThreadEnabled() const;
 
     bool OpenFile(const String& fileName);
+    bool OpenFile(File *file, const String& fileName);
     bool FileEof() const;
     int BufferData();
+    // ogg_sync_pageseek() and ogg_sync_pageout() over either input
+    long PageSeek(ogg_page *page);
+    int PageOut(ogg_page *page);
+    static unsigned GetPageChecksum(const ogg_page *page);
     int QueuePage(ogg_page *page);
+    void QueueAudioPage(ogg_page *page);
+    // false while the audio thread has the Vorbis state
+    bool DecodesAudio() const;
+    // fills audiobuf_ and queues it once full, until out of packets
+    void DecodeAudio();
     void VideoWrite();
-    void Yuv420pToRgba8888(const th_ycbcr_buffer &yuv, SharedPtr<VideoData> ptr);
+    // decode thread side of SetDecodeLod()
+    void ApplyDecodeLod();
+    void ResumeDecoding();
+    void SetStripeCallback();
+    static void StripeDecoded(void *ctx, th_ycbcr_buffer yuv, int yfrag0, int yfragEnd);
+    bool UseStripeConversion() const;
+    static void ConvertBands(TheoraWorkQueue *workQueue, const YuvConverter &converter, const th_img_plane yuv[3],
+                             unsigned char *rgba, int rgbaStride, unsigned numBands);
+    static void ConvertBandWork(const TheoraWorkItem *item, unsigned threadIndex);
+    void YuvToRgba8888(const th_ycbcr_buffer &yuv, SharedPtr<VideoData> ptr);
+    // seeking - offsets are file positions of page starts
+    // moves the decoder state to the keyframe before timeMSec and has it discard up to
+    // there, with the decoding threads parked. returns the clock time it lands on
+    int64_t Reposition(int64_t timeMSec);
+    void SeekFile(int64_t offset);
+    int64_t GetNextPage(ogg_page *page, int64_t boundary);
+    int64_t FindPageBefore(int64_t frameIndex, int64_t *granulePos);
+    bool IsTheoraPage(ogg_page *page) const;
+    void ResetDecoders();
+    // granule position of the first complete Vorbis packet on the page, -1 if none
+    int64_t GetFirstPacketGranulePos(ogg_page *page);
+    void ScanDuration();
+    void ReadSkeletonPackets();
+    void SetupKeyframeIndex();
+    void IndexFunction();
+    bool BuildKeyframeIndex();
+    // late frame handling - returns true if the packet is skipped while catching up
+    bool SkipToKeyframe(ogg_packet *packet);
+    bool IsFrameLate(int64_t frameIndex);
+    int64_t GetFrameTime(int64_t frameIndex) const;
+    // looping - time the pass starts at, and whether the pass the input is on can be entered
+    bool CanLoop() const;
+    int64_t GetPassTime(unsigned pass) const;
+    void FindDataOffset();
+    bool StartVideoPass(unsigned pass);
+    bool StartAudioPass(unsigned pass);
+    int GetGranuleBias() const;
+    // per frame decode-time controller, queues a level change for the next packet
+    void UpdatePostProcess(long long decodeUSec);
+    void PublishStats();
     void DumpInfo();
 
 private:
@@ -69,44 +280,52 @@ private:
     WeakPtr<Context>    context_;
     SharedPtr<File>     file_;
 
-    int64_t             elapsedTime_;
+    std::atomic<int64_t> elapsedTime_;
     int64_t             videoAdvanceTime_;
     int64_t             audioAdvanceTime_;
 
-    // buffers
-    Vector<SharedPtr<VideoData>>  videoBufferContainer_;
-    Vector<SharedPtr<AudioData>>  audioBufferContainer_;
+    // buffers - lock-free, decode thread produces and main thread consumes
+    TheoraRingBuffer<VideoData>  videoBufferQueue_;
+    TheoraRingBuffer<AudioData>  audioBufferQueue_;
 
-    // threading properties
-    Mutex            mutexTimer_;
-    Mutex            mutexExit_;
-    Mutex            mutexAudioBuff_;
-    Mutex            mutexVideoBuff_;
-    Mutex            mutexThreadEnable_;
-    bool             threadEnabled_;
-    bool             fnExited_;
-    bool             stopAV_;
+    // recycled frame and audio chunk buffers
+    VideoDataPool    videoDataPool_;
+    AudioDataPool    audioDataPool_;
+
+    // threading properties - the decode thread sleeps on wakeSignal_ and is woken
+    // when the clock reaches wakeTime_, queue space frees up or on exit
+    TheoraSignal         wakeSignal_;
+    std::atomic<int64_t> wakeTime_;
+    std::atomic<bool>    waitingForSpace_;
+    std::atomic<bool>    threadEnabled_;
+    bool                 stopAV_;
 
     // theora audio and video
     ogg_sync_state   oggSyncState_;
     ogg_page         oggPage_;
     ogg_stream_state oggVbStreamState_;
     ogg_stream_state oggThStreamState_;
+    ogg_stream_state oggSkStreamState_;
     ogg_packet       oggPacket_;
 
+    // parsed codec headers, shared through the TheoraHeaderCache subsystem when one
+    // is registered. thInfo_ is a copy, vbInfo_ points into them
+    SharedPtr<TheoraHeaders> headers_;
+    SharedPtr<TheoraHeaderCache> headerCache_;
+
     th_info          thInfo_;
-    th_comment       thComment_;
     th_dec_ctx       *thDecCtx_;
-    th_setup_info    *thSetupInfo_;
     th_pixel_fmt     thPixelFmt_;
 
-    vorbis_info      vbInfo_;
-    vorbis_comment   vbComment_;
+    vorbis_info      *vbInfo_;
     vorbis_dsp_state vbDspState_;
     vorbis_block     vbBlock_;
 
     int              thPacket_;
     int              vbPacket_;
+    // skeleton stream open until its end of stream packet
+    int              skPacket_;
+    int              skVersionMajor_;
     int              stateFlag_;
 
     int              videobufReady_;
@@ -125,44 +344,127 @@ private:
     int              postProcessLevelMax_;
     int              postProcessLevel_;
     int              postProcessIncrement_;
+    int              postProcessCooldown_;
+    std::atomic<bool> adaptivePostProcess_;
+    HiresTimer       decodeTimer_;
+    float            decodeUSecAvg_;
+
+    // decode thread writes stats_, GetStats() copies statsSnapshot_
+    TheoraStats      stats_;
+    TheoraStats      statsSnapshot_;
+    mutable Mutex    statsMutex_;
 
     int              audioFills_;
     int              frames_;
     int              dropped_;
+    int              skipped_;
+    int              reduced_;
+
+    // index of the last frame decoded or skipped
+    int64_t          lastFrameIndex_;
+    bool             dropFrame_;
+    // dropped for the reduced frame rate rather than for being late
+    bool             reducedFrame_;
+    bool             catchingUp_;
+
+    // seek state - frames before seekFrame_ and audio before seekSample_ are
+    // decoded but discarded, frame indices are unknown until a granule position is seen
+    int64_t          seekOffset_;
+    unsigned         seekReads_;
+    int64_t          seekFrame_;
+    // keyframe the seek landed before, numbers it if no granule position comes first
+    int64_t          seekKeyframe_;
+    int64_t          seekSample_;
+    int64_t          seekAudioGranulePos_;
+    bool             seekAudioPageSeen_;
+    bool             frameIndexKnown_;
+    bool             seekIndex_;
+    // written by indexThread_ until indexReady_ is set, read only after
+    TheoraKeyframeIndex keyframeIndex_;
+    SharedPtr<TheoraStageThread> indexThread_;
+    std::atomic<bool> indexEnabled_;
+    std::atomic<bool> indexReady_;
+    String           fileName_;
+
+    // looping - pages are read for inputPass_ (demux side) and decoded for videoPass_ and
+    // audioPass_, heldPage_ and heldAudioPage_ are a next pass's first page waiting for
+    // the streams to drain. passes count from the start of the clock
+    std::atomic<bool> looping_;
+    int64_t          dataOffset_;
+    unsigned         inputPass_;
+    unsigned         videoPass_;
+    unsigned         audioPass_;
+    SharedPtr<TheoraPage> heldPage_;
+    SharedPtr<TheoraPage> heldAudioPage_;
+
+    // mapped input - pages are cut from [mappedPosition_, mappedEnd_), which
+    // BufferData() widens like a read would fill the sync buffer
+    bool             mappedInput_;
+    TheoraMappedFile mappedFile_;
+    unsigned         mappedPosition_;
+    unsigned         mappedEnd_;
+
+    // read-ahead pipeline - while it runs the demux thread owns the sync layer, the
+    // mapped span and the file, the decode thread only the stream states
+    TheoraReader     reader_;
+    SharedPtr<TheoraStageThread> demuxThread_;
+    TheoraRingBuffer<TheoraPage> pageQueue_;
+    TheoraRingBuffer<TheoraPage> freePages_;
+    // set by the reader when a chunk is queued, by the decoder when it takes a page, and on stop
+    TheoraSignal     demuxSignal_;
+    std::atomic<bool> demuxEnabled_;
+    std::atomic<bool> demuxFinished_;
+    std::atomic<bool> waitingForPages_;
+    std::atomic<long long> demuxStallUSec_;
+    unsigned         prefetchWindow_;
+    bool             pipelineRunning_;
+
+    // audio thread - owns the Vorbis stream, dsp state, audiobuf_ and audio seek state while it
+    // runs, sleeps on audioSignal_ until the clock reaches audioWakeTime_, pages or queue space
+    SharedPtr<TheoraStageThread> audioThread_;
+    TheoraRingBuffer<TheoraPage> audioPageQueue_;
+    TheoraRingBuffer<TheoraPage> freeAudioPages_;
+    TheoraSignal     audioSignal_;
+    std::atomic<int64_t> audioWakeTime_;
+    std::atomic<bool> audioEnabled_;
+    std::atomic<bool> audioWaitingForPages_;
+    std::atomic<bool> audioWaitingForSpace_;
+    std::atomic<bool> audioFinished_;
+    std::atomic<long long> audioStallUSec_;
+    std::atomic<unsigned> audioStalls_;
+    int              audioSerialNo_;
+    unsigned         audioLeadMSec_;
+    int              audioPriority_;
+    bool             audioThreadRunning_;
+
+    YuvConverter     yuvConverter_;
+    bool             stripeConversion_;
+    SharedPtr<VideoData> stripeFrame_;
+    SharedPtr<TheoraWorkQueue> workQueue_;
+    unsigned         conversionBands_;
+
+    // requestedLod_ is set by the main thread and picked up as decodeLod_ between packets,
+    // below DECODE_LOD_FULL frames are halved into halfPicture_ and converted as 4:4:4
+    std::atomic<int> requestedLod_;
+    // raised from DECODE_LOD_PAUSED, the decode side seeks to the clock before its next packet
+    std::atomic<bool> resumePending_;
+    TheoraDecodeLod  decodeLod_;
+    YuvConverter     halfConverter_;
+    PODVector<unsigned char> halfPicture_;
+
+    // asynchronous open - openThread_ runs OpenStream(), openNotifier_ sends the event once
+    // opening_ clears. openTimer_ runs from the start of either initialize
+    SharedPtr<TheoraStageThread> openThread_;
+    SharedPtr<TheoraOpenNotifier> openNotifier_;
+    std::atomic<bool> opening_;
+    std::atomic<int> openResult_;
+    String           openFileName_;
+    HiresTimer       openTimer_;
 
-    //=============================================================================
-    // Function ref - below functions are from 
-    // Android Open Source Project (AOSP), APACHE LICENSE 2.0
-    //=============================================================================
-    typedef uint8_t uint8;
-    typedef uint32_t uint32;
-    typedef int32_t int32;
-
-    union Rgba {
-      uint32 color;
-      uint8 channel[4];
-    };
-
-    // Channel index constants
-    static const uint8 kRed = 0;
-    static const uint8 kGreen = 1;
-    static const uint8 kBlue = 2;
-    static const uint8 kAlpha = 3;
-
-    // Clamp to range 0-255
-    static inline uint8 clamp(int32 x)
-    {
-      return (uint8)(x > 255 ? 255 : (x < 0 ? 0 : x));
-    }
-
-    static inline Rgba convertYuvToRgba(int32 y, int32 u, int32 v)
-    {
-      Rgba color;
-      color.channel[kRed] = clamp(y + static_cast<int>(1.402f * v));
-      color.channel[kGreen] = clamp(y - static_cast<int>(0.344f * u + 0.714f * v));
-      color.channel[kBlue] = clamp(y + static_cast<int>(1.772f * u));
-      color.channel[kAlpha] = 0xff;
-      return color;
-    }
-
-};
\ No newline at end of file
+    // managed decoding - wakeTime_ is when the stream is next ready, waitingForSpace_
+    // that it waits on the consumer, decodedTime_ the earliest time_ still to decode
+    SharedPtr<TheoraManager> manager_;
+    bool             useManager_;
+    bool             managed_;
+    std::atomic<int64_t> decodedTime_;
+};
@@ -5,11 +5,32 @@
 #include <Urho3D/Resource/ResourceCache.h>
 
 #include "TheoraAudio.h"
+#include "Theora.h"
 
 #include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// seconds of audio the ring buffer can hold
+static const unsigned AudioBufferSeconds = 1;
+// audio is handed to the stream this far ahead of what is being heard
+static const int64_t AudioWriteAheadMSec = 250;
+
 //=============================================================================
 //=============================================================================
 TheoraAudio::TheoraAudio(Context* context)
+    : bufferSize_(0)
+    , bufferMask_(0)
+    , readPos_(0)
+    , writePos_(0)
+    , framesWritten_(0)
+    , framesRead_(0)
+    , anchorTime_(0)
+    , anchorFrame_(0)
+    , anchored_(false)
+    , outputLatency_(OutputLatencyMSec)
+    , underruns_(0)
+    , endOfStream_(false)
+    , starved_(false)
 {
     soundSource_ = NULL;
 }
@@ -23,34 +44,175 @@ void TheoraAudio::Init(SoundSource *soundSource, long frequency, bool sixteenBit
 {
     soundSource_ = soundSource;
     SetFormat(frequency, sixteenBit, stereo);
+
+    // allocated once, power of two so positions can wrap with a mask
+    bufferSize_ = NextPowerOfTwo(AudioBufferSeconds * frequency * GetSampleSize());
+    bufferMask_ = bufferSize_ - 1;
+    buffer_ = new signed char[bufferSize_];
+    readPos_ = 0;
+    writePos_ = 0;
+    framesWritten_ = 0;
+    framesRead_ = 0;
+    anchored_ = false;
 }
 
 void TheoraAudio::Play()
 {
-    soundSource_->Play(this);
+    if (soundSource_)
+    {
+        soundSource_->Play(this);
+    }
 }
 
 void TheoraAudio::Stop()
 {
-    soundSource_->Stop();
+    if (soundSource_)
+    {
+        soundSource_->Stop();
+    }
 }
 
 bool TheoraAudio::IsPlaying() const
 {
-    return soundSource_->IsPlaying();
+    return soundSource_ && soundSource_->IsPlaying();
 }
 
-unsigned TheoraAudio::WriteData(void* data, unsigned numBytes)
+unsigned TheoraAudio::WriteData(const void* data, unsigned numBytes, int64_t timeMSec)
 {
-    BufferedSoundStream::AddData(data, numBytes);
+    if (!buffer_)
+    {
+        return 0;
+    }
+
+    unsigned writePos = writePos_.load(std::memory_order_relaxed);
+    unsigned space = bufferSize_ - (writePos - readPos_.load(std::memory_order_acquire));
+
+    // keep whole samples when the buffer is about to overflow
+    numBytes = Min(numBytes, space - space % GetSampleSize());
+
+    unsigned offset = writePos & bufferMask_;
+    unsigned first = Min(numBytes, bufferSize_ - offset);
+    memcpy(buffer_.Get() + offset, data, first);
+    memcpy(buffer_.Get(), (const signed char*)data + first, numBytes - first);
+
+    if (!anchored_)
+    {
+        anchorTime_ = timeMSec;
+        anchorFrame_ = framesWritten_;
+        anchored_ = true;
+    }
+    framesWritten_ += numBytes / GetSampleSize();
+
+    writePos_.store(writePos + numBytes, std::memory_order_release);
     return numBytes;
 }
 
-void TheoraAudio::Clear()
+unsigned TheoraAudio::GetData(signed char* dest, unsigned numBytes)
+{
+    if (!buffer_)
+    {
+        return 0;
+    }
+
+    unsigned readPos = readPos_.load(std::memory_order_relaxed);
+    unsigned outBytes = Min(numBytes, writePos_.load(std::memory_order_acquire) - readPos);
+
+    unsigned offset = readPos & bufferMask_;
+    unsigned first = Min(outBytes, bufferSize_ - offset);
+    memcpy(dest, buffer_.Get() + offset, first);
+    memcpy(dest + first, buffer_.Get(), outBytes - first);
+
+    readPos_.store(readPos + outBytes, std::memory_order_release);
+    framesRead_.fetch_add(outBytes / GetSampleSize(), std::memory_order_relaxed);
+
+    if (outBytes < numBytes && !endOfStream_)
+    {
+        if (!starved_)
+        {
+            ++underruns_;
+        }
+        starved_ = true;
+    }
+    else
+    {
+        starved_ = false;
+    }
+
+    return outBytes;
+}
+
+bool TheoraAudio::Update(Theora *theora, int64_t timeMSec)
+{
+    AudioData *data = theora->PeekAudioQueueData();
+    bool written = false;
+
+    // nothing to hear it on, still taken so the decoder doesn't stall on a full queue
+    while (data && data->time_ <= timeMSec + outputLatency_ + AudioWriteAheadMSec)
+    {
+        if (soundSource_)
+        {
+            WriteData(data->buf_, data->size_, data->time_);
+            written = true;
+        }
+        theora->GetAudioQueueData();
+        data = theora->PeekAudioQueueData();
+    }
+
+    if (written && !IsPlaying())
+    {
+        Play();
+    }
+
+    // running dry after the last chunk is not an underrun
+    SetEndOfStream(theora->IsAudioFinished() && !data);
+    return written;
+}
+
+bool TheoraAudio::GetPlaybackTime(int64_t &timeMSec) const
 {
-    BufferedSoundStream::Clear();
+    if (!anchored_ || !buffer_)
+    {
+        return false;
+    }
+
+    uint64_t framesRead = framesRead_.load(std::memory_order_relaxed);
+    uint64_t latencyFrames = (uint64_t)outputLatency_ * (uint64_t)GetIntFrequency() / 1000;
+    if (framesRead == framesWritten_ || framesRead < anchorFrame_ + latencyFrames)
+    {
+        return false;
+    }
+
+    // integer frames from the anchor, nothing accumulates
+    timeMSec = anchorTime_ + (int64_t)((framesRead - anchorFrame_ - latencyFrames) * 1000 / (uint64_t)GetIntFrequency());
+    return true;
 }
 
+void TheoraAudio::SetOutputLatency(unsigned msec)
+{
+    outputLatency_ = msec;
+}
 
+unsigned TheoraAudio::GetOutputLatency() const
+{
+    return outputLatency_;
+}
 
+unsigned TheoraAudio::GetNumUnderruns() const
+{
+    return underruns_;
+}
 
+void TheoraAudio::SetEndOfStream(bool endOfStream)
+{
+    endOfStream_ = endOfStream;
+}
+
+void TheoraAudio::Clear()
+{
+    readPos_.store(writePos_.load(std::memory_order_acquire), std::memory_order_release);
+    // what was dropped counts as read, the next write anchors the new position
+    framesRead_ = framesWritten_;
+    anchored_ = false;
+    starved_ = false;
+    endOfStream_ = false;
+}
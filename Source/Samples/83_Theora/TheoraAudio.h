@@ -1,6 +1,9 @@
 #pragma once
 
-#include <Urho3D/Audio/BufferedSoundStream.h>
+#include <Urho3D/Audio/SoundStream.h>
+
+#include <atomic>
+#include <stdint.h>
 
 //=============================================================================
 //=============================================================================
@@ -11,11 +14,26 @@ class SoundSource;
 
 using namespace Urho3D;
 
+class Theora;
+
 //=============================================================================
+// sound stream fed from a fixed-size ring buffer
+// - main thread writes with WriteData()
+// - audio thread reads through GetData()
+// - the samples handed to the sound source give the stream position, the
+//   master clock of playback
+// - without its sound source, removed with the node's components, it stays
+//   silent and Update() drops the decoded audio
 //=============================================================================
-class TheoraAudio : public BufferedSoundStream
+class TheoraAudio : public SoundStream
 {
 public:
+    // device buffer the sample asks the engine for, EP_SOUND_BUFFER
+    static const int SoundBufferMSec = 20;
+    // between GetData() and the speaker - the sound source's 100 ms stream buffer,
+    // about half full on average, then the device buffer
+    static const unsigned OutputLatencyMSec = 50 + SoundBufferMSec;
+
     TheoraAudio(Context* context);
     virtual ~TheoraAudio();
 
@@ -23,11 +41,52 @@ public:
     void Play();
     void Stop();
     bool IsPlaying() const;
+    // only call while stopped
     void Clear();
 
-    unsigned WriteData(void* data, unsigned numBytes);
+    // timeMSec is the stream time of the first sample, the first write after Clear()
+    // anchors the position to it
+    unsigned WriteData(const void* data, unsigned numBytes, int64_t timeMSec);
+    virtual unsigned GetData(signed char* dest, unsigned numBytes);
+    // writes the decoder's audio due by timeMSec, ahead by the output latency and
+    // some more so the stream doesn't run dry over a slow frame, and starts playing
+    // once there is some. returns true if it wrote
+    bool Update(Theora *theora, int64_t timeMSec);
+
+    // stream time of the sample being heard - the samples consumed by the sound
+    // source less the output latency. false until that sample is audible and
+    // while the buffer is dry, the position doesn't move then
+    bool GetPlaybackTime(int64_t &timeMSec) const;
+    // mixing and device buffering between GetData() and the speaker, OutputLatencyMSec
+    // unless set
+    void SetOutputLatency(unsigned msec);
+    unsigned GetOutputLatency() const;
+
+    // GetData() calls that came up short, one per dry spell. short reads once the
+    // end of the stream is marked are not counted
+    unsigned GetNumUnderruns() const;
+    void SetEndOfStream(bool endOfStream);
 
 protected:
     WeakPtr<SoundSource> soundSource_;
-};
 
+    SharedArrayPtr<signed char> buffer_;
+    unsigned                    bufferSize_;
+    unsigned                    bufferMask_;
+    std::atomic<unsigned>       readPos_;
+    std::atomic<unsigned>       writePos_;
+
+    // sample frames through the buffer since Init(), never wrap
+    uint64_t                    framesWritten_;
+    std::atomic<uint64_t>       framesRead_;
+    // main thread - stream time of the frame at anchorFrame_
+    int64_t                     anchorTime_;
+    uint64_t                    anchorFrame_;
+    bool                        anchored_;
+    unsigned                    outputLatency_;
+
+    std::atomic<unsigned>       underruns_;
+    std::atomic<bool>           endOfStream_;
+    // audio thread only, or while stopped
+    bool                        starved_;
+};
@@ -0,0 +1,1392 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Container/ArrayPtr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Random.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+#include "TheoraBenchmark.h"
+#include "Theora.h"
+#include "TheoraYuv.h"
+#include "TheoraWorkQueue.h"
+#include "TheoraManager.h"
+#include "TheoraHeaderCache.h"
+#include "TheoraVideo.h"
+#include "TheoraPresenter.h"
+
+#include <stdio.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <malloc.h>
+#endif
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static const int BenchmarkIterations = 50;
+static const int BenchmarkFrames = 300;
+static const int BenchmarkSeeks = 50;
+// frames played before the pool check starts counting, the queues and pools fill up in them
+static const unsigned PoolWarmupFrames = 60;
+// padded frames with the picture regions streams put in them - whole frames, odd origins and
+// odd sizes, and pictures narrower than a vector of pixels
+struct YuvExactnessRegion
+{
+    int frameWidth_;
+    int frameHeight_;
+    int x_;
+    int y_;
+    int width_;
+    int height_;
+};
+static const YuvExactnessRegion YuvExactnessRegions[] =
+{
+    { 64, 48, 0, 0, 64, 48 },
+    { 336, 256, 7, 5, 323, 247 },
+    { 352, 288, 2, 1, 333, 285 },
+    { 48, 32, 1, 3, 13, 27 },
+};
+// bytes past each converted row that must be left alone
+static const int YuvExactnessGuardBytes = 64;
+// samples per channel in the synthetic vorbis pcm buffer, a couple of long blocks
+static const int BenchmarkPcmSamples = 4096;
+// a seek that never produces a frame is reported instead of hanging the benchmark
+static const unsigned SeekTimeoutMSec = 5000;
+// a decoder that stops producing frames fails the check playing it instead of hanging it
+static const unsigned FrameTimeoutMSec = 5000;
+// stream scaling plays every video in real time for this long, presenting once per tick
+static const unsigned ScalingRunMSec = 2000;
+static const unsigned ScalingTickMSec = 16;
+static const unsigned ScalingMaxStreams = 64;
+// with most streams below full decode LOD
+static const unsigned LodScalingMaxStreams = 128;
+// updates the presenter check runs, one of them late by a few frames
+static const unsigned PresenterUpdates = 120;
+static const unsigned PresenterHitchUpdate = 30;
+static const unsigned PresenterHitchFrames = 8;
+// passes played past the first by the loop benchmark
+static const unsigned BenchmarkLoops = 3;
+// instances of one video opened by the header sharing benchmark
+static const unsigned SharingInstances = 32;
+// videos opened at once by the asynchronous open benchmark, a level's worth of screens
+static const unsigned AsyncOpenInstances = 10;
+static const unsigned AsyncOpenTimeoutMSec = 10000;
+
+//=============================================================================
+//=============================================================================
+void TheoraBenchmark::Run(Context *context, const String &videoFilename)
+{
+    URHO3D_LOGINFO("---- Theora benchmark ----");
+
+    const th_pixel_fmt pixelFmts[] = { TH_PF_420, TH_PF_422, TH_PF_444 };
+    for (unsigned i = 0; i < sizeof(pixelFmts) / sizeof(pixelFmts[0]); ++i)
+    {
+        YuvConversion(1280, 720, pixelFmts[i]);
+        YuvConversion(1920, 1080, pixelFmts[i]);
+    }
+
+    ColorSpaceCost(1920, 1080);
+
+    BandScaling(context, 1920, 1080);
+    BandScaling(context, 3840, 2160);
+
+    StripeConversion(context, videoFilename);
+
+    SeekLatency(context, videoFilename, false);
+    SeekLatency(context, videoFilename, true);
+
+    InputThroughput(context, videoFilename);
+
+    PcmConversion(1);
+    PcmConversion(2);
+    PcmConversion(6);
+
+    PoolSteadyState(context, videoFilename);
+
+    StreamScaling(context, videoFilename);
+    LodScaling(context, videoFilename);
+
+    LoopTurnaround(context, videoFilename, false);
+    LoopTurnaround(context, videoFilename, true);
+
+    HeaderSharing(context, videoFilename, false);
+    HeaderSharing(context, videoFilename, true);
+
+    AsyncOpen(context, videoFilename);
+
+    ResourcePreload(context, videoFilename);
+}
+
+bool TheoraBenchmark::RunChecks(Context *context, const String &videoFilename)
+{
+    URHO3D_LOGINFO("---- Theora checks ----");
+
+    bool passed = true;
+
+    passed &= YuvExactness();
+    passed &= PcmConversion(1);
+    passed &= PcmConversion(2);
+    passed &= PcmConversion(6);
+    passed &= PoolSteadyState(context, videoFilename);
+    passed &= PresenterChurn(context, videoFilename);
+    passed &= LoopTurnaround(context, videoFilename, false);
+    passed &= LoopTurnaround(context, videoFilename, true);
+
+    URHO3D_LOGINFOF("---- Theora checks %s ----", passed ? "passed" : "FAILED");
+    return passed;
+}
+
+void TheoraBenchmark::YuvConversion(int width, int height, th_pixel_fmt pixelFmt)
+{
+    th_ycbcr_buffer yuv;
+    SharedArrayPtr<unsigned char> planes = CreateYuvFrame(yuv, width, height, pixelFmt);
+    SharedArrayPtr<unsigned char> reference(new unsigned char[width * height * 4]);
+    SharedArrayPtr<unsigned char> output(new unsigned char[width * height * 4]);
+
+    YuvConverter converter;
+    converter.SetPixelFormat(pixelFmt);
+    converter.SetPath(YUV_PATH_C);
+    converter.Convert(yuv, reference.Get(), width * 4, 0, height);
+
+    for (int path = YUV_PATH_C; path < MAX_YUV_PATHS; ++path)
+    {
+        if (!YuvConverter::IsPathSupported((YuvConvertPath)path))
+        {
+            URHO3D_LOGINFOF("yuv %s %dx%d %s: not supported", YuvConverter::GetPixelFormatName(pixelFmt), width, height,
+                            YuvConverter::GetPathName((YuvConvertPath)path));
+            continue;
+        }
+
+        converter.SetPath((YuvConvertPath)path);
+        memset(output.Get(), 0, width * height * 4);
+
+        HiresTimer timer;
+        for (int i = 0; i < BenchmarkIterations; ++i)
+        {
+            converter.Convert(yuv, output.Get(), width * 4, 0, height);
+        }
+        long long usec = Max(timer.GetUSec(false), 1LL);
+
+        bool identical = memcmp(output.Get(), reference.Get(), width * height * 4) == 0;
+        float mpixelsPerSec = (float)width * height * BenchmarkIterations / (float)usec;
+
+        URHO3D_LOGINFOF("yuv %s %dx%d %s: %.1f MP/s%s", YuvConverter::GetPixelFormatName(pixelFmt), width, height,
+                        YuvConverter::GetPathName((YuvConvertPath)path), mpixelsPerSec, identical ? "" : " - OUTPUT MISMATCH");
+    }
+}
+
+bool TheoraBenchmark::YuvExactness()
+{
+    const th_pixel_fmt pixelFmts[] = { TH_PF_420, TH_PF_422, TH_PF_444 };
+    const YuvRange ranges[] = { YUV_RANGE_STUDIO, YUV_RANGE_FULL };
+    unsigned compared = 0;
+    bool passed = true;
+
+    for (unsigned i = 0; i < sizeof(pixelFmts) / sizeof(pixelFmts[0]); ++i)
+    {
+        for (unsigned j = 0; j < sizeof(YuvExactnessRegions) / sizeof(YuvExactnessRegions[0]); ++j)
+        {
+            const YuvExactnessRegion &region = YuvExactnessRegions[j];
+            th_ycbcr_buffer frame;
+            SharedArrayPtr<unsigned char> planes = CreateYuvFrame(frame, region.frameWidth_, region.frameHeight_, pixelFmts[i]);
+
+            YuvConverter converter;
+            converter.SetPixelFormat(pixelFmts[i]);
+            converter.SetPictureRegion(region.x_, region.y_, region.width_, region.height_);
+            th_img_plane picture[3];
+            converter.CropPicture(frame, picture);
+
+            int width = converter.GetPictureWidth();
+            int height = converter.GetPictureHeight();
+            int stride = width * 4 + YuvExactnessGuardBytes;
+            SharedArrayPtr<unsigned char> reference(new unsigned char[stride * height]);
+            SharedArrayPtr<unsigned char> output(new unsigned char[stride * height]);
+
+            for (unsigned k = 0; k < sizeof(ranges) / sizeof(ranges[0]); ++k)
+            {
+                converter.SetColorSpace(TH_CS_ITU_REC_470BG, ranges[k]);
+                converter.SetPath(YUV_PATH_C);
+                memset(reference.Get(), 0, stride * height);
+                converter.Convert(picture, reference.Get(), stride, 0, height);
+
+                for (int path = YUV_PATH_C + 1; path < MAX_YUV_PATHS; ++path)
+                {
+                    if (!YuvConverter::IsPathSupported((YuvConvertPath)path))
+                    {
+                        continue;
+                    }
+
+                    converter.SetPath((YuvConvertPath)path);
+                    memset(output.Get(), 0, stride * height);
+                    converter.Convert(picture, output.Get(), stride, 0, height);
+                    ++compared;
+
+                    if (memcmp(output.Get(), reference.Get(), stride * height) != 0)
+                    {
+                        URHO3D_LOGERRORF("yuv exactness: FAILED, %s differs from %s on %s %s range %dx%d at (%d, %d)",
+                                         YuvConverter::GetPathName((YuvConvertPath)path), YuvConverter::GetPathName(YUV_PATH_C),
+                                         YuvConverter::GetPixelFormatName(pixelFmts[i]),
+                                         ranges[k] == YUV_RANGE_STUDIO ? "studio" : "full", region.width_, region.height_,
+                                         region.x_, region.y_);
+                        passed = false;
+                    }
+                }
+            }
+        }
+    }
+
+    URHO3D_LOGINFOF("yuv exactness: %u conversions compared against %s", compared, YuvConverter::GetPathName(YUV_PATH_C));
+    return passed;
+}
+
+void TheoraBenchmark::ColorSpaceCost(int width, int height)
+{
+    th_ycbcr_buffer yuv;
+    SharedArrayPtr<unsigned char> planes = CreateYuvFrame(yuv, width, height);
+    SharedArrayPtr<unsigned char> output(new unsigned char[width * height * 4]);
+
+    const th_colorspace colorSpaces[] = { TH_CS_UNSPECIFIED, TH_CS_ITU_REC_470M, TH_CS_ITU_REC_470BG };
+    YuvConverter converter;
+
+    for (int path = YUV_PATH_C; path < MAX_YUV_PATHS; ++path)
+    {
+        if (!YuvConverter::IsPathSupported((YuvConvertPath)path))
+        {
+            continue;
+        }
+
+        converter.SetPath((YuvConvertPath)path);
+
+        // first pass is the old full range behaviour, the rest what streams now get
+        for (int i = -1; i < (int)(sizeof(colorSpaces) / sizeof(colorSpaces[0])); ++i)
+        {
+            if (i < 0)
+            {
+                converter.SetColorSpace(TH_CS_UNSPECIFIED, YUV_RANGE_FULL);
+            }
+            else
+            {
+                converter.SetColorSpace(colorSpaces[i], YUV_RANGE_STUDIO);
+            }
+
+            HiresTimer timer;
+            for (int j = 0; j < BenchmarkIterations; ++j)
+            {
+                converter.Convert(yuv, output.Get(), width * 4, 0, height);
+            }
+            long long usec = Max(timer.GetUSec(false), 1LL);
+
+            float mpixelsPerSec = (float)width * height * BenchmarkIterations / (float)usec;
+            URHO3D_LOGINFOF("colorspace %dx%d %s, %s %s range: %.1f MP/s", width, height,
+                            YuvConverter::GetPathName((YuvConvertPath)path),
+                            YuvConverter::GetColorSpaceName(converter.GetColorSpace()),
+                            converter.GetRange() == YUV_RANGE_STUDIO ? "studio" : "full", mpixelsPerSec);
+        }
+    }
+}
+
+void TheoraBenchmark::BandScaling(Context *context, int width, int height)
+{
+    TheoraWorkQueue *workQueue = context->GetSubsystem<TheoraWorkQueue>();
+    if (!workQueue)
+    {
+        URHO3D_LOGINFO("band scaling: skipped, no TheoraWorkQueue subsystem");
+        return;
+    }
+
+    th_ycbcr_buffer yuv;
+    SharedArrayPtr<unsigned char> planes = CreateYuvFrame(yuv, width, height);
+    SharedArrayPtr<unsigned char> output(new unsigned char[width * height * 4]);
+    YuvConverter converter;
+
+    float singleBand = 0.0f;
+    unsigned maxBands = workQueue->GetNumThreads() + 1;
+
+    for (unsigned numBands = 1; ; numBands = Min(numBands * 2, maxBands))
+    {
+        HiresTimer timer;
+        for (int i = 0; i < BenchmarkIterations; ++i)
+        {
+            Theora::ConvertBands(workQueue, converter, yuv, output.Get(), width * 4, numBands);
+        }
+        long long usec = Max(timer.GetUSec(false), 1LL);
+
+        float mpixelsPerSec = (float)width * height * BenchmarkIterations / (float)usec;
+        if (numBands == 1)
+        {
+            singleBand = mpixelsPerSec;
+        }
+
+        URHO3D_LOGINFOF("bands %dx%d %s, %u band(s): %.1f MP/s (x%.2f)", width, height,
+                        YuvConverter::GetPathName(converter.GetPath()), numBands, mpixelsPerSec, mpixelsPerSec / singleBand);
+
+        if (numBands >= maxBands)
+        {
+            break;
+        }
+    }
+}
+
+SharedArrayPtr<unsigned char> TheoraBenchmark::CreateYuvFrame(th_ycbcr_buffer &yuv, int width, int height,
+                                                               th_pixel_fmt pixelFmt)
+{
+    int chromaWidth = pixelFmt == TH_PF_444 ? width : (width + 1) / 2;
+    int chromaHeight = pixelFmt == TH_PF_420 ? (height + 1) / 2 : height;
+    int lumaSize = width * height;
+    int chromaSize = chromaWidth * chromaHeight;
+
+    SharedArrayPtr<unsigned char> planes(new unsigned char[lumaSize + chromaSize * 2]);
+    for (int i = 0; i < lumaSize + chromaSize * 2; ++i)
+    {
+        planes[i] = (unsigned char)Rand();
+    }
+
+    yuv[0].width = width;
+    yuv[0].height = height;
+    yuv[0].stride = width;
+    yuv[0].data = planes.Get();
+    yuv[1].width = yuv[2].width = chromaWidth;
+    yuv[1].height = yuv[2].height = chromaHeight;
+    yuv[1].stride = yuv[2].stride = chromaWidth;
+    yuv[1].data = planes.Get() + lumaSize;
+    yuv[2].data = planes.Get() + lumaSize + chromaSize;
+
+    return planes;
+}
+
+void TheoraBenchmark::StripeConversion(Context *context, const String &videoFilename)
+{
+    float msecPerFrame[2] = { 0.0f, 0.0f };
+    unsigned yuvFrameBytes = 0;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        SharedPtr<Theora> theora(new Theora());
+        theora->SetStripeConversion(pass == 1);
+
+        HiresTimer timer;
+        if (theora->Initialize(context, videoFilename) != INIT_OK)
+        {
+            URHO3D_LOGINFOF("stripe conversion: skipped, cannot open %s", videoFilename.CString());
+            return;
+        }
+
+        int frames = DecodeFrames(theora, BenchmarkFrames);
+        msecPerFrame[pass] = (float)timer.GetUSec(false) / 1000.0f / (float)Max(frames, 1);
+
+        const TheoraAVInfo &info = theora->GetTheoraAVInfo();
+        yuvFrameBytes = info.videoFrameWidth_ * info.videoFrameHeight_ * 3 / 2;
+    }
+
+    // the full-frame pass re-reads every plane from memory after decode
+    float savedMBPerSec = (float)yuvFrameBytes / (1024.0f * 1024.0f) * 1000.0f / Max(msecPerFrame[1], 0.001f);
+
+    URHO3D_LOGINFOF("stripe conversion: full-frame pass %.3f ms/frame, stripe callback %.3f ms/frame, "
+                    "%u KB/frame of yuv not re-read (%.1f MB/s at this rate)",
+                    msecPerFrame[0], msecPerFrame[1], yuvFrameBytes / 1024, savedMBPerSec);
+}
+
+void TheoraBenchmark::SeekLatency(Context *context, const String &videoFilename, bool seekIndex)
+{
+    const char *mode = seekIndex ? "index" : "bisection";
+
+    SharedPtr<Theora> theora(new Theora());
+    theora->SetSeekIndex(seekIndex);
+    if (theora->Initialize(context, videoFilename) != INIT_OK)
+    {
+        URHO3D_LOGINFOF("seek latency %s: skipped, cannot open %s", mode, videoFilename.CString());
+        return;
+    }
+
+    unsigned durationMSec = theora->GetTheoraAVInfo().durationMSec_;
+    if (!durationMSec)
+    {
+        URHO3D_LOGINFOF("seek latency %s: skipped, unknown duration", mode);
+        return;
+    }
+
+    // the index is scanned in the background, time the seeks through it
+    Timer indexTimeout;
+    while (seekIndex && !theora->IsKeyframeIndexReady() && indexTimeout.GetMSec(false) < SeekTimeoutMSec)
+    {
+        Time::Sleep(1);
+    }
+
+    // the decode thread runs, so audio decoded ahead of the target frame has to be drained
+    theora->StartProcess();
+
+    float seekMSecTotal = 0.0f;
+    float seekMSecMax = 0.0f;
+    float frameMSecTotal = 0.0f;
+    float frameMSecMax = 0.0f;
+    unsigned readsTotal = 0;
+    unsigned readsMax = 0;
+    int timeouts = 0;
+    unsigned indexed = 0;
+
+    // both modes seek to the same positions
+    SetRandomSeed(1);
+    for (int i = 0; i < BenchmarkSeeks; ++i)
+    {
+        int64_t timeMSec = (int64_t)durationMSec * Rand() / 32767;
+
+        HiresTimer timer;
+        theora->Seek(timeMSec);
+        float seekMSec = timer.GetUSec(false) / 1000.0f;
+
+        Timer timeout;
+        while (!theora->PeekVideoQueueData() && timeout.GetMSec(false) < SeekTimeoutMSec)
+        {
+            if (!theora->GetAudioQueueData())
+            {
+                Time::Sleep(0);
+            }
+        }
+        float frameMSec = timer.GetUSec(false) / 1000.0f;
+
+        if (!theora->PeekVideoQueueData())
+        {
+            ++timeouts;
+        }
+
+        TheoraStats stats = theora->GetStats();
+        unsigned reads = stats.lastSeekReads_;
+        indexed += stats.lastSeekIndexed_ ? 1 : 0;
+        seekMSecTotal += seekMSec;
+        seekMSecMax = Max(seekMSecMax, seekMSec);
+        frameMSecTotal += frameMSec;
+        frameMSecMax = Max(frameMSecMax, frameMSec);
+        readsTotal += reads;
+        readsMax = Max(readsMax, reads);
+    }
+
+    // a linear scan reads half the file on average, bisection about log2 of it per lookup
+    unsigned fileBlocks = Max(theora->file_->GetSize() / 4096, 1u);
+    float log2Blocks = logf((float)fileBlocks) / logf(2.0f);
+
+    URHO3D_LOGINFOF("seek latency %s: %d seeks over %u ms (%u indexed), seek %.2f ms avg %.2f ms max, "
+                    "first frame %.2f ms avg %.2f ms max%s",
+                    mode, BenchmarkSeeks, durationMSec, indexed, seekMSecTotal / BenchmarkSeeks, seekMSecMax,
+                    frameMSecTotal / BenchmarkSeeks, frameMSecMax, timeouts ? " - TIMED OUT" : "");
+    URHO3D_LOGINFOF("seek latency %s: %.1f reads avg %u max for %u KB, log2(4 KB blocks) %.1f, linear scan avg %u",
+                    mode, (float)readsTotal / BenchmarkSeeks, readsMax, fileBlocks * 4, log2Blocks, fileBlocks / 2);
+}
+
+void TheoraBenchmark::InputThroughput(Context *context, const String &videoFilename)
+{
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        SharedPtr<Theora> theora(new Theora());
+        theora->SetMappedInput(pass == 1);
+        if (theora->Initialize(context, videoFilename) != INIT_OK)
+        {
+            URHO3D_LOGINFOF("input throughput: skipped, cannot open %s", videoFilename.CString());
+            return;
+        }
+
+        const char *mode = theora->IsInputMapped() ? "mapped" : "buffered";
+
+        // demux only, every page of the file is cut and checked but not decoded
+        unsigned long long pageBytes = 0;
+        unsigned pages = 0;
+        HiresTimer timer;
+        for (int i = 0; i < BenchmarkIterations; ++i)
+        {
+            theora->SeekFile(0);
+            ogg_page page;
+            while (true)
+            {
+                while (theora->PageOut(&page) > 0)
+                {
+                    pageBytes += page.header_len + page.body_len;
+                    ++pages;
+                }
+                if (theora->FileEof())
+                {
+                    break;
+                }
+                theora->BufferData();
+            }
+        }
+        long long usec = Max(timer.GetUSec(false), 1LL);
+
+        URHO3D_LOGINFOF("input throughput %s: demux %.1f MB/s, %u pages per pass",
+                        mode, (float)pageBytes / (float)usec, pages / BenchmarkIterations);
+
+        // decoding needs a player past its headers, not one at a rewound file
+        theora = new Theora();
+        theora->SetMappedInput(pass == 1);
+        if (theora->Initialize(context, videoFilename) != INIT_OK)
+        {
+            return;
+        }
+
+        TheoraStats before = theora->GetStats();
+        int frames = Max(DecodeFrames(theora, BenchmarkFrames), 1);
+        TheoraStats after = theora->GetStats();
+
+        URHO3D_LOGINFOF("input throughput %s: %d frames, %.2f reads/frame, %.1f KB/frame",
+                        mode, frames, (float)(after.inputReads_ - before.inputReads_) / frames,
+                        (float)(after.inputBytes_ - before.inputBytes_) / 1024.0f / frames);
+    }
+}
+
+bool TheoraBenchmark::PcmConversion(int channels)
+{
+    // a fake dsp state is all vorbis_synthesis_pcmout/read and the int16 entry point look at
+    vorbis_info vi;
+    memset(&vi, 0, sizeof(vi));
+    vi.channels = channels;
+
+    PODVector<float> samples(BenchmarkPcmSamples * channels);
+    PODVector<float*> channelPcm(channels);
+    PODVector<float*> returnedPcm(channels);
+    for (int j = 0; j < channels; ++j)
+    {
+        channelPcm[j] = &samples[j * BenchmarkPcmSamples];
+        // a little out of range so the clamp is exercised
+        for (int i = 0; i < BenchmarkPcmSamples; ++i)
+        {
+            channelPcm[j][i] = Random(-1.2f, 1.2f);
+        }
+    }
+
+    vorbis_dsp_state dsp;
+    memset(&dsp, 0, sizeof(dsp));
+    dsp.vi = &vi;
+    dsp.pcm = &channelPcm[0];
+    dsp.pcmret = &returnedPcm[0];
+
+    SharedArrayPtr<int16_t> reference(new int16_t[BenchmarkPcmSamples * channels]);
+    SharedArrayPtr<int16_t> output(new int16_t[BenchmarkPcmSamples * channels]);
+    float msamplesPerSec[2];
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        HiresTimer timer;
+        for (int k = 0; k < BenchmarkIterations * 10; ++k)
+        {
+            dsp.pcm_current = BenchmarkPcmSamples;
+            dsp.pcm_returned = 0;
+
+            if (pass == 0)
+            {
+                // what Theora::DecodeAudio did before
+                float **pcm;
+                int ret = vorbis_synthesis_pcmout(&dsp, &pcm);
+                int countIdx = 0;
+                for (int i = 0; i < ret; ++i)
+                {
+                    for (int j = 0; j < channels; ++j)
+                    {
+                        reference[countIdx++] = Clamp(FloorToInt(pcm[j][i] * 32767.0f), -32768, 32767);
+                    }
+                }
+                vorbis_synthesis_read(&dsp, ret);
+            }
+            else
+            {
+                vorbis_synthesis_pcmout_int16(&dsp, output.Get(), BenchmarkPcmSamples);
+            }
+        }
+        long long usec = Max(timer.GetUSec(false), 1LL);
+        msamplesPerSec[pass] = (float)BenchmarkPcmSamples * channels * BenchmarkIterations * 10 / (float)usec;
+    }
+
+    URHO3D_LOGINFOF("pcm conversion %d channel(s): float loop %.1f MS/s, int16 entry point %.1f MS/s (x%.2f)",
+                    channels, msamplesPerSec[0], msamplesPerSec[1], msamplesPerSec[1] / Max(msamplesPerSec[0], 0.001f));
+
+    if (memcmp(output.Get(), reference.Get(), BenchmarkPcmSamples * channels * sizeof(int16_t)) != 0)
+    {
+        URHO3D_LOGERRORF("pcm conversion %d channel(s): FAILED, int16 entry point output differs from the float loop", channels);
+        return false;
+    }
+    return true;
+}
+
+void TheoraBenchmark::StreamScaling(Context *context, const String &videoFilename)
+{
+    // a pool of the player's own when it runs with one, a temporary one otherwise
+    SharedPtr<TheoraManager> manager(context->GetSubsystem<TheoraManager>());
+    bool ownManager = !manager;
+    if (ownManager)
+    {
+        manager = new TheoraManager(context);
+        manager->CreateThreads(0);
+        context->RegisterSubsystem(manager);
+    }
+
+    for (unsigned numStreams = 1; numStreams <= ScalingMaxStreams; numStreams *= 2)
+    {
+        if (!PlayStreams(context, videoFilename, numStreams, false, false) ||
+            !PlayStreams(context, videoFilename, numStreams, true, false))
+        {
+            break;
+        }
+    }
+
+    if (ownManager)
+    {
+        context->RemoveSubsystem<TheoraManager>();
+    }
+}
+
+void TheoraBenchmark::LodScaling(Context *context, const String &videoFilename)
+{
+    SharedPtr<TheoraManager> manager(context->GetSubsystem<TheoraManager>());
+    bool ownManager = !manager;
+    if (ownManager)
+    {
+        manager = new TheoraManager(context);
+        manager->CreateThreads(0);
+        context->RegisterSubsystem(manager);
+    }
+
+    for (unsigned numStreams = ScalingMaxStreams / 2; numStreams <= LodScalingMaxStreams; numStreams *= 2)
+    {
+        if (!PlayStreams(context, videoFilename, numStreams, true, false) ||
+            !PlayStreams(context, videoFilename, numStreams, true, true))
+        {
+            break;
+        }
+    }
+
+    if (ownManager)
+    {
+        context->RemoveSubsystem<TheoraManager>();
+    }
+}
+
+bool TheoraBenchmark::PoolSteadyState(Context *context, const String &videoFilename)
+{
+    // looped so a short video still plays the whole run
+    SharedPtr<Theora> theora(new Theora());
+    theora->SetLooping(true);
+    theora->SetManaged(false);
+    if (theora->Initialize(context, videoFilename) != INIT_OK)
+    {
+        URHO3D_LOGERRORF("pool steady state: FAILED, cannot open %s", videoFilename.CString());
+        return false;
+    }
+    theora->StartProcess();
+
+    const VideoDataPool &videoPool = theora->GetVideoDataPool();
+    const AudioDataPool &audioPool = theora->GetAudioDataPool();
+    unsigned videoAllocations = 0;
+    unsigned audioAllocations = 0;
+    unsigned frames = 0;
+    bool timedOut = false;
+
+    // every frame is taken as soon as it is decoded and the clock moved on to it
+    while (frames < PoolWarmupFrames + BenchmarkFrames)
+    {
+        if (!WaitForFrame(theora))
+        {
+            timedOut = true;
+            break;
+        }
+        SharedPtr<VideoData> frame = theora->GetVideoQueueData();
+
+        if (++frames == PoolWarmupFrames)
+        {
+            videoAllocations = videoPool.GetNumAllocations();
+            audioAllocations = audioPool.GetNumAllocations();
+        }
+        theora->SetElapsedTime(frame->time_);
+    }
+
+    videoAllocations = videoPool.GetNumAllocations() - videoAllocations;
+    audioAllocations = audioPool.GetNumAllocations() - audioAllocations;
+    unsigned reuses = videoPool.GetNumReuses() + audioPool.GetNumReuses();
+
+    URHO3D_LOGINFOF("pool steady state: %u frames after %u to warm up, %u video and %u audio buffers allocated, "
+                    "%u reused", frames - Min(frames, PoolWarmupFrames), PoolWarmupFrames, videoAllocations,
+                    audioAllocations, reuses);
+
+    if (timedOut || frames < PoolWarmupFrames + BenchmarkFrames)
+    {
+        URHO3D_LOGERRORF("pool steady state: FAILED, %u of %u frames played", frames, PoolWarmupFrames + BenchmarkFrames);
+        return false;
+    }
+    if (videoAllocations || audioAllocations)
+    {
+        URHO3D_LOGERRORF("pool steady state: FAILED, %u buffers allocated in steady state", videoAllocations + audioAllocations);
+        return false;
+    }
+    return true;
+}
+
+bool TheoraBenchmark::PresenterChurn(Context *context, const String &videoFilename)
+{
+    // looped so a short video still plays the whole run
+    SharedPtr<Theora> theora(new Theora());
+    theora->SetLooping(true);
+    theora->SetManaged(false);
+    if (theora->Initialize(context, videoFilename) != INIT_OK)
+    {
+        URHO3D_LOGERRORF("presenter churn: FAILED, cannot open %s", videoFilename.CString());
+        return false;
+    }
+    const TheoraAVInfo &info = theora->GetTheoraAVInfo();
+    theora->StartProcess();
+
+    // without a Time subsystem every update is a rendered frame of its own
+    SharedPtr<Time> time(context->GetSubsystem<Time>());
+    context->RemoveSubsystem<Time>();
+
+    SharedPtr<Material> material(new Material(context));
+    SharedPtr<TheoraPresenter> presenter(new TheoraPresenter(context));
+    presenter->Init(material, info.videoFrameWidth_, info.videoFrameHeight_);
+
+    double frameMSec = 1000.0 / info.videoFrameRate_;
+    double clockMSec = 0.0;
+    unsigned multipleUploads = 0;
+    unsigned uploadsAfterHitch = 0;
+    bool timedOut = false;
+
+    for (unsigned i = 0; i < PresenterUpdates; ++i)
+    {
+        // the hitch update comes late, the frames due meanwhile are superseded by the newest
+        clockMSec += frameMSec * (i == PresenterHitchUpdate ? PresenterHitchFrames : 1);
+        theora->SetElapsedTime((int64_t)clockMSec);
+        if (!WaitForFrame(theora))
+        {
+            timedOut = true;
+            break;
+        }
+
+        unsigned uploads = presenter->GetNumUploads();
+        presenter->Update(theora, (int64_t)clockMSec);
+        uploads = presenter->GetNumUploads() - uploads;
+
+        if (uploads > 1)
+        {
+            ++multipleUploads;
+        }
+        if (i > PresenterHitchUpdate)
+        {
+            uploadsAfterHitch += uploads;
+        }
+    }
+
+    if (time)
+    {
+        context->RegisterSubsystem(time);
+    }
+
+    URHO3D_LOGINFOF("presenter churn: %u updates, %u texture allocations, %u uploads, %u frames skipped, "
+                    "%u uploads after a %u frame hitch", PresenterUpdates, presenter->GetNumAllocations(),
+                    presenter->GetNumUploads(), presenter->GetNumSkipped(), uploadsAfterHitch, PresenterHitchFrames);
+
+    if (timedOut)
+    {
+        URHO3D_LOGERRORF("presenter churn: FAILED, no frame decoded within %u ms", FrameTimeoutMSec);
+        return false;
+    }
+    if (presenter->GetNumAllocations() != 1)
+    {
+        URHO3D_LOGERRORF("presenter churn: FAILED, %u texture allocations", presenter->GetNumAllocations());
+        return false;
+    }
+    if (multipleUploads)
+    {
+        URHO3D_LOGERRORF("presenter churn: FAILED, %u updates uploaded more than one frame", multipleUploads);
+        return false;
+    }
+    if (!uploadsAfterHitch)
+    {
+        URHO3D_LOGERRORF("presenter churn: FAILED, no frame uploaded after the hitch");
+        return false;
+    }
+    return true;
+}
+
+bool TheoraBenchmark::LoopTurnaround(Context *context, const String &videoFilename, bool pipeline)
+{
+    const char *mode = pipeline ? "pipeline" : "inline";
+
+    SharedPtr<Theora> theora(new Theora());
+    theora->SetLooping(true);
+    theora->SetManaged(false);
+    if (!pipeline)
+    {
+        theora->SetPrefetchWindow(0);
+    }
+    if (theora->Initialize(context, videoFilename) != INIT_OK)
+    {
+        URHO3D_LOGERRORF("loop turnaround %s: FAILED, cannot open %s", mode, videoFilename.CString());
+        return false;
+    }
+
+    int64_t durationMSec = theora->GetTheoraAVInfo().durationMSec_;
+    if (!durationMSec)
+    {
+        URHO3D_LOGERRORF("loop turnaround %s: FAILED, unknown duration", mode);
+        return false;
+    }
+
+    float frameIntervalMSec = 1000.0f / theora->GetTheoraAVInfo().videoFrameRate_;
+    theora->StartProcess();
+
+    unsigned frames = 0;
+    unsigned gaps = 0;
+    int64_t lastTime = 0;
+    float waitMSecTotal = 0.0f;
+    float passWaitMSecMax = 0.0f;
+    PODVector<int64_t> audioTimes;
+    int64_t lastAudioTime = -1;
+    int64_t audioStepMin = M_MAX_INT;
+    int64_t audioStepMax = 0;
+    unsigned allocations = 0;
+    bool timedOut = false;
+
+    // every frame is taken as soon as it is decoded and the clock moved on to it
+    for (;;)
+    {
+        HiresTimer timer;
+        if (!WaitForFrame(theora, &audioTimes))
+        {
+            timedOut = true;
+            break;
+        }
+        SharedPtr<VideoData> frame = theora->GetVideoQueueData();
+
+        for (unsigned i = 0; i < audioTimes.Size(); ++i)
+        {
+            if (lastAudioTime >= 0)
+            {
+                audioStepMin = Min(audioStepMin, audioTimes[i] - lastAudioTime);
+                audioStepMax = Max(audioStepMax, audioTimes[i] - lastAudioTime);
+            }
+            lastAudioTime = audioTimes[i];
+        }
+        audioTimes.Clear();
+
+        float waitMSec = timer.GetUSec(false) / 1000.0f;
+        waitMSecTotal += waitMSec;
+
+        if (frames)
+        {
+            if (Abs((float)(frame->time_ - lastTime) - frameIntervalMSec) > 1.5f)
+            {
+                ++gaps;
+            }
+
+            // the first frame of a pass, frame times end their interval
+            if ((frame->time_ - 1) / durationMSec != (lastTime - 1) / durationMSec)
+            {
+                passWaitMSecMax = Max(passWaitMSecMax, waitMSec);
+
+                if ((frame->time_ - 1) / durationMSec == 1)
+                {
+                    allocations = theora->GetVideoDataPool().GetNumAllocations() + theora->GetAudioDataPool().GetNumAllocations();
+                }
+                else if ((frame->time_ - 1) / durationMSec >= (int64_t)BenchmarkLoops)
+                {
+                    break;
+                }
+            }
+        }
+
+        ++frames;
+        lastTime = frame->time_;
+        theora->SetElapsedTime(frame->time_);
+    }
+
+    allocations = theora->GetVideoDataPool().GetNumAllocations() + theora->GetAudioDataPool().GetNumAllocations() - allocations;
+    TheoraStats stats = theora->GetStats();
+
+    // the same first frame by tearing the player down and opening the file again
+    HiresTimer reopenTimer;
+    theora = new Theora();
+    theora->SetManaged(false);
+    if (!pipeline)
+    {
+        theora->SetPrefetchWindow(0);
+    }
+    float reopenMSec = 0.0f;
+    if (theora->Initialize(context, videoFilename) == INIT_OK)
+    {
+        theora->StartProcess();
+        WaitForFrame(theora);
+        reopenMSec = reopenTimer.GetUSec(false) / 1000.0f;
+    }
+
+    URHO3D_LOGINFOF("loop turnaround %s: %u loops, %u frames, %u gaps in frame times, %u buffers allocated after the "
+                    "first pass%s", mode, stats.loops_, frames, gaps, allocations, timedOut ? " - TIMED OUT" : "");
+    URHO3D_LOGINFOF("loop turnaround %s: decoder reset %.3f ms, first frame of a pass %.2f ms max vs %.2f ms avg, "
+                    "reopening %.2f ms, audio chunks %d - %d ms apart",
+                    mode, stats.lastLoopMSec_, passWaitMSecMax, waitMSecTotal / Max(frames, 1u), reopenMSec,
+                    (int)(audioStepMin == M_MAX_INT ? 0 : audioStepMin), (int)audioStepMax);
+
+    if (timedOut || stats.loops_ < BenchmarkLoops)
+    {
+        URHO3D_LOGERRORF("loop turnaround %s: FAILED, %u of %u loops played", mode, stats.loops_, BenchmarkLoops);
+        return false;
+    }
+    if (gaps)
+    {
+        URHO3D_LOGERRORF("loop turnaround %s: FAILED, %u gaps in frame times", mode, gaps);
+        return false;
+    }
+    if (allocations)
+    {
+        URHO3D_LOGERRORF("loop turnaround %s: FAILED, %u buffers allocated after the first pass", mode, allocations);
+        return false;
+    }
+    return true;
+}
+
+void TheoraBenchmark::HeaderSharing(Context *context, const String &videoFilename, bool shared)
+{
+    const char *mode = shared ? "shared" : "per instance";
+
+    // the cache is registered for the shared run only, whatever the application set up
+    SharedPtr<TheoraHeaderCache> appCache(context->GetSubsystem<TheoraHeaderCache>());
+    context->RemoveSubsystem<TheoraHeaderCache>();
+    SharedPtr<TheoraHeaderCache> cache;
+    if (shared)
+    {
+        cache = new TheoraHeaderCache(context);
+        context->RegisterSubsystem(cache);
+    }
+
+    Vector<SharedPtr<Theora> > instances;
+    unsigned long long startBytes = 0;
+    unsigned long long firstBytes = 0;
+    unsigned long long startHeap = 0;
+    unsigned long long firstHeap = 0;
+    float firstMSec = 0.0f;
+    float restMSec = 0.0f;
+    float restHeaderMSec = 0.0f;
+    unsigned restShared = 0;
+
+    // the first round only grows the heap, so both modes are measured from the same state
+    for (unsigned round = 0; round < 2; ++round)
+    {
+        instances.Clear();
+        startBytes = GetResidentBytes();
+        startHeap = GetHeapBytes();
+        restMSec = 0.0f;
+        restHeaderMSec = 0.0f;
+        restShared = 0;
+
+        for (unsigned i = 0; i < SharingInstances; ++i)
+        {
+            HiresTimer timer;
+            SharedPtr<Theora> theora(new Theora());
+            theora->SetManaged(false);
+            theora->SetSeekIndex(false);
+            if (theora->Initialize(context, videoFilename) != INIT_OK)
+            {
+                URHO3D_LOGINFOF("header sharing %s: skipped, cannot open %s", mode, videoFilename.CString());
+                break;
+            }
+            float msec = timer.GetUSec(false) / 1000.0f;
+            instances.Push(theora);
+
+            if (i == 0)
+            {
+                firstMSec = msec;
+                firstBytes = GetResidentBytes();
+                firstHeap = GetHeapBytes();
+            }
+            else
+            {
+                TheoraStats stats = theora->GetStats();
+                restMSec += msec;
+                restHeaderMSec += stats.headerMSec_;
+                restShared += stats.sharedHeaders_ ? 1 : 0;
+            }
+        }
+
+        if (instances.Size() != SharingInstances)
+        {
+            break;
+        }
+    }
+
+    if (instances.Size() == SharingInstances)
+    {
+        unsigned long long endBytes = GetResidentBytes();
+        unsigned long long endHeap = GetHeapBytes();
+        unsigned numRest = SharingInstances - 1;
+
+        URHO3D_LOGINFOF("header sharing %s: %u instances, first opened in %.2f ms, each after it in %.2f ms",
+                        mode, SharingInstances, firstMSec, restMSec / numRest);
+        // the heap figure is exact, resident memory moves with what the allocator keeps or returns
+        if (endBytes || endHeap)
+        {
+            URHO3D_LOGINFOF("header sharing %s: first instance %.1f KB heap %.1f KB resident, each after it "
+                            "%.1f KB heap %.1f KB resident", mode,
+                            (double)((long long)(firstHeap - startHeap)) / 1024.0,
+                            (double)((long long)(firstBytes - startBytes)) / 1024.0,
+                            (double)((long long)(endHeap - firstHeap)) / 1024.0 / numRest,
+                            (double)((long long)(endBytes - firstBytes)) / 1024.0 / numRest);
+        }
+        else
+        {
+            URHO3D_LOGINFOF("header sharing %s: memory use not available", mode);
+        }
+
+        URHO3D_LOGINFOF("header sharing %s: headers of each instance after the first %.3f ms, %u of %u shared",
+                        mode, restHeaderMSec / numRest, restShared, numRest);
+    }
+
+    instances.Clear();
+
+    if (cache)
+    {
+        context->RemoveSubsystem<TheoraHeaderCache>();
+    }
+    if (appCache)
+    {
+        context->RegisterSubsystem(appCache);
+    }
+}
+
+void TheoraBenchmark::AsyncOpen(Context *context, const String &videoFilename)
+{
+    // Initialize() - the caller waits for every open in turn
+    {
+        Vector<SharedPtr<Theora> > instances;
+        float totalMSec = 0.0f;
+        float maxMSec = 0.0f;
+
+        for (unsigned i = 0; i < AsyncOpenInstances; ++i)
+        {
+            HiresTimer timer;
+            SharedPtr<Theora> theora(new Theora());
+            theora->SetManaged(false);
+            theora->SetSeekIndex(false);
+            if (theora->Initialize(context, videoFilename) != INIT_OK)
+            {
+                URHO3D_LOGINFOF("async open: skipped, cannot open %s", videoFilename.CString());
+                return;
+            }
+            float msec = timer.GetUSec(false) / 1000.0f;
+            totalMSec += msec;
+            maxMSec = Max(maxMSec, msec);
+            instances.Push(theora);
+        }
+
+        URHO3D_LOGINFOF("async open: %u videos with Initialize(), caller blocked %.2f ms (longest call %.2f ms)",
+                        AsyncOpenInstances, totalMSec, maxMSec);
+    }
+
+    // InitializeAsync() - the caller only starts the opens, then polls for them like the
+    // notifier does once a frame
+    Vector<SharedPtr<Theora> > instances;
+    float totalMSec = 0.0f;
+    float maxMSec = 0.0f;
+    HiresTimer allTimer;
+
+    for (unsigned i = 0; i < AsyncOpenInstances; ++i)
+    {
+        HiresTimer timer;
+        SharedPtr<Theora> theora(new Theora());
+        theora->SetManaged(false);
+        theora->SetSeekIndex(false);
+        if (!theora->InitializeAsync(context, videoFilename))
+        {
+            URHO3D_LOGINFOF("async open: cannot start opening %s", videoFilename.CString());
+            return;
+        }
+        float msec = timer.GetUSec(false) / 1000.0f;
+        totalMSec += msec;
+        maxMSec = Max(maxMSec, msec);
+        instances.Push(theora);
+    }
+
+    unsigned numOpening = AsyncOpenInstances;
+    while (numOpening && allTimer.GetUSec(false) < AsyncOpenTimeoutMSec * 1000)
+    {
+        Time::Sleep(1);
+
+        numOpening = 0;
+        for (unsigned i = 0; i < instances.Size(); ++i)
+        {
+            numOpening += instances[i]->IsOpening() ? 1 : 0;
+        }
+    }
+    float allMSec = allTimer.GetUSec(false) / 1000.0f;
+
+    if (numOpening)
+    {
+        URHO3D_LOGINFOF("async open: %u of %u videos TIMED OUT", numOpening, AsyncOpenInstances);
+        return;
+    }
+
+    float latencyMSec = 0.0f;
+    float maxLatencyMSec = 0.0f;
+    for (unsigned i = 0; i < instances.Size(); ++i)
+    {
+        if (instances[i]->GetOpenResult() != INIT_OK)
+        {
+            URHO3D_LOGINFOF("async open: open failed with %d", instances[i]->GetOpenResult());
+            return;
+        }
+
+        float msec = instances[i]->GetStats().openMSec_;
+        latencyMSec += msec;
+        maxLatencyMSec = Max(maxLatencyMSec, msec);
+    }
+
+    URHO3D_LOGINFOF("async open: %u videos with InitializeAsync(), caller blocked %.2f ms (longest call %.3f ms)",
+                    AsyncOpenInstances, totalMSec, maxMSec);
+    URHO3D_LOGINFOF("async open: open to first frame %.2f ms avg, %.2f ms max, all ready after %.2f ms",
+                    latencyMSec / AsyncOpenInstances, maxLatencyMSec, allMSec);
+}
+
+void TheoraBenchmark::ResourcePreload(Context *context, const String &videoFilename)
+{
+    // what a loading thread does for the resource, then what the main thread is left with
+    ResourceCache *cache = context->GetSubsystem<ResourceCache>();
+    SharedPtr<File> file = cache ? cache->GetFile(videoFilename, false) : SharedPtr<File>(new File(context, videoFilename, FILE_READ));
+    SharedPtr<TheoraVideo> video(new TheoraVideo(context));
+    video->SetName(videoFilename);
+
+    HiresTimer timer;
+    if (!file || !file->IsOpen() || !video->BeginLoad(*file))
+    {
+        URHO3D_LOGINFOF("resource preload: skipped, cannot open %s", videoFilename.CString());
+        return;
+    }
+    float beginMSec = timer.GetUSec(true) / 1000.0f;
+    video->EndLoad();
+    float endMSec = timer.GetUSec(true) / 1000.0f;
+
+    // the prepared instance, started as a player would on its first frame
+    SharedPtr<Theora> prepared = video->CreateInstance();
+    prepared->SetManaged(false);
+    bool ready = !prepared->IsOpening() && prepared->PeekVideoQueueData();
+    prepared->StartProcess();
+    float startMSec = timer.GetUSec(true) / 1000.0f;
+
+    // the next instance opens on its own
+    SharedPtr<Theora> next = video->CreateInstance();
+    float createMSec = timer.GetUSec(false) / 1000.0f;
+    while (next && next->IsOpening() && timer.GetUSec(false) < AsyncOpenTimeoutMSec * 1000)
+    {
+        Time::Sleep(1);
+    }
+    bool nextReady = next && !next->IsOpening() && next->GetOpenResult() == INIT_OK;
+
+    URHO3D_LOGINFOF("resource preload: BeginLoad %.2f ms, EndLoad %.3f ms, first instance %s and started in %.3f ms",
+                    beginMSec, endMSec, ready ? "had its first frame" : "had NO frame", startMSec);
+    URHO3D_LOGINFOF("resource preload: next instance created in %.3f ms, first frame %s %.2f ms",
+                    createMSec, nextReady ? "after" : "NOT READY after", next ? next->GetStats().openMSec_ : 0.0f);
+}
+
+bool TheoraBenchmark::PlayStreams(Context *context, const String &videoFilename, unsigned numStreams,
+                                  bool managed, bool lodMix)
+{
+    const char *mode = lodMix ? "managed lod mix" : (managed ? "managed" : "dedicated");
+    TheoraManager *manager = context->GetSubsystem<TheoraManager>();
+
+    Vector<SharedPtr<Theora> > streams;
+    for (unsigned i = 0; i < numStreams; ++i)
+    {
+        SharedPtr<Theora> theora(new Theora());
+        theora->SetSeekIndex(false);
+        theora->SetManaged(managed);
+        if (theora->Initialize(context, videoFilename) != INIT_OK)
+        {
+            URHO3D_LOGINFOF("stream scaling: skipped, cannot open %s", videoFilename.CString());
+            return false;
+        }
+
+        // a scene full of screens - most out of view or far away, a few close up
+        if (lodMix)
+        {
+            theora->SetDecodeLod(i % 8 == 0 ? DECODE_LOD_FULL : (i % 8 == 1 ? DECODE_LOD_REDUCED :
+                                 (i % 4 == 2 ? DECODE_LOD_KEYFRAMES : DECODE_LOD_AUDIO)));
+        }
+        streams.Push(theora);
+    }
+
+    for (unsigned i = 0; i < numStreams; ++i)
+    {
+        streams[i]->StartProcess();
+    }
+
+    unsigned threads = 0;
+    for (unsigned i = 0; i < numStreams; ++i)
+    {
+        Theora *theora = streams[i];
+        threads += (theora->IsStarted() ? 1 : 0) + (theora->pipelineRunning_ ? 2 : 0) +
+                   (theora->audioThreadRunning_ ? 1 : 0);
+    }
+    threads += managed && manager ? manager->GetNumThreads() : 0;
+
+    unsigned long long stepsBefore = manager ? manager->GetNumSteps() : 0;
+    unsigned long long stealsBefore = manager ? manager->GetNumSteals() : 0;
+
+    // presents the latest due frame of every stream per tick, a tick with more than one
+    // due means the decoder delivered late. only full LOD streams are expected to keep up
+    unsigned numFull = 0;
+    unsigned presented = 0;
+    unsigned superseded = 0;
+    unsigned starved = 0;
+    unsigned ticks = 0;
+    HiresTimer timer;
+    for (int64_t timeMSec = 0; timeMSec < ScalingRunMSec; timeMSec = timer.GetUSec(false) / 1000)
+    {
+        numFull = 0;
+        for (unsigned i = 0; i < numStreams; ++i)
+        {
+            Theora *theora = streams[i];
+            theora->SetElapsedTime(timeMSec);
+
+            unsigned due = 0;
+            VideoData *vptr = theora->PeekVideoQueueData();
+            while (vptr && vptr->time_ <= timeMSec)
+            {
+                theora->GetVideoQueueData();
+                vptr = theora->PeekVideoQueueData();
+                ++due;
+            }
+            while (theora->GetAudioQueueData())
+            {
+            }
+
+            if (theora->GetDecodeLod() != DECODE_LOD_FULL)
+            {
+                continue;
+            }
+
+            ++numFull;
+            presented += due ? 1 : 0;
+            superseded += due ? due - 1 : 0;
+            starved += !due && !vptr ? 1 : 0;
+        }
+
+        ++ticks;
+        Time::Sleep(ScalingTickMSec);
+    }
+    float seconds = timer.GetUSec(false) / 1000000.0f;
+
+    unsigned dropped = 0;
+    unsigned skipped = 0;
+    for (unsigned i = 0; i < numStreams; ++i)
+    {
+        streams[i]->WaitExit();
+
+        if (streams[i]->GetDecodeLod() == DECODE_LOD_FULL)
+        {
+            TheoraStats stats = streams[i]->GetStats();
+            dropped += stats.framesDropped_;
+            skipped += stats.framesSkipped_;
+        }
+    }
+
+    float frameRate = streams[0]->GetTheoraAVInfo().videoFrameRate_;
+    float expected = Max(frameRate * seconds * numFull, 1.0f);
+
+    URHO3D_LOGINFOF("stream scaling %s: %u streams (%u full) on %u threads, %.1f of %.1f fps/stream, "
+                    "%.1f%% late %.1f%% dropped %.1f%% skipped, %.1f%% ticks starved",
+                    mode, numStreams, numFull, threads, presented / seconds / Max(numFull, 1u), frameRate,
+                    100.0f * superseded / expected, 100.0f * dropped / expected, 100.0f * skipped / expected,
+                    100.0f * starved / Max(ticks * numFull, 1u));
+    if (managed && manager)
+    {
+        URHO3D_LOGINFOF("stream scaling %s: %llu steps %llu steals", mode,
+                        manager->GetNumSteps() - stepsBefore, manager->GetNumSteals() - stealsBefore);
+    }
+
+    return true;
+}
+
+bool TheoraBenchmark::WaitForFrame(Theora *theora, PODVector<int64_t> *audioTimes)
+{
+    Timer timeout;
+    for (;;)
+    {
+        // audio runs ahead of the clock, an inline decoder stalls on a full audio queue
+        while (SharedPtr<AudioData> audio = theora->GetAudioQueueData())
+        {
+            if (audioTimes)
+            {
+                audioTimes->Push(audio->time_);
+            }
+        }
+
+        if (theora->PeekVideoQueueData())
+        {
+            return true;
+        }
+        if (timeout.GetMSec(false) >= FrameTimeoutMSec)
+        {
+            return false;
+        }
+        Time::Sleep(0);
+    }
+}
+
+int TheoraBenchmark::DecodeFrames(Theora *theora, int maxFrames)
+{
+    double frameRate = theora->GetTheoraAVInfo().videoFrameRate_;
+    int steps = 0;
+    int frames = 0;
+
+    while (frames < maxFrames)
+    {
+        while (theora->GetVideoQueueData())
+        {
+            ++frames;
+        }
+        while (theora->GetAudioQueueData())
+        {
+        }
+
+        int decoded = theora->frames_;
+        theora->SetElapsedTime(static_cast<int64_t>(++steps * 1000.0 / frameRate));
+        theora->UpdateTimer();
+        theora->UpdateFrames();
+
+        if (theora->frames_ == decoded && theora->FileEof())
+        {
+            break;
+        }
+    }
+
+    return frames;
+}
+
+unsigned long long TheoraBenchmark::GetHeapBytes()
+{
+    unsigned long long bytes = 0;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    // small blocks in use plus the ones mapped on their own
+    struct mallinfo2 info = mallinfo2();
+    bytes = info.uordblks + info.hblkhd;
+#endif
+
+    return bytes;
+}
+
+unsigned long long TheoraBenchmark::GetResidentBytes()
+{
+    unsigned long long bytes = 0;
+
+#if defined(__linux__)
+    // second field of statm is the resident page count
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        unsigned long long size = 0;
+        unsigned long long resident = 0;
+        if (fscanf(statm, "%llu %llu", &size, &resident) == 2)
+        {
+            bytes = resident * (unsigned long long)sysconf(_SC_PAGESIZE);
+        }
+        fclose(statm);
+    }
+#endif
+
+    return bytes;
+}
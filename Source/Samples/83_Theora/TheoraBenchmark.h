@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/ArrayPtr.h>
+#include <Urho3D/Container/Vector.h>
+
+#include <theora/codec.h>
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+namespace Urho3D
+{
+class Context;
+}
+
+class Theora;
+
+//=============================================================================
+// micro benchmarks, results are written to the log
+//=============================================================================
+class TheoraBenchmark
+{
+public:
+    static void Run(Context *context, const String &videoFilename);
+    // the benchmarks that assert on their results, run by the sample's test. failures are
+    // logged as errors, false if any failed
+    static bool RunChecks(Context *context, const String &videoFilename);
+
+    // yuv to rgba conversion throughput per code path
+    static void YuvConversion(int width, int height, th_pixel_fmt pixelFmt);
+    // every SIMD conversion path against the C one, per chroma layout and range, on picture
+    // regions with odd origins and sizes. false if any output byte differs or a path writes past a row
+    static bool YuvExactness();
+    // conversion throughput with the legacy full range coefficients vs per-colorspace studio range ones
+    static void ColorSpaceCost(int width, int height);
+    // decode + convert time with stripe callback conversion vs a second full-frame pass
+    static void StripeConversion(Context *context, const String &videoFilename);
+    // conversion throughput as the frame is split into more row bands
+    static void BandScaling(Context *context, int width, int height);
+    // time and file reads to seek to random positions and get the first frame back,
+    // bisecting the file or through the keyframe index
+    static void SeekLatency(Context *context, const String &videoFilename, bool seekIndex);
+    // demux throughput and read calls per decoded frame, buffered file reads vs the memory mapped input
+    static void InputThroughput(Context *context, const String &videoFilename);
+    // vorbis float pcm to interleaved int16, the per-sample loop vs vorbis_synthesis_pcmout_int16.
+    // false if their output differs
+    static bool PcmConversion(int channels);
+    // delivered frame rate and lateness playing 1 to 64 videos at once, a thread set per video
+    // vs decode steps on the TheoraManager pool
+    static void StreamScaling(Context *context, const String &videoFilename);
+    // 32 to 128 videos on the TheoraManager pool, all at full decode LOD vs a mix where an
+    // eighth stay at full and the rest are reduced, keyframes only or audio only
+    static void LodScaling(Context *context, const String &videoFilename);
+    // buffers the video and audio data pools allocate over a stretch of playback once the
+    // queues have filled, false if any or the video can't be played
+    static bool PoolSteadyState(Context *context, const String &videoFilename);
+    // a TheoraPresenter over a stretch of updates with one that comes several frames late. false
+    // unless the texture was allocated once, no update uploaded more than one frame and frames
+    // were still uploaded after the late one
+    static bool PresenterChurn(Context *context, const String &videoFilename);
+    // looping the video a few times as fast as it decodes - frame time continuity, buffers
+    // allocated after the first pass and the wait for the first frame of a pass, vs reopening.
+    // false if a frame time jumps at the loop point, a buffer was allocated after the first
+    // pass or the video can't be played
+    static bool LoopTurnaround(Context *context, const String &videoFilename, bool pipeline);
+    // opening the same video many times with and without a TheoraHeaderCache - the time to
+    // open each instance after the first and the resident memory it adds
+    static void HeaderSharing(Context *context, const String &videoFilename, bool shared);
+    // ten videos opened at level load - how long the caller is blocked with Initialize() vs
+    // InitializeAsync(), and the time from InitializeAsync() until each first frame is ready
+    static void AsyncOpen(Context *context, const String &videoFilename);
+    // a TheoraVideo resource - BeginLoad() as run on the loading thread, EndLoad() and starting
+    // the instance it prepared on the main thread, and the open of the instance after it
+    static void ResourcePreload(Context *context, const String &videoFilename);
+
+private:
+    // random planes, returned array owns the plane memory
+    static SharedArrayPtr<unsigned char> CreateYuvFrame(th_ycbcr_buffer &yuv, int width, int height,
+                                                        th_pixel_fmt pixelFmt = TH_PF_420);
+    // plays numStreams copies of the video in real time and logs how the full LOD ones keep up,
+    // false if the video can't be opened
+    static bool PlayStreams(Context *context, const String &videoFilename, unsigned numStreams,
+                            bool managed, bool lodMix);
+    // drains the audio queue of a started decoder until a frame is at the front of the video
+    // queue, false if none came in time. the times of the audio chunks drained go into audioTimes
+    static bool WaitForFrame(Theora *theora, PODVector<int64_t> *audioTimes = 0);
+    // drives the decoder synchronously, returns the number of frames decoded
+    static int DecodeFrames(Theora *theora, int maxFrames);
+    // heap bytes allocated and resident set size of the process, 0 where they can't be read
+    static unsigned long long GetHeapBytes();
+    static unsigned long long GetResidentBytes();
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+
+#include <atomic>
+
+#include "TheoraData.h"
+#include "TheoraRingBuffer.h"
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+//=============================================================================
+// per-stream pool of fixed-size TheoraData buffers
+// - decode thread calls Acquire()
+// - main thread calls Track() on every item it pops from the frame queue
+//   and Collect() to hand items nobody else references back to the decoder
+// items travel decoder -> frame queue -> main thread -> free queue -> decoder,
+// so a refcount is only ever touched by the thread that currently owns it
+//=============================================================================
+template <class T>
+class TheoraBufferPool
+{
+public:
+    TheoraBufferPool(unsigned capacity)
+        : freeQueue_(capacity)
+        , bufferSize_(0)
+        , numAllocations_(0)
+        , numReuses_(0)
+        , numReleases_(0)
+    {
+        tracked_.Reserve(freeQueue_.Capacity());
+    }
+
+    // call before first Acquire(), buffers of a different size are discarded
+    void SetBufferSize(unsigned bufferSize)
+    {
+        bufferSize_ = bufferSize;
+    }
+
+    // decode thread
+    SharedPtr<TheoraData<T> > Acquire()
+    {
+        SharedPtr<TheoraData<T> > data = freeQueue_.Pop();
+
+        while (data && data->capacity_ != bufferSize_)
+        {
+            data = freeQueue_.Pop();
+        }
+
+        if (data)
+        {
+            ++numReuses_;
+        }
+        else
+        {
+            data = new TheoraData<T>(bufferSize_);
+            ++numAllocations_;
+        }
+
+        data->size_ = 0;
+        data->time_ = 0;
+        return data;
+    }
+
+    // main thread
+    void Track(const SharedPtr<TheoraData<T> > &data)
+    {
+        if (data)
+        {
+            tracked_.Push(data);
+        }
+    }
+
+    // main thread
+    void Collect()
+    {
+        for (unsigned i = 0; i < tracked_.Size(); )
+        {
+            // only the pool still holds it
+            if (tracked_[i].Refs() == 1)
+            {
+                SharedPtr<TheoraData<T> > data = tracked_[i];
+                tracked_[i] = tracked_.Back();
+                tracked_.Pop();
+
+                // free queue full - let it go
+                if (!freeQueue_.Push(data))
+                {
+                    ++numReleases_;
+                }
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    unsigned GetNumAllocations() const  { return numAllocations_; }
+    unsigned GetNumReuses() const       { return numReuses_; }
+    unsigned GetNumReleases() const     { return numReleases_; }
+
+private:
+    TheoraRingBuffer<TheoraData<T> >    freeQueue_;
+    Vector<SharedPtr<TheoraData<T> > >  tracked_;
+    unsigned                            bufferSize_;
+
+    // atomic so the stats can be read from any thread
+    std::atomic<unsigned>               numAllocations_;
+    std::atomic<unsigned>               numReuses_;
+    std::atomic<unsigned>               numReleases_;
+};
+
+typedef TheoraBufferPool<signed short> AudioDataPool;
+typedef TheoraBufferPool<unsigned char> VideoDataPool;
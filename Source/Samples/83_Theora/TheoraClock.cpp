@@ -0,0 +1,111 @@
+#include <Urho3D/Math/MathDefs.h>
+
+#include "TheoraClock.h"
+#include "TheoraAudio.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// further apart than this the clock jumps to the audio position
+static const int64_t ResyncThresholdUSec = 200000;
+// a fraction of the drift is taken out per update - the audio position moves in
+// mixer sized steps, this averages them out
+static const int64_t DriftCorrectionDivisor = 16;
+// and at most this fraction of the update's own step, so the clock never runs
+// backwards and frame pacing barely changes
+static const int64_t MaxCorrectionDivisor = 4;
+
+//=============================================================================
+//=============================================================================
+TheoraClock::TheoraClock()
+    : timeUSec_(0)
+    , driftUSec_(0)
+    , running_(false)
+    , audioMaster_(false)
+    , resyncs_(0)
+{
+}
+
+void TheoraClock::Reset(int64_t timeMSec)
+{
+    Stop();
+    SetTime(timeMSec);
+    driftUSec_ = 0;
+    audioMaster_ = false;
+}
+
+void TheoraClock::SetTime(int64_t timeMSec)
+{
+    timeUSec_ = timeMSec * 1000;
+    timer_.Reset();
+}
+
+void TheoraClock::Start()
+{
+    if (!running_)
+    {
+        timer_.Reset();
+        running_ = true;
+    }
+}
+
+void TheoraClock::Stop()
+{
+    running_ = false;
+}
+
+bool TheoraClock::IsRunning() const
+{
+    return running_;
+}
+
+int64_t TheoraClock::Update(const TheoraAudio *audio)
+{
+    if (!running_)
+    {
+        return GetTime();
+    }
+
+    int64_t stepUSec = timer_.GetUSec(true);
+    timeUSec_ += stepUSec;
+
+    int64_t audioMSec;
+    audioMaster_ = audio && audio->IsPlaying() && audio->GetPlaybackTime(audioMSec);
+    if (audioMaster_)
+    {
+        driftUSec_ = audioMSec * 1000 - timeUSec_;
+
+        if (Abs(driftUSec_) > ResyncThresholdUSec)
+        {
+            timeUSec_ += driftUSec_;
+            ++resyncs_;
+        }
+        else
+        {
+            int64_t maxCorrection = stepUSec / MaxCorrectionDivisor;
+            timeUSec_ += Clamp(driftUSec_ / DriftCorrectionDivisor, -maxCorrection, maxCorrection);
+        }
+    }
+
+    return GetTime();
+}
+
+int64_t TheoraClock::GetTime() const
+{
+    return timeUSec_ / 1000;
+}
+
+int64_t TheoraClock::GetDriftMSec() const
+{
+    return driftUSec_ / 1000;
+}
+
+bool TheoraClock::IsAudioMaster() const
+{
+    return audioMaster_;
+}
+
+unsigned TheoraClock::GetNumResyncs() const
+{
+    return resyncs_;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Urho3D/Core/Timer.h>
+
+#include <stdint.h>
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+class TheoraAudio;
+
+//=============================================================================
+// presentation clock - integer microseconds off the high resolution timer,
+// slaved to the audio stream position whenever sound is playing
+// - small differences are slewed out over several updates, without the clock
+//   ever stepping back, large ones (a hitch, a dry spell) are jumped
+// - main thread only
+//=============================================================================
+class TheoraClock
+{
+public:
+    TheoraClock();
+
+    // stopped at timeMSec
+    void Reset(int64_t timeMSec);
+    // moves the position, keeps running or stopped
+    void SetTime(int64_t timeMSec);
+    void Start();
+    void Stop();
+    bool IsRunning() const;
+
+    // advances by the wall time since the last update and corrects toward the
+    // audio position when audio has one, returns the new time
+    int64_t Update(const TheoraAudio *audio);
+    int64_t GetTime() const;
+
+    // audio position minus the clock at the last update that had one
+    int64_t GetDriftMSec() const;
+    // the last update followed the audio
+    bool IsAudioMaster() const;
+    // jumps to the audio position
+    unsigned GetNumResyncs() const;
+
+private:
+    HiresTimer  timer_;
+    int64_t     timeUSec_;
+    int64_t     driftUSec_;
+    bool        running_;
+    bool        audioMaster_;
+    unsigned    resyncs_;
+};
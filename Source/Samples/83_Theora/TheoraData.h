@@ -9,6 +9,8 @@ extern const int RGBAComponentSize;
 
 enum TheoraErrorType
 {
+    // opening or already open
+    OPEN_BUSY_ERROR = -7,
     CODEC_FRAMERATE_ERROR = -6,
     CODEC_YUV_ERROR = -5,
     CODEC_HEADER_ERROR = -4,
@@ -18,6 +20,22 @@ enum TheoraErrorType
     INIT_OK = 0,
 };
 
+// how much of a stream is decoded, picked from the on-screen size of its surface
+enum TheoraDecodeLod
+{
+    // every frame at full resolution and post-processing
+    DECODE_LOD_FULL = 0,
+    // every frame decoded, every other one converted at half resolution, no post-processing
+    DECODE_LOD_REDUCED,
+    // keyframes only at half resolution, no post-processing
+    DECODE_LOD_KEYFRAMES,
+    // video packets are skipped, audio is decoded as before
+    DECODE_LOD_AUDIO,
+    // nothing is read or decoded, picks up at the clock when raised again
+    DECODE_LOD_PAUSED,
+    MAX_DECODE_LODS
+};
+
 struct TheoraAVInfo
 {
     TheoraAVInfo()
@@ -25,6 +43,7 @@ struct TheoraAVInfo
         videoFrameWidth_ = 0;
         videoFrameHeight_ = 0;
         videoFrameRate_ = 0.0f;
+        durationMSec_ = 0;
 
         audioFrequencey_ = 0;
         audioSixteenBits_ = true;
@@ -36,6 +55,8 @@ struct TheoraAVInfo
     unsigned videoFrameWidth_;
     unsigned videoFrameHeight_;
     float videoFrameRate_;
+    // from the last Theora page, 0 if unknown
+    unsigned durationMSec_;
 
     long audioFrequencey_;
     bool audioSixteenBits_;
@@ -43,22 +64,151 @@ struct TheoraAVInfo
     bool initialized_;
 };
 
+static const unsigned PostProcessHistorySize = 16;
+
+// post-processing level change made by the decode-time controller
+struct TheoraPostProcessChange
+{
+    int   frame_;
+    int   level_;
+    float decodeMSec_;
+    float leadMSec_;
+};
+
+// decoder statistics, a snapshot copied out of the decode thread
+struct TheoraStats
+{
+    TheoraStats()
+    {
+        frames_ = 0;
+        decodeMSec_ = 0.0f;
+        frameIntervalMSec_ = 0.0f;
+
+        postProcessLevel_ = 0;
+        postProcessLevelMax_ = 0;
+        postProcessStepsDown_ = 0;
+        postProcessStepsUp_ = 0;
+        postProcessHistorySize_ = 0;
+
+        framesDropped_ = 0;
+        framesSkipped_ = 0;
+        framesReduced_ = 0;
+        catchUps_ = 0;
+
+        seeks_ = 0;
+        lastSeekReads_ = 0;
+        lastSeekMSec_ = 0.0f;
+        lastSeekIndexed_ = false;
+
+        loops_ = 0;
+        lastLoopMSec_ = 0.0f;
+
+        headerMSec_ = 0.0f;
+        sharedHeaders_ = false;
+        openMSec_ = 0.0f;
+
+        inputBytes_ = 0;
+        inputReads_ = 0;
+
+        prefetchedBytes_ = 0;
+        ioStallMSec_ = 0.0f;
+        demuxStallMSec_ = 0.0f;
+        decodeStallMSec_ = 0.0f;
+        decodeStalls_ = 0;
+        audioStallMSec_ = 0.0f;
+        audioStalls_ = 0;
+    }
+
+    int   frames_;
+    // smoothed decode + convert time per frame
+    float decodeMSec_;
+    float frameIntervalMSec_;
+
+    int   postProcessLevel_;
+    int   postProcessLevelMax_;
+    unsigned postProcessStepsDown_;
+    unsigned postProcessStepsUp_;
+    // most recent level changes, oldest first
+    TheoraPostProcessChange postProcessHistory_[PostProcessHistorySize];
+    unsigned postProcessHistorySize_;
+
+    // decoded but not converted or queued, already behind the clock
+    unsigned framesDropped_;
+    // not decoded while catching up to the next keyframe
+    unsigned framesSkipped_;
+    // not decoded or not converted for a lower decode LOD
+    unsigned framesReduced_;
+    unsigned catchUps_;
+
+    unsigned seeks_;
+    // file reads and time taken by the last Seek() to find and reposition on the keyframe
+    unsigned lastSeekReads_;
+    float lastSeekMSec_;
+    // looked up in the keyframe index rather than bisected
+    bool lastSeekIndexed_;
+
+    // times the video looped back to the start, and how long resetting the decoder took
+    unsigned loops_;
+    float lastLoopMSec_;
+
+    // time taken to parse the codec headers at open, or to find them already parsed
+    // in the TheoraHeaderCache
+    float headerMSec_;
+    bool sharedHeaders_;
+    // from the start of Initialize() or InitializeAsync() to the first frames decoded
+    float openMSec_;
+
+    // bytes handed to the Ogg layer and the file reads that took, none when mapped
+    unsigned long long inputBytes_;
+    unsigned inputReads_;
+
+    // read-ahead pipeline: bytes read but not yet demuxed, and time each stage spent
+    // stalled - io in reads or faulting in mapped pages, demux waiting for io, decode
+    // waiting for demux with frames due
+    unsigned prefetchedBytes_;
+    float ioStallMSec_;
+    float demuxStallMSec_;
+    float decodeStallMSec_;
+    unsigned decodeStalls_;
+    // audio thread waiting for pages with audio due
+    float audioStallMSec_;
+    unsigned audioStalls_;
+};
+
 template <class T>
 class TheoraData: public RefCounted
 {
 public:
-    TheoraData() : buf_(0), size_(0), time_(0)
+    static const unsigned CacheLineSize = 64;
+
+    TheoraData() : buf_(0), size_(0), capacity_(0), width_(0), height_(0), time_(0), block_(0)
     {
     }
 
+    // fixed-size buffer, start aligned to a cache line
+    TheoraData(unsigned capacity) : buf_(0), size_(0), capacity_(capacity), width_(0), height_(0), time_(0), block_(0)
+    {
+        block_ = new unsigned char[capacity * sizeof(T) + CacheLineSize - 1];
+        buf_ = reinterpret_cast<T*>((reinterpret_cast<size_t>(block_) + CacheLineSize - 1) & ~(size_t)(CacheLineSize - 1));
+    }
+
     virtual ~TheoraData()
     {
+        delete [] block_;
+        block_ = NULL;
         buf_ = NULL;
     }
 
-    SharedArrayPtr<T>  buf_;
+    T*                 buf_;
     int                size_;
+    unsigned           capacity_;
+    // video frames - picture size, half the stream's below DECODE_LOD_FULL
+    int                width_;
+    int                height_;
     int64_t            time_;
+
+private:
+    unsigned char      *block_;
 };
 
 typedef TheoraData<signed short> AudioData;
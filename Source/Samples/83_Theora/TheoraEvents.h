@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+//=============================================================================
+// a video opened with Theora::InitializeAsync() has its first frame decoded,
+// or failed to open. sent from the main thread, at the start of the frame
+// after the open finished
+//=============================================================================
+URHO3D_EVENT(E_THEORAFIRSTFRAME, TheoraFirstFrame)
+{
+    URHO3D_PARAM(P_THEORA, Theora);             // Theora pointer
+    URHO3D_PARAM(P_RESULT, Result);             // int, INIT_OK or the open error
+    URHO3D_PARAM(P_LATENCY, Latency);           // float, msec from InitializeAsync() to the first frame
+}
@@ -0,0 +1,253 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "TheoraHeaderCache.h"
+#include "TheoraData.h"
+
+#include <string.h>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+TheoraHeaders::TheoraHeaders()
+    : theoraHash_(0)
+    , vorbisHash_(0)
+    , parsed_(false)
+    , thSetupInfo_(NULL)
+{
+    th_info_init(&thInfo_);
+    th_comment_init(&thComment_);
+    vorbis_info_init(&vbInfo_);
+    vorbis_comment_init(&vbComment_);
+}
+
+TheoraHeaders::~TheoraHeaders()
+{
+    if (thSetupInfo_)
+    {
+        th_setup_free(thSetupInfo_);
+        thSetupInfo_ = NULL;
+    }
+
+    th_comment_clear(&thComment_);
+    th_info_clear(&thInfo_);
+    vorbis_comment_clear(&vbComment_);
+    vorbis_info_clear(&vbInfo_);
+}
+
+bool TheoraHeaders::ReadTheoraInfo(const ogg_packet *packet, th_info *info)
+{
+    // the identification header fills in the info only
+    th_comment comment;
+    th_setup_info *setup = NULL;
+    ogg_packet idPacket = *packet;
+
+    th_comment_init(&comment);
+    bool result = th_decode_headerin(info, &comment, &setup, &idPacket) > 0;
+    th_comment_clear(&comment);
+    if (setup)
+    {
+        th_setup_free(setup);
+    }
+
+    return result;
+}
+
+void TheoraHeaders::AddTheoraPacket(const ogg_packet *packet)
+{
+    AddPacket(theoraData_, theoraSizes_, theoraHash_, packet);
+}
+
+void TheoraHeaders::AddVorbisPacket(const ogg_packet *packet)
+{
+    AddPacket(vorbisData_, vorbisSizes_, vorbisHash_, packet);
+}
+
+void TheoraHeaders::AddPacket(PODVector<unsigned char> &data, PODVector<unsigned> &sizes, unsigned &hash,
+                              const ogg_packet *packet)
+{
+    unsigned size = (unsigned)packet->bytes;
+    unsigned offset = data.Size();
+    data.Resize(offset + size);
+    memcpy(&data[offset], packet->packet, size);
+    sizes.Push(size);
+
+    for (unsigned i = 0; i < size; ++i)
+    {
+        hash = SDBMHash(hash, packet->packet[i]);
+    }
+}
+
+void TheoraHeaders::GetPacket(const PODVector<unsigned char> &data, const PODVector<unsigned> &sizes, unsigned index,
+                              ogg_packet *packet)
+{
+    unsigned offset = 0;
+    for (unsigned i = 0; i < index; ++i)
+    {
+        offset += sizes[i];
+    }
+
+    memset(packet, 0, sizeof(ogg_packet));
+    packet->packet = const_cast<unsigned char*>(&data[offset]);
+    packet->bytes = sizes[index];
+    packet->b_o_s = index == 0 ? 1 : 0;
+    packet->packetno = index;
+}
+
+int TheoraHeaders::Parse()
+{
+    if (parsed_)
+    {
+        return INIT_OK;
+    }
+
+    // th_decode_headerin() returns 0 for the first video packet, so a missing header fails too
+    for (unsigned i = 0; i < theoraSizes_.Size(); ++i)
+    {
+        ogg_packet packet;
+        GetPacket(theoraData_, theoraSizes_, i, &packet);
+        if (th_decode_headerin(&thInfo_, &thComment_, &thSetupInfo_, &packet) <= 0)
+        {
+            return TH_PACKET_ERROR;
+        }
+    }
+
+    for (unsigned i = 0; i < vorbisSizes_.Size(); ++i)
+    {
+        ogg_packet packet;
+        GetPacket(vorbisData_, vorbisSizes_, i, &packet);
+        if (vorbis_synthesis_headerin(&vbInfo_, &vbComment_, &packet))
+        {
+            return VB_PACKET_ERROR;
+        }
+    }
+
+    // the first vorbis_synthesis_init() on an info builds its decode codebooks into it,
+    // done here so that decoders initialized on different threads only read them
+    if (!vorbisSizes_.Empty())
+    {
+        vorbis_dsp_state dspState;
+        if (vorbis_synthesis_init(&dspState, &vbInfo_))
+        {
+            return VB_PACKET_ERROR;
+        }
+        vorbis_dsp_clear(&dspState);
+    }
+
+    parsed_ = true;
+    return INIT_OK;
+}
+
+bool TheoraHeaders::IsParsed() const
+{
+    return parsed_;
+}
+
+unsigned TheoraHeaders::GetHash() const
+{
+    return theoraHash_ * 31 + vorbisHash_;
+}
+
+bool TheoraHeaders::Matches(const TheoraHeaders &rhs) const
+{
+    return GetHash() == rhs.GetHash() &&
+           theoraSizes_ == rhs.theoraSizes_ && vorbisSizes_ == rhs.vorbisSizes_ &&
+           theoraData_ == rhs.theoraData_ && vorbisData_ == rhs.vorbisData_;
+}
+
+const th_info& TheoraHeaders::GetTheoraInfo() const
+{
+    return thInfo_;
+}
+
+const th_comment& TheoraHeaders::GetTheoraComment() const
+{
+    return thComment_;
+}
+
+const th_setup_info* TheoraHeaders::GetTheoraSetup() const
+{
+    return thSetupInfo_;
+}
+
+vorbis_info* TheoraHeaders::GetVorbisInfo() const
+{
+    return &vbInfo_;
+}
+
+//=============================================================================
+//=============================================================================
+TheoraHeaderCache::TheoraHeaderCache(Context *context)
+    : Object(context)
+    , hits_(0)
+    , misses_(0)
+{
+}
+
+TheoraHeaderCache::~TheoraHeaderCache()
+{
+}
+
+int TheoraHeaderCache::Acquire(SharedPtr<TheoraHeaders> &headers)
+{
+    MutexLock lock(mutex_);
+
+    for (unsigned i = 0; i < entries_.Size(); ++i)
+    {
+        if (entries_[i]->Matches(*headers))
+        {
+            headers = entries_[i];
+            ++hits_;
+            return INIT_OK;
+        }
+    }
+
+    int result = headers->Parse();
+    if (result == INIT_OK)
+    {
+        entries_.Push(headers);
+        ++misses_;
+    }
+
+    return result;
+}
+
+void TheoraHeaderCache::Release(SharedPtr<TheoraHeaders> &headers)
+{
+    MutexLock lock(mutex_);
+
+    for (unsigned i = 0; i < entries_.Size(); ++i)
+    {
+        if (entries_[i] == headers)
+        {
+            headers.Reset();
+
+            // only the cache still holds it
+            if (entries_[i].Refs() == 1)
+            {
+                entries_.Erase(i);
+            }
+            return;
+        }
+    }
+
+    headers.Reset();
+}
+
+unsigned TheoraHeaderCache::GetNumEntries() const
+{
+    MutexLock lock(mutex_);
+    return entries_.Size();
+}
+
+unsigned TheoraHeaderCache::GetNumHits() const
+{
+    MutexLock lock(mutex_);
+    return hits_;
+}
+
+unsigned TheoraHeaderCache::GetNumMisses() const
+{
+    MutexLock lock(mutex_);
+    return misses_;
+}
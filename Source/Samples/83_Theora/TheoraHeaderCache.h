@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+
+#include <ogg/ogg.h>
+#include <theora/theoradec.h>
+#include <vorbis/codec.h>
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+//=============================================================================
+// a video's codec header packets and the setup parsed from them - the Theora
+// info, comments and Huffman/quantizer setup, the Vorbis info with its decode
+// codebooks. packets are added while the file is opened, after Parse() it is
+// read-only and any number of decoders can be allocated from it at once
+//=============================================================================
+class TheoraHeaders : public RefCounted
+{
+public:
+    TheoraHeaders();
+    virtual ~TheoraHeaders();
+
+    // true if the packet is a Theora identification header, its frame size and rate
+    // are needed before the rest of the headers are in
+    static bool ReadTheoraInfo(const ogg_packet *packet, th_info *info);
+
+    void AddTheoraPacket(const ogg_packet *packet);
+    void AddVorbisPacket(const ogg_packet *packet);
+    // INIT_OK or the packet error of the first stream that fails
+    int Parse();
+    bool IsParsed() const;
+
+    unsigned GetHash() const;
+    // same packets, byte for byte
+    bool Matches(const TheoraHeaders &rhs) const;
+
+    const th_info& GetTheoraInfo() const;
+    const th_comment& GetTheoraComment() const;
+    const th_setup_info* GetTheoraSetup() const;
+    // vorbis_synthesis_init() takes it non-const, decoders only read it
+    vorbis_info* GetVorbisInfo() const;
+
+private:
+    static void AddPacket(PODVector<unsigned char> &data, PODVector<unsigned> &sizes, unsigned &hash,
+                          const ogg_packet *packet);
+    static void GetPacket(const PODVector<unsigned char> &data, const PODVector<unsigned> &sizes, unsigned index,
+                          ogg_packet *packet);
+
+    PODVector<unsigned char>    theoraData_;
+    PODVector<unsigned>         theoraSizes_;
+    PODVector<unsigned char>    vorbisData_;
+    PODVector<unsigned>         vorbisSizes_;
+    // per stream, however their pages are interleaved
+    unsigned                    theoraHash_;
+    unsigned                    vorbisHash_;
+    bool                        parsed_;
+
+    th_info                     thInfo_;
+    th_comment                  thComment_;
+    th_setup_info               *thSetupInfo_;
+    mutable vorbis_info         vbInfo_;
+    vorbis_comment              vbComment_;
+};
+
+//=============================================================================
+// shares parsed headers between instances playing the same video, a clip on
+// dozens of screens is parsed once and its decode codebooks held once
+// - entries are found by a hash of the header packets and compared byte for
+//   byte, the same clip is shared whatever file or package it comes from
+// - an entry lives as long as an instance holds it
+// - thread-safe, entries are acquired and released under the cache lock, a
+//   miss is parsed under it so instances opening together wait for one parse
+//=============================================================================
+class TheoraHeaderCache : public Object
+{
+    URHO3D_OBJECT(TheoraHeaderCache, Object);
+
+public:
+    TheoraHeaderCache(Context *context);
+    virtual ~TheoraHeaderCache();
+
+    // replaces headers with the cached ones for the same packets, or parses and
+    // adds them. INIT_OK or the parse error, headers are left unparsed on error
+    int Acquire(SharedPtr<TheoraHeaders> &headers);
+    // drops the caller's reference, the entry goes with the last one
+    void Release(SharedPtr<TheoraHeaders> &headers);
+
+    unsigned GetNumEntries() const;
+    unsigned GetNumHits() const;
+    unsigned GetNumMisses() const;
+
+private:
+    mutable Mutex                       mutex_;
+    Vector<SharedPtr<TheoraHeaders> >   entries_;
+    unsigned                            hits_;
+    unsigned                            misses_;
+};
@@ -0,0 +1,295 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "TheoraKeyframeIndex.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// Skeleton 4.0 index packet: "index\0", serialno, keypoint count, time denominator,
+// first and last time numerators, then variable length keypoint deltas
+static const unsigned char SkeletonIndexId[6] = { 'i', 'n', 'd', 'e', 'x', 0 };
+static const int SkeletonIndexSerialNo = 6;
+static const int SkeletonIndexNumKeypoints = 10;
+static const int SkeletonIndexTimeDenominator = 18;
+static const int SkeletonIndexKeypoints = 42;
+
+// sidecar file, native byte order - a mismatch fails the version check and the index is rebuilt
+static const char SidecarId[4] = { 'T', 'K', 'F', 'I' };
+static const unsigned SidecarVersion = 1;
+// app preferences directory of the sidecars
+static const char *SidecarOrganization = "urho3d";
+static const char *SidecarApplication = "theora";
+
+struct TheoraKeyframeIndexHeader
+{
+    char     id_[4];
+    unsigned version_;
+    uint64_t sourceSize_;
+    unsigned sourceModified_;
+    unsigned numKeyframes_;
+};
+
+static_assert(sizeof(TheoraKeyframeIndexHeader) % sizeof(int64_t) == 0, "keyframes must stay 8 byte aligned");
+
+static int64_t ReadInt64LE(const unsigned char *data)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i)
+    {
+        value = (value << 8) | data[i];
+    }
+    return (int64_t)value;
+}
+
+static unsigned ReadUInt32LE(const unsigned char *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned)data[3] << 24);
+}
+
+// 7 bits per byte, least significant first, the last byte has the top bit set
+static const unsigned char* ReadVariableLength(const unsigned char *data, const unsigned char *end, int64_t &value)
+{
+    value = 0;
+    for (int shift = 0; data < end && shift < 63; shift += 7)
+    {
+        unsigned char byte = *data++;
+        value |= (int64_t)(byte & 0x7f) << shift;
+        if (byte & 0x80)
+        {
+            return data;
+        }
+    }
+    return 0;
+}
+
+//=============================================================================
+//=============================================================================
+TheoraKeyframeIndex::TheoraKeyframeIndex()
+    : mappedKeyframes_(0)
+    , mappedSize_(0)
+{
+}
+
+void TheoraKeyframeIndex::Clear()
+{
+    keyframes_.Clear();
+    mappedFile_.Close();
+    mappedKeyframes_ = 0;
+    mappedSize_ = 0;
+}
+
+void TheoraKeyframeIndex::Add(int64_t offset, int64_t frame)
+{
+    if (!keyframes_.Empty() && (frame <= keyframes_.Back().frame_ || offset < keyframes_.Back().offset_))
+    {
+        return;
+    }
+
+    TheoraKeyframe keyframe;
+    keyframe.offset_ = offset;
+    keyframe.frame_ = frame;
+    keyframes_.Push(keyframe);
+}
+
+bool TheoraKeyframeIndex::ReadSkeletonIndex(const ogg_packet *packet, int serialNo, unsigned fpsNumerator,
+                                            unsigned fpsDenominator)
+{
+    const unsigned char *data = packet->packet;
+    const unsigned char *end = data + packet->bytes;
+
+    if (packet->bytes < SkeletonIndexKeypoints || memcmp(data, SkeletonIndexId, sizeof(SkeletonIndexId)) != 0 ||
+        (int)ReadUInt32LE(data + SkeletonIndexSerialNo) != serialNo || !fpsNumerator || !fpsDenominator)
+    {
+        return false;
+    }
+
+    int64_t numKeypoints = ReadInt64LE(data + SkeletonIndexNumKeypoints);
+    int64_t timeDenominator = ReadInt64LE(data + SkeletonIndexTimeDenominator);
+    if (numKeypoints <= 0 || timeDenominator <= 0)
+    {
+        return false;
+    }
+
+    Clear();
+    // every keypoint takes at least two bytes
+    keyframes_.Reserve((unsigned)Min(numKeypoints, (int64_t)(packet->bytes / 2)));
+
+    // keypoint times are presentation times, i.e. frame starts
+    int64_t frameDenominator = timeDenominator * fpsDenominator;
+    int64_t offset = 0;
+    int64_t time = 0;
+    const unsigned char *keypoint = data + SkeletonIndexKeypoints;
+    for (int64_t i = 0; i < numKeypoints; ++i)
+    {
+        int64_t delta;
+        if (!(keypoint = ReadVariableLength(keypoint, end, delta)))
+        {
+            break;
+        }
+        offset += delta;
+
+        if (!(keypoint = ReadVariableLength(keypoint, end, delta)))
+        {
+            break;
+        }
+        time += delta;
+
+        Add(offset, (time * fpsNumerator + frameDenominator / 2) / frameDenominator);
+    }
+
+    return !keyframes_.Empty();
+}
+
+bool TheoraKeyframeIndex::Load(const String &fileName, unsigned sourceSize, unsigned sourceModified)
+{
+    Clear();
+
+    if (!mappedFile_.Open(fileName))
+    {
+        return false;
+    }
+
+    TheoraKeyframeIndexHeader header;
+    if (mappedFile_.GetSize() < sizeof(header))
+    {
+        mappedFile_.Close();
+        return false;
+    }
+    memcpy(&header, mappedFile_.GetData(), sizeof(header));
+
+    if (memcmp(header.id_, SidecarId, sizeof(SidecarId)) != 0 || header.version_ != SidecarVersion ||
+        header.sourceSize_ != sourceSize || header.sourceModified_ != sourceModified ||
+        mappedFile_.GetSize() != sizeof(header) + header.numKeyframes_ * sizeof(TheoraKeyframe))
+    {
+        mappedFile_.Close();
+        return false;
+    }
+
+    // what Add() would have kept, a damaged sidecar is rebuilt rather than seeked with
+    const TheoraKeyframe *keyframes = reinterpret_cast<const TheoraKeyframe*>(mappedFile_.GetData() + sizeof(header));
+    for (unsigned i = 0; i < header.numKeyframes_; ++i)
+    {
+        if (keyframes[i].offset_ < 0 || keyframes[i].offset_ >= (int64_t)sourceSize || keyframes[i].frame_ < 0 ||
+            (i && (keyframes[i].frame_ <= keyframes[i - 1].frame_ || keyframes[i].offset_ < keyframes[i - 1].offset_)))
+        {
+            mappedFile_.Close();
+            return false;
+        }
+    }
+
+    mappedKeyframes_ = keyframes;
+    mappedSize_ = header.numKeyframes_;
+    return true;
+}
+
+bool TheoraKeyframeIndex::Save(Context *context, const String &fileName, unsigned sourceSize, unsigned sourceModified) const
+{
+    FileSystem *fileSystem = context ? context->GetSubsystem<FileSystem>() : 0;
+    if (!fileSystem)
+    {
+        return false;
+    }
+
+    // another instance of the video may have written it since this one scanned
+    TheoraKeyframeIndex existing;
+    if (existing.Load(fileName, sourceSize, sourceModified))
+    {
+        return true;
+    }
+
+    TheoraKeyframeIndexHeader header;
+    memcpy(header.id_, SidecarId, sizeof(SidecarId));
+    header.version_ = SidecarVersion;
+    header.sourceSize_ = sourceSize;
+    header.sourceModified_ = sourceModified;
+    header.numKeyframes_ = GetSize();
+
+    // the sidecar may be mapped by another instance, truncating it in place would fault that
+    // reader. it is written beside the target under a name of this instance's and renamed over it
+    String tempName = fileName + ToString(".%p.tmp", this);
+    bool written = false;
+    {
+        File file(context, tempName, FILE_WRITE);
+        if (!file.IsOpen())
+        {
+            return false;
+        }
+
+        unsigned keyframeBytes = GetSize() * sizeof(TheoraKeyframe);
+        written = file.Write(&header, sizeof(header)) == sizeof(header) &&
+                  file.Write(GetKeyframes(), keyframeBytes) == keyframeBytes;
+    }
+
+    // rename replaces the target on POSIX. where it can't, the outdated target is deleted first,
+    // which fails while it is mapped and leaves it to be replaced by a later open
+    if (written && !fileSystem->Rename(tempName, fileName))
+    {
+        written = fileSystem->Delete(fileName) && fileSystem->Rename(tempName, fileName);
+    }
+    if (!written)
+    {
+        fileSystem->Delete(tempName);
+    }
+
+    return written;
+}
+
+String TheoraKeyframeIndex::GetSidecarName(Context *context, const String &videoFileName)
+{
+    FileSystem *fileSystem = context ? context->GetSubsystem<FileSystem>() : 0;
+    String directory = fileSystem ? fileSystem->GetAppPreferencesDir(SidecarOrganization, SidecarApplication) : String::EMPTY;
+    if (directory.Empty())
+    {
+        return String::EMPTY;
+    }
+
+    // the video directory may not be writable, and is not the place for a cache anyway
+    String name = videoFileName;
+    name.Replace('/', '_');
+    name.Replace('\\', '_');
+    name.Replace(':', '_');
+    return directory + name + ".idx";
+}
+
+const TheoraKeyframe* TheoraKeyframeIndex::Find(int64_t frame) const
+{
+    const TheoraKeyframe *keyframes = GetKeyframes();
+    unsigned size = GetSize();
+
+    if (!size || keyframes[0].frame_ > frame)
+    {
+        return 0;
+    }
+
+    // last entry with frame_ <= frame
+    unsigned low = 0;
+    unsigned high = size - 1;
+    while (low < high)
+    {
+        unsigned mid = (low + high + 1) / 2;
+        if (keyframes[mid].frame_ <= frame)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    return &keyframes[low];
+}
+
+const TheoraKeyframe* TheoraKeyframeIndex::GetKeyframes() const
+{
+    return mappedKeyframes_ ? mappedKeyframes_ : keyframes_.Buffer();
+}
+
+unsigned TheoraKeyframeIndex::GetSize() const
+{
+    return mappedKeyframes_ ? mappedSize_ : keyframes_.Size();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+
+#include <ogg/ogg.h>
+
+#include "TheoraMappedFile.h"
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+namespace Urho3D
+{
+class Context;
+}
+
+//=============================================================================
+// decoding from offset_ reaches keyframe frame_ before any later frame
+//=============================================================================
+struct TheoraKeyframe
+{
+    int64_t offset_;
+    int64_t frame_;
+};
+
+//=============================================================================
+// keyframe offsets of the Theora stream, sorted by frame. filled from an Ogg
+// Skeleton 4.0 index packet, a page scan, or a sidecar file in the app preferences
+// directory written after the scan, which later opens map instead of scanning again
+//=============================================================================
+class TheoraKeyframeIndex
+{
+public:
+    TheoraKeyframeIndex();
+
+    void Clear();
+    // keyframes are added in file order, out of order ones are ignored
+    void Add(int64_t offset, int64_t frame);
+
+    // returns true if the packet is a Skeleton index for the stream, keypoint
+    // times are converted to frames at the stream's frame rate
+    bool ReadSkeletonIndex(const ogg_packet *packet, int serialNo, unsigned fpsNumerator, unsigned fpsDenominator);
+
+    // the sidecar is only used when it was written for a source of the same size and modification time,
+    // and its keyframes are in order and inside the source
+    bool Load(const String &fileName, unsigned sourceSize, unsigned sourceModified);
+    // replaces the sidecar as a whole, never rewrites it in place. true without writing if a valid
+    // one is already there
+    bool Save(Context *context, const String &fileName, unsigned sourceSize, unsigned sourceModified) const;
+    // the video's path flattened into a file name in the app preferences directory, empty if
+    // there is none
+    static String GetSidecarName(Context *context, const String &videoFileName);
+
+    // the last keyframe at or before frame, null if there is none
+    const TheoraKeyframe* Find(int64_t frame) const;
+
+    const TheoraKeyframe* GetKeyframes() const;
+    unsigned GetSize() const;
+    bool IsEmpty() const { return GetSize() == 0; }
+    bool IsMapped() const { return mappedFile_.IsOpen(); }
+
+private:
+    PODVector<TheoraKeyframe> keyframes_;
+
+    // sidecar contents, used in place of keyframes_ while mapped
+    TheoraMappedFile          mappedFile_;
+    const TheoraKeyframe      *mappedKeyframes_;
+    unsigned                  mappedSize_;
+};
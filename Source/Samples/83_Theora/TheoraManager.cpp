@@ -0,0 +1,330 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/IO/Log.h>
+
+#include "TheoraManager.h"
+#include "TheoraWorkQueue.h"
+#include "Theora.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+class TheoraManagerWorker : public Thread, public RefCounted
+{
+public:
+    TheoraManagerWorker(TheoraManager *owner, unsigned index)
+        : owner_(owner)
+        , index_(index)
+        , sleeping_(false)
+    {
+    }
+
+    virtual void ThreadFunction()
+    {
+        owner_->ProcessSteps(index_);
+    }
+
+    TheoraManager                       *owner_;
+    unsigned                            index_;
+    // this worker's streams, other workers lock it to steal
+    Mutex                               mutex_;
+    PODVector<TheoraManagedStream*>     streams_;
+    TheoraSignal                        signal_;
+    std::atomic<bool>                   sleeping_;
+};
+
+//=============================================================================
+//=============================================================================
+TheoraManager::TheoraManager(Context *context)
+    : Object(context)
+    , shutDown_(false)
+    , steps_(0)
+    , steals_(0)
+{
+}
+
+TheoraManager::~TheoraManager()
+{
+    shutDown_ = true;
+
+    for (unsigned i = 0; i < workers_.Size(); ++i)
+    {
+        workers_[i]->signal_.Set();
+    }
+    for (unsigned i = 0; i < workers_.Size(); ++i)
+    {
+        workers_[i]->Stop();
+
+        // streams hold a reference to the manager, none can be left
+        if (!workers_[i]->streams_.Empty())
+        {
+            URHO3D_LOGERRORF("TheoraManager destroyed with %u streams", workers_[i]->streams_.Size());
+        }
+    }
+    workers_.Clear();
+}
+
+void TheoraManager::CreateThreads(unsigned numThreads)
+{
+    // streams are spread over the workers as they are added
+    if (!workers_.Empty())
+    {
+        return;
+    }
+
+    // the CPUs the conversion work queue does not already keep busy
+    if (!numThreads)
+    {
+        TheoraWorkQueue *workQueue = GetSubsystem<TheoraWorkQueue>();
+        unsigned numBusy = workQueue ? workQueue->GetNumThreads() : 0;
+        numThreads = GetNumLogicalCPUs() > numBusy ? GetNumLogicalCPUs() - numBusy : 1;
+    }
+
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        workers_.Push(SharedPtr<TheoraManagerWorker>(new TheoraManagerWorker(this, i)));
+    }
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        workers_[i]->Run();
+    }
+}
+
+unsigned TheoraManager::GetNumThreads() const
+{
+    return workers_.Size();
+}
+
+void TheoraManager::AddStream(Theora *theora)
+{
+    if (workers_.Empty())
+    {
+        return;
+    }
+
+    // the shortest queue
+    TheoraManagerWorker *worker = workers_[0];
+    unsigned numStreams = M_MAX_UNSIGNED;
+    for (unsigned i = 0; i < workers_.Size(); ++i)
+    {
+        MutexLock lock(workers_[i]->mutex_);
+        if (workers_[i]->streams_.Size() < numStreams)
+        {
+            worker = workers_[i];
+            numStreams = worker->streams_.Size();
+        }
+    }
+
+    {
+        MutexLock lock(worker->mutex_);
+        worker->streams_.Push(new TheoraManagedStream(theora));
+    }
+
+    // the worker it went to may be busy, any sleeping one can take it
+    Wake();
+}
+
+void TheoraManager::RemoveStream(Theora *theora)
+{
+    TheoraManagedStream *stream = 0;
+
+    for (unsigned i = 0; i < workers_.Size() && !stream; ++i)
+    {
+        TheoraManagerWorker *worker = workers_[i];
+        MutexLock lock(worker->mutex_);
+
+        for (unsigned j = 0; j < worker->streams_.Size(); ++j)
+        {
+            if (worker->streams_[j]->theora_ == theora)
+            {
+                stream = worker->streams_[j];
+                worker->streams_.Erase(j);
+                break;
+            }
+        }
+    }
+
+    if (!stream)
+    {
+        return;
+    }
+
+    // out of the queue, no new step can start - wait for one in progress
+    {
+        std::unique_lock<std::mutex> lock(stepMutex_);
+        while (stream->running_)
+        {
+            stepDone_.wait(lock);
+        }
+    }
+
+    delete stream;
+}
+
+unsigned TheoraManager::GetNumStreams() const
+{
+    unsigned numStreams = 0;
+
+    for (unsigned i = 0; i < workers_.Size(); ++i)
+    {
+        MutexLock lock(workers_[i]->mutex_);
+        numStreams += workers_[i]->streams_.Size();
+    }
+
+    return numStreams;
+}
+
+void TheoraManager::Wake()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // one is enough, it keeps stepping until nothing is ready
+    for (unsigned i = 0; i < workers_.Size(); ++i)
+    {
+        if (workers_[i]->sleeping_.exchange(false))
+        {
+            workers_[i]->signal_.Set();
+            break;
+        }
+    }
+}
+
+bool TheoraManager::IsAnyWorkerSleeping() const
+{
+    for (unsigned i = 0; i < workers_.Size(); ++i)
+    {
+        if (workers_[i]->sleeping_)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool TheoraManager::IsAnyStreamReady() const
+{
+    for (unsigned i = 0; i < workers_.Size(); ++i)
+    {
+        TheoraManagerWorker *worker = workers_[i];
+        MutexLock lock(worker->mutex_);
+
+        for (unsigned j = 0; j < worker->streams_.Size(); ++j)
+        {
+            TheoraManagedStream *stream = worker->streams_[j];
+            if (!stream->running_ && stream->theora_->IsStepReady())
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+unsigned long long TheoraManager::GetNumSteps() const
+{
+    return steps_;
+}
+
+unsigned long long TheoraManager::GetNumSteals() const
+{
+    return steals_;
+}
+
+void TheoraManager::ProcessSteps(unsigned index)
+{
+    TheoraManagerWorker *worker = workers_[index];
+
+    while (!shutDown_)
+    {
+        if (RunStep(index))
+        {
+            continue;
+        }
+
+        worker->sleeping_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // a stream may have become ready before the flag was seen
+        if (RunStep(index))
+        {
+            worker->sleeping_ = false;
+            continue;
+        }
+
+        worker->signal_.Wait();
+    }
+}
+
+bool TheoraManager::RunStep(unsigned index)
+{
+    TheoraManagedStream *stream = 0;
+
+    // own queue first, then the others starting from the next worker
+    for (unsigned i = 0; i < workers_.Size() && !stream; ++i)
+    {
+        stream = PickStream(workers_[(index + i) % workers_.Size()]);
+        if (stream && i)
+        {
+            ++steals_;
+        }
+    }
+
+    if (!stream)
+    {
+        return false;
+    }
+
+    // a worker sleeping since the last wake would leave other ready streams
+    // waiting behind this step
+    if (IsAnyWorkerSleeping() && IsAnyStreamReady())
+    {
+        Wake();
+    }
+
+    stream->theora_->DecodeStep();
+    ++steps_;
+
+    // the stream may be deleted as soon as the lock is released
+    {
+        std::lock_guard<std::mutex> lock(stepMutex_);
+        stream->running_ = false;
+    }
+    stepDone_.notify_all();
+
+    return true;
+}
+
+TheoraManagedStream* TheoraManager::PickStream(TheoraManagerWorker *worker)
+{
+    MutexLock lock(worker->mutex_);
+
+    // earliest deadline first
+    TheoraManagedStream *best = 0;
+    int64_t bestSlack = 0;
+
+    for (unsigned i = 0; i < worker->streams_.Size(); ++i)
+    {
+        TheoraManagedStream *stream = worker->streams_[i];
+        if (stream->running_ || !stream->theora_->IsStepReady())
+        {
+            continue;
+        }
+
+        int64_t slack = stream->theora_->GetStepSlack();
+        if (!best || slack < bestSlack)
+        {
+            best = stream;
+            bestSlack = slack;
+        }
+    }
+
+    // only ever set under the queue lock
+    if (best)
+    {
+        best->running_ = true;
+    }
+
+    return best;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Container/Vector.h>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "TheoraSignal.h"
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+class Theora;
+class TheoraManagerWorker;
+
+//=============================================================================
+// a stream in a worker's queue, running_ while a worker has its decode step
+//=============================================================================
+struct TheoraManagedStream
+{
+    TheoraManagedStream(Theora *theora) : theora_(theora), running_(false)
+    {
+    }
+
+    Theora              *theora_;
+    // set under the queue lock, cleared under stepMutex_
+    std::atomic<bool>   running_;
+};
+
+//=============================================================================
+// decodes any number of videos on a fixed pool of threads instead of a thread
+// per video
+// - every worker has a queue of streams, it runs the decode step of the most
+//   urgent ready one - the least decoded ahead of its clock - and steals from
+//   the other queues when none of its own are ready
+// - a step decodes at most a frame and an audio chunk and never blocks, streams
+//   are ready while behind their advance window with room in their queues
+// - workers sleep until a clock moves, queue space frees up or a stream is added
+//=============================================================================
+class TheoraManager : public Object
+{
+    URHO3D_OBJECT(TheoraManager, Object);
+
+    friend class TheoraManagerWorker;
+
+public:
+    TheoraManager(Context *context);
+    virtual ~TheoraManager();
+
+    // 0 - one per logical CPU not taken by a registered TheoraWorkQueue, at least one
+    void CreateThreads(unsigned numThreads);
+    unsigned GetNumThreads() const;
+
+    // thread-safe. RemoveStream() returns once no worker is in the stream's step
+    void AddStream(Theora *theora);
+    void RemoveStream(Theora *theora);
+    unsigned GetNumStreams() const;
+    // a stream may have become ready, wakes a sleeping worker
+    void Wake();
+
+    // decode steps run, and the ones taken from another worker's queue
+    unsigned long long GetNumSteps() const;
+    unsigned long long GetNumSteals() const;
+
+private:
+    void ProcessSteps(unsigned index);
+    bool RunStep(unsigned index);
+    TheoraManagedStream* PickStream(TheoraManagerWorker *worker);
+    bool IsAnyWorkerSleeping() const;
+    bool IsAnyStreamReady() const;
+
+    Vector<SharedPtr<TheoraManagerWorker> > workers_;
+    // RemoveStream() waits on stepDone_ for a step in progress
+    std::mutex                              stepMutex_;
+    std::condition_variable                 stepDone_;
+    std::atomic<bool>                       shutDown_;
+    std::atomic<unsigned long long>         steps_;
+    std::atomic<unsigned long long>         steals_;
+};
@@ -0,0 +1,138 @@
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "TheoraMappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+TheoraMappedFile::TheoraMappedFile()
+    : data_(0)
+    , size_(0)
+#ifdef _WIN32
+    , fileHandle_(INVALID_HANDLE_VALUE)
+    , mappingHandle_(0)
+#endif
+{
+}
+
+TheoraMappedFile::~TheoraMappedFile()
+{
+    Close();
+}
+
+bool TheoraMappedFile::Open(const String &fileName)
+{
+    Close();
+
+#ifdef _WIN32
+    fileHandle_ = CreateFileW(WString(GetNativePath(fileName)).CString(), GENERIC_READ, FILE_SHARE_READ, 0,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (fileHandle_ == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    // empty files cannot be mapped, larger than 4 GB ones are not addressed by unsigned offsets
+    if (!GetFileSizeEx(fileHandle_, &fileSize) || fileSize.QuadPart == 0 || fileSize.HighPart != 0)
+    {
+        Close();
+        return false;
+    }
+
+    mappingHandle_ = CreateFileMappingW(fileHandle_, 0, PAGE_READONLY, 0, 0, 0);
+    if (!mappingHandle_)
+    {
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_)
+    {
+        Close();
+        return false;
+    }
+    size_ = fileSize.LowPart;
+#else
+    int fd = open(GetNativePath(fileName).CString(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (unsigned long long)st.st_size > 0xffffffffULL)
+    {
+        close(fd);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void *data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    data_ = static_cast<const unsigned char*>(data);
+    size_ = (unsigned)st.st_size;
+#endif
+
+    return true;
+}
+
+void TheoraMappedFile::Close()
+{
+#ifdef _WIN32
+    if (data_)
+    {
+        UnmapViewOfFile(data_);
+    }
+    if (mappingHandle_)
+    {
+        CloseHandle(mappingHandle_);
+        mappingHandle_ = 0;
+    }
+    if (fileHandle_ != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle_);
+        fileHandle_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (data_)
+    {
+        munmap(const_cast<unsigned char*>(data_), size_);
+    }
+#endif
+
+    data_ = 0;
+    size_ = 0;
+}
+
+void TheoraMappedFile::Prefetch(unsigned offset, unsigned size) const
+{
+    if (!data_ || offset >= size_)
+    {
+        return;
+    }
+
+#ifndef _WIN32
+    // the start has to be page aligned
+    unsigned pageSize = (unsigned)sysconf(_SC_PAGESIZE);
+    unsigned begin = offset - offset % pageSize;
+    unsigned end = Min(offset + size, size_);
+    madvise(const_cast<unsigned char*>(data_) + begin, end - begin, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+//=============================================================================
+// read-only memory mapping of a whole disk file, pages are faulted in by the
+// os on first access instead of being copied through a read buffer
+//=============================================================================
+class TheoraMappedFile
+{
+public:
+    TheoraMappedFile();
+    ~TheoraMappedFile();
+
+    bool Open(const String &fileName);
+    void Close();
+
+    bool IsOpen() const { return data_ != 0; }
+    const unsigned char* GetData() const { return data_; }
+    unsigned GetSize() const { return size_; }
+    // hints the os to start reading the range in
+    void Prefetch(unsigned offset, unsigned size) const;
+
+private:
+    // non-copyable
+    TheoraMappedFile(const TheoraMappedFile&);
+    TheoraMappedFile& operator=(const TheoraMappedFile&);
+
+    const unsigned char *data_;
+    unsigned            size_;
+#ifdef _WIN32
+    void                *fileHandle_;
+    void                *mappingHandle_;
+#endif
+};
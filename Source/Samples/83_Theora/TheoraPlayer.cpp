@@ -21,6 +21,7 @@
 //
 
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/Engine/Engine.h>
 #include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Graphics/Graphics.h>
@@ -42,7 +43,15 @@
 
 #include "TheoraPlayer.h"
 #include "Theora.h"
+#include "TheoraEvents.h"
 #include "TheoraAudio.h"
+#include "TheoraBenchmark.h"
+#include "TheoraWorkQueue.h"
+#include "TheoraManager.h"
+#include "TheoraHeaderCache.h"
+#include "TheoraPresenter.h"
+#include "TheoraVideo.h"
+#include "TheoraVideoComponent.h"
 #include <cstdio>
 
 #include <Urho3D/DebugNew.h>
@@ -53,15 +62,28 @@ URHO3D_DEFINE_APPLICATION_MAIN(TheoraPlayer)
 //=============================================================================
 //=============================================================================
 static const unsigned InputDelay = 250;
+// split color conversion across cores from this frame height on
+static const unsigned ParallelConversionHeight = 1080;
+static const unsigned StatsRefreshInterval = 500;
+static const int64_t SeekStepMSec = 10000;
+// keyframes only below this on-screen height in pixels, reduced below half the video height
+static const float KeyframeLodScreenHeight = 48.0f;
+// a lower decode LOD is taken once wanted for this long, a higher one straight away
+static const unsigned LodDowngradeMSec = 500;
+// the component screen, to the side of the TV and smaller
+static const Vector3 ComponentScreenOffset(4.0f, 0.0f, 0.0f);
+static const float ComponentScreenScale = 0.5f;
+static const char* DecodeLodNames[MAX_DECODE_LODS] = { "full", "reduced", "keyframes", "audio", "paused" };
 
 //=============================================================================
 //=============================================================================
 TheoraPlayer::TheoraPlayer(Context* context)
     : Sample(context)
-    , elapsedTime_(0.0f)
+    , rescaleNode_(true)
     , stopped_(false)
     , paused_(false)
-    , rescaleNode_(true)
+    , opening_(false)
+    , looping_(true)
 {
 }
 
@@ -72,11 +94,15 @@ void TheoraPlayer::Setup()
     engineParameters_[EP_WINDOW_HEIGHT] = 720;
     engineParameters_[EP_FULL_SCREEN]   = false;
     engineParameters_[EP_SOUND]         = true;
-    engineParameters_[EP_SOUND_BUFFER]  = 20;
+    engineParameters_[EP_SOUND_BUFFER]  = TheoraAudio::SoundBufferMSec;
     engineParameters_[EP_RESOURCE_PATHS]= "Data;CoreData;Data/Theora";
     engineParameters_[EP_LOG_NAME]      = GetSubsystem<FileSystem>()->GetProgramDir() + "theora.log";
     engineParameters_[EP_VSYNC] = true;
     engineParameters_[EP_REFRESH_RATE] = 60;
+
+    // select file to play, a resource name found through the ResourceCache
+    videoFilename_ = "Video/sira-numb.ogv";
+    //videoFilename_ = "Video/bbb_theora_486kbit.ogv";
 }
 
 void TheoraPlayer::Start()
@@ -84,6 +110,31 @@ void TheoraPlayer::Start()
     // Execute base class startup
     Sample::Start();
 
+    // worker pool shared by all videos for frame conversion, decoding takes up the remaining core
+    TheoraWorkQueue *workQueue = new TheoraWorkQueue(context_);
+    context_->RegisterSubsystem(workQueue);
+    workQueue->CreateThreads(Max((int)GetNumLogicalCPUs() - 1, 1));
+
+    // decode steps of all videos on the cores the work queue leaves, workers sleep while every
+    // video is ahead of its clock
+    TheoraManager *manager = new TheoraManager(context_);
+    context_->RegisterSubsystem(manager);
+    manager->CreateThreads(0);
+
+    // videos opened more than once parse their headers and hold their codebooks once
+    context_->RegisterSubsystem(new TheoraHeaderCache(context_));
+
+    // videos as resources, preloaded with a scene and played on its materials
+    TheoraVideo::RegisterObject(context_);
+    TheoraVideoComponent::RegisterObject(context_);
+
+    // the test run asserts on the benchmarks that have a pass condition, a failure exits with an error code
+    if (GetArguments().Contains("-checks") && !TheoraBenchmark::RunChecks(context_, videoFilename_))
+    {
+        ErrorExit("Theora checks failed, see the log");
+        return;
+    }
+
     // Create the scene content
     CreateScene();
 
@@ -117,38 +168,116 @@ void TheoraPlayer::CreateScene()
 
     // create TVComponent
     tvNode_ = scene_->GetChild("TV", true);
+    CreateComponentScreen();
 
     // init theora
     InitializeTheora();
 }
 
+void TheoraPlayer::CreateComponentScreen()
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    StaticModel *tvModel = tvNode_ ? tvNode_->GetComponent<StaticModel>() : 0;
+    if (!tvModel || !tvModel->GetMaterial(0))
+    {
+        return;
+    }
+
+    // the cache loads the resource from its File, which opens an instance up to its first frame
+    TheoraVideo *video = cache->GetResource<TheoraVideo>(videoFilename_);
+    if (!video)
+    {
+        return;
+    }
+
+    Node *screenNode = scene_->CreateChild("VideoScreen");
+    screenNode->SetPosition(tvNode_->GetPosition() + ComponentScreenOffset);
+    screenNode->SetRotation(tvNode_->GetRotation());
+    screenNode->SetScale(tvNode_->GetScale() * ComponentScreenScale);
+
+    // a material of its own, the TV's presenter writes the TV's texture
+    StaticModel *screenModel = screenNode->CreateComponent<StaticModel>();
+    screenModel->SetModel(tvModel->GetModel());
+    screenModel->SetMaterial(tvModel->GetMaterial(0)->Clone());
+
+    // playing along with the TV would double the sound, hidden it only starts on the
+    // prepared instance once shown, and stops again when hidden
+    screenNode->SetEnabled(false);
+
+    TheoraVideoComponent *videoComponent = screenNode->CreateComponent<TheoraVideoComponent>();
+    videoComponent->SetVideo(video);
+    videoComponent->SetLooping(true);
+    videoComponent->Play();
+    screenNode_ = screenNode;
+}
+
+void TheoraPlayer::ToggleComponentScreen()
+{
+    if (screenNode_)
+    {
+        screenNode_->SetEnabled(!screenNode_->IsEnabled());
+    }
+}
+
 void TheoraPlayer::InitializeTheora()
 {
     if (tvNode_)
     {
-        // select file to play
-        String filename = GetSubsystem<FileSystem>()->GetProgramDir()+ "Data/Theora/Video/sira-numb.ogv";
-        //String filename = GetSubsystem<FileSystem>()->GetProgramDir()+ "Data/Theora/Video/bbb_theora_486kbit.ogv";
-
+        // file I/O, header parsing and the first frames happen off the main thread,
+        // the rest of the setup waits for HandleTheoraFirstFrame()
         theora_ = new Theora();
-        int result = theora_->Initialize(context_, filename);
+        opening_ = theora_->InitializeAsync(context_, videoFilename_);
 
-        if (result == INIT_OK)
+        if (!opening_)
         {
-            // get video/audio info
-            theoraAVInfo_ = theora_->GetTheoraAVInfo();
+            URHO3D_LOGERRORF("Theora init error: %d", theora_->GetOpenResult());
+            theora_.Reset();
+        }
+    }
+}
 
-            // init
-            InitAudio();
-            SetOutputModel(tvNode_->GetComponent<StaticModel>());
+void TheoraPlayer::HandleTheoraFirstFrame(StringHash eventType, VariantMap& eventData)
+{
+    using namespace TheoraFirstFrame;
 
-            // start theora process
-            theora_->StartProcess();
-        }
-        else
-        {
-            URHO3D_LOGERRORF("Theora init error: %d", result);
-        }
+    // stopped and reopened since, or another player's video
+    if (!theora_ || eventData[P_THEORA].GetPtr() != theora_.Get())
+    {
+        return;
+    }
+
+    opening_ = false;
+
+    int result = eventData[P_RESULT].GetInt();
+    if (result != INIT_OK)
+    {
+        URHO3D_LOGERRORF("Theora init error: %d", result);
+        theora_.Reset();
+        return;
+    }
+
+    URHO3D_LOGINFOF("Theora: '%s' opened, first frame in %.1f ms", videoFilename_.CString(), eventData[P_LATENCY].GetFloat());
+
+    // get video/audio info
+    theoraAVInfo_ = theora_->GetTheoraAVInfo();
+
+    if (theoraAVInfo_.videoFrameHeight_ >= ParallelConversionHeight)
+    {
+        theora_->SetConversionBands(GetSubsystem<TheoraWorkQueue>()->GetNumThreads() + 1);
+    }
+
+    theora_->SetLooping(looping_);
+
+    // init
+    InitAudio();
+    SetOutputModel(tvNode_->GetComponent<StaticModel>());
+
+    // start theora process, paused while opening keeps the clock stopped
+    theora_->StartProcess();
+    clock_.Reset(0);
+    if (!paused_)
+    {
+        clock_.Start();
     }
 }
 
@@ -177,11 +306,16 @@ void TheoraPlayer::Pause()
 
     if (paused_)
     {
+        clock_.Stop();
         if (theoraAudio_)
         {
             theoraAudio_->Stop();
         }
     }
+    else
+    {
+        clock_.Start();
+    }
 }
 
 void TheoraPlayer::Stop()
@@ -190,98 +324,168 @@ void TheoraPlayer::Stop()
     {
         if (theora_)
         {
+            // an open still running is stopped and waited for
             theora_.Reset();
         }
+        opening_ = false;
         if (theoraAudio_)
         {
             theoraAudio_->Stop();
             theoraAudio_->Clear();
         }
+        if (presenter_)
+        {
+            presenter_->Clear();
+        }
 
-        elapsedTime_ = 0.0f;
-        videoBufferContainer_.Clear();
-        audioBufferContainer_.Clear();
+        clock_.Reset(0);
         stopped_ = true;
     }
 }
 
-void TheoraPlayer::AddElapsedTime(float timeStep)
+void TheoraPlayer::SeekBy(int64_t deltaMSec)
 {
-    if (!stopped_ && !paused_)
+    if (stopped_ || opening_ || !theora_)
     {
-        elapsedTime_ += timeStep;
-        elapsedTime64_ = static_cast<int64_t>(1000.0f * elapsedTime_);
+        return;
+    }
 
-        if (theora_)
-        {
-            theora_->SetElapsedTime(elapsedTime_);
+    // looping, the clock runs on past the end and Seek() finds the pass
+    int64_t timeMSec = Max(clock_.GetTime() + deltaMSec, (int64_t)0);
+    if (theoraAVInfo_.durationMSec_ && !looping_)
+    {
+        timeMSec = Min(timeMSec, (int64_t)theoraAVInfo_.durationMSec_);
+    }
 
-            ProcessAudioVideo();
+    // audio already handed to the sound stream belongs to the old position
+    if (theoraAudio_)
+    {
+        theoraAudio_->Stop();
+        theoraAudio_->Clear();
+    }
+
+    if (theora_->Seek(timeMSec))
+    {
+        clock_.SetTime(timeMSec);
+
+        if (presenter_)
+        {
+            presenter_->Clear();
         }
     }
 }
 
-void TheoraPlayer::ProcessAudioVideo()
+void TheoraPlayer::ToggleLooping()
 {
-    if (!theora_)
-    {
-        return;
-    }
+    looping_ = !looping_;
 
-    // get audio/video buffers
-    SharedPtr<VideoData> vptr = theora_->GetVideoQueueData();
-    while (vptr != NULL)
+    if (theora_)
     {
-        videoBufferContainer_.Push(vptr);
-        vptr = theora_->GetVideoQueueData();
+        theora_->SetLooping(looping_);
     }
-    SharedPtr<AudioData> aptr = theora_->GetAudioQueueData();
-    while (aptr != NULL)
+}
+
+void TheoraPlayer::UpdatePlayback()
+{
+    if (!stopped_ && !paused_ && !opening_ && theora_)
     {
-        audioBufferContainer_.Push(aptr);
-        aptr = theora_->GetAudioQueueData();
+        // wall time, slaved to the samples the sound source has taken
+        theora_->SetElapsedTime(clock_.Update(theoraAudio_));
+
+        UpdateDecodeLod();
+        ProcessAudioVideo();
     }
+}
+
+void TheoraPlayer::UpdateDecodeLod()
+{
+    TheoraDecodeLod lod = GetSurfaceLod();
+    TheoraDecodeLod current = theora_->GetDecodeLod();
 
-    // write video
-    while (videoBufferContainer_.Size() > 0)
+    // a model swinging in and out of view or across a threshold would flip it every frame
+    if (lod <= current)
     {
-        if (videoBufferContainer_[0]->time_ <= elapsedTime64_)
-        {
-            rgbaTexture_->SetSize(theoraAVInfo_.videoFrameWidth_, theoraAVInfo_.videoFrameHeight_, 
-                                  Graphics::GetRGBAFormat(), TEXTURE_DYNAMIC);
-            rgbaTexture_->SetData(0, 0, 0, theoraAVInfo_.videoFrameWidth_, theoraAVInfo_.videoFrameHeight_, 
-                                  (const void*)videoBufferContainer_[0]->buf_);
-            videoBufferContainer_.Erase(0);
-        }
-        else
+        lodTimer_.Reset();
+
+        if (lod < current)
         {
-            break;
+            theora_->SetDecodeLod(lod);
         }
     }
+    else if (lodTimer_.GetMSec(false) >= LodDowngradeMSec)
+    {
+        theora_->SetDecodeLod(lod);
+        lodTimer_.Reset();
+    }
+}
 
-    // write audio
-    bool gotAudioBuff = false;
-    while (audioBufferContainer_.Size() > 0)
+TheoraDecodeLod TheoraPlayer::GetSurfaceLod() const
+{
+    Camera *camera = cameraNode_ ? cameraNode_->GetComponent<Camera>() : 0;
+    Graphics *graphics = GetSubsystem<Graphics>();
+    if (!outputModel_ || !camera || !graphics)
     {
-        if (audioBufferContainer_[0]->time_ <= elapsedTime64_)
-        {
-            theoraAudio_->AddData(audioBufferContainer_[0]->buf_, audioBufferContainer_[0]->size_);
-            audioBufferContainer_.Erase(0);
-            gotAudioBuff = true;
-        }
-        else
-        {
-            break;
-        }
+        return DECODE_LOD_FULL;
+    }
+
+    // as of the last rendered frame
+    if (!outputModel_->IsInView(camera))
+    {
+        return theoraAVInfo_.audioFrequencey_ ? DECODE_LOD_AUDIO : DECODE_LOD_PAUSED;
     }
 
-    if (gotAudioBuff)
+    // projected height of the world bounding box
+    const BoundingBox &box = outputModel_->GetWorldBoundingBox();
+    const Matrix3x4 &view = camera->GetView();
+    float top = M_INFINITY;
+    float bottom = -M_INFINITY;
+
+    for (unsigned i = 0; i < 8; ++i)
     {
-        if (!theoraAudio_->IsPlaying())
+        Vector3 corner(i & 1 ? box.max_.x_ : box.min_.x_, i & 2 ? box.max_.y_ : box.min_.y_, i & 4 ? box.max_.z_ : box.min_.z_);
+
+        // reaches behind the near plane, as large as it gets
+        if ((view * corner).z_ < camera->GetNearClip())
         {
-            theoraAudio_->Play();
+            return DECODE_LOD_FULL;
         }
+
+        Vector2 screen = camera->WorldToScreenPoint(corner);
+        top = Min(top, screen.y_);
+        bottom = Max(bottom, screen.y_);
     }
+
+    float screenHeight = (bottom - top) * graphics->GetHeight();
+
+    if (screenHeight < KeyframeLodScreenHeight)
+    {
+        return DECODE_LOD_KEYFRAMES;
+    }
+    // half resolution is all that shows
+    if (screenHeight <= theoraAVInfo_.videoFrameHeight_ * 0.5f)
+    {
+        return DECODE_LOD_REDUCED;
+    }
+    return DECODE_LOD_FULL;
+}
+
+void TheoraPlayer::ProcessAudioVideo()
+{
+    if (!theora_)
+    {
+        return;
+    }
+
+    int64_t timeMSec = clock_.GetTime();
+
+    // write video - only the newest due frame is uploaded
+    if (presenter_)
+    {
+        presenter_->Update(theora_, timeMSec);
+    }
+
+    // write audio
+    theoraAudio_->Update(theora_, timeMSec);
 }
 
 bool TheoraPlayer::SetOutputModel(StaticModel* model)
@@ -331,18 +535,13 @@ bool TheoraPlayer::InitTexture()
 {
     bool success = false;
 
-    // RGBA texture
+    // RGBA texture, kept for every video played after
     if (outputMaterial_)
     {
-        if (!framePlanarDataRGBA_)
+        if (!presenter_)
         {
-            framePlanarDataRGBA_ = new unsigned char[theoraAVInfo_.videoFrameWidth_ * theoraAVInfo_.videoFrameHeight_ * RGBAComponentSize];
-            rgbaTexture_ = SharedPtr<Texture2D>(new Texture2D(context_));
-            rgbaTexture_->SetSize(theoraAVInfo_.videoFrameWidth_, theoraAVInfo_.videoFrameHeight_, Graphics::GetRGBAFormat(), TEXTURE_DYNAMIC);
-            rgbaTexture_->SetFilterMode(FILTER_BILINEAR);
-            rgbaTexture_->SetNumLevels(1);
-
-            outputMaterial_->SetTexture(TextureUnit::TU_DIFFUSE, rgbaTexture_);
+            presenter_ = new TheoraPresenter(context_);
+            presenter_->Init(outputMaterial_, theoraAVInfo_.videoFrameWidth_, theoraAVInfo_.videoFrameHeight_);
         }
         success = true;
     }
@@ -357,18 +556,85 @@ void TheoraPlayer::CreateInstructions()
 
     // Construct new Text object, set string to display and font to use
     Text* instructionText = ui->GetRoot()->CreateChild<Text>();
-    instructionText->SetText("WASD - move\nVid: J - play, K - toggle pause, L - stop");
+    instructionText->SetText("WASD - move\nVid: J - play, K - toggle pause, L - stop, O - toggle loop\nLeft/Right - seek 10 s\nV - toggle the TheoraVideoComponent screen\nB - run benchmark (results in log)");
     instructionText->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 12);
 
     // Position the text relative to the screen center
     instructionText->SetHorizontalAlignment(HA_CENTER);
     instructionText->SetPosition(0, 10);
+
+    statsText_ = ui->GetRoot()->CreateChild<Text>();
+    statsText_->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 12);
+    statsText_->SetPosition(10, 10);
+}
+
+void TheoraPlayer::UpdateStatsText()
+{
+    if (!statsText_ || statsTimer_.GetMSec(false) < StatsRefreshInterval)
+    {
+        return;
+    }
+    statsTimer_.Reset();
+
+    if (!theora_)
+    {
+        statsText_->SetText("");
+        return;
+    }
+
+    if (opening_)
+    {
+        statsText_->SetText("opening " + videoFilename_);
+        return;
+    }
+
+    TheoraStats stats = theora_->GetStats();
+    String text;
+    text.AppendWithFormat("frames: %d (dropped %u, skipped %u, catch-ups %u)\ndecode: %.2f / %.2f ms\npp level: %d / %d (down %u, up %u)",
+                          stats.frames_, stats.framesDropped_, stats.framesSkipped_, stats.catchUps_,
+                          stats.decodeMSec_, stats.frameIntervalMSec_,
+                          stats.postProcessLevel_, stats.postProcessLevelMax_,
+                          stats.postProcessStepsDown_, stats.postProcessStepsUp_);
+    text.AppendWithFormat("\ninput: %u KB ahead, stalls io %.1f / demux %.1f / decode %.1f ms (%u)",
+                          stats.prefetchedBytes_ / 1024, stats.ioStallMSec_, stats.demuxStallMSec_,
+                          stats.decodeStallMSec_, stats.decodeStalls_);
+    text.AppendWithFormat("\naudio: %u underruns, decoder stalls %.1f ms (%u)",
+                          theoraAudio_ ? theoraAudio_->GetNumUnderruns() : 0, stats.audioStallMSec_, stats.audioStalls_);
+    text.AppendWithFormat("\nclock: %s master, drift %d ms, resyncs %u",
+                          clock_.IsAudioMaster() ? "audio" : "wall", (int)clock_.GetDriftMSec(), clock_.GetNumResyncs());
+    text.AppendWithFormat("\nlod: %s, %u frames reduced", DecodeLodNames[theora_->GetDecodeLod()], stats.framesReduced_);
+    if (presenter_)
+    {
+        text.AppendWithFormat("\ntexture: %u uploads, %u skipped, %u allocations",
+                              presenter_->GetNumUploads(), presenter_->GetNumSkipped(), presenter_->GetNumAllocations());
+    }
+    text.AppendWithFormat("\nopen: %.1f ms to the first frame (headers %.2f ms%s)",
+                          stats.openMSec_, stats.headerMSec_, stats.sharedHeaders_ ? ", shared" : "");
+    if (stats.loops_)
+    {
+        text.AppendWithFormat("\nloops: %u (last %.3f ms)", stats.loops_, stats.lastLoopMSec_);
+    }
+    if (stats.seeks_)
+    {
+        text.AppendWithFormat("\nseeks: %u (last %.2f ms, %u reads)", stats.seeks_, stats.lastSeekMSec_, stats.lastSeekReads_);
+    }
+
+    // latest level changes
+    for (unsigned i = stats.postProcessHistorySize_ > 4 ? stats.postProcessHistorySize_ - 4 : 0; i < stats.postProcessHistorySize_; ++i)
+    {
+        const TheoraPostProcessChange &change = stats.postProcessHistory_[i];
+        text.AppendWithFormat("\n  frame %d -> %d (%.2f ms, lead %.0f ms)",
+                              change.frame_, change.level_, change.decodeMSec_, change.leadMSec_);
+    }
+
+    statsText_->SetText(text);
 }
 
 void TheoraPlayer::SubscribeToEvents()
 {
     // Subscribe HandleUpdate() function for processing update events
     SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(TheoraPlayer, HandleUpdate));
+    SubscribeToEvent(E_THEORAFIRSTFRAME, URHO3D_HANDLER(TheoraPlayer, HandleTheoraFirstFrame));
 }
 
 void TheoraPlayer::HandleUpdate(StringHash eventType, VariantMap& eventData)
@@ -378,7 +644,8 @@ void TheoraPlayer::HandleUpdate(StringHash eventType, VariantMap& eventData)
     // Take the frame time step, which is stored as a float
     float timeStep = eventData[P_TIMESTEP].GetFloat();
 
-    AddElapsedTime(timeStep);
+    UpdatePlayback();
+    UpdateStatsText();
 
     // Move the camera, scale movement with time step
     MoveCamera(timeStep);
@@ -442,5 +709,37 @@ void TheoraPlayer::MoveCamera(float timeStep)
             inputTimer_.Reset();
         }
     }
+    if (input->GetKeyDown(KEY_O))
+    {
+        if (inputTimer_.GetMSec(false) > InputDelay)
+        {
+            ToggleLooping();
+            inputTimer_.Reset();
+        }
+    }
+    if (input->GetKeyDown(KEY_LEFT) || input->GetKeyDown(KEY_RIGHT))
+    {
+        if (inputTimer_.GetMSec(false) > InputDelay)
+        {
+            SeekBy(input->GetKeyDown(KEY_LEFT) ? -SeekStepMSec : SeekStepMSec);
+            inputTimer_.Reset();
+        }
+    }
+    if (input->GetKeyDown(KEY_V))
+    {
+        if (inputTimer_.GetMSec(false) > InputDelay)
+        {
+            ToggleComponentScreen();
+            inputTimer_.Reset();
+        }
+    }
+    if (input->GetKeyDown(KEY_B))
+    {
+        if (inputTimer_.GetMSec(false) > InputDelay)
+        {
+            TheoraBenchmark::Run(context_, videoFilename_);
+            inputTimer_.Reset();
+        }
+    }
 }
 
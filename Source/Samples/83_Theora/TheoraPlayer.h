@@ -24,6 +24,7 @@
 
 #include "Sample.h"
 #include "TheoraData.h"
+#include "TheoraClock.h"
 
 //=============================================================================
 //=============================================================================
@@ -33,11 +34,12 @@ class Node;
 class Scene;
 class StaticModel;
 class Material;
-class Texture2D;
+class Text;
 }
 
 class Theora;
 class TheoraAudio;
+class TheoraPresenter;
 
 //=============================================================================
 //=============================================================================
@@ -54,12 +56,20 @@ public:
 
 private:
     void CreateScene();
+    /// Put a second screen next to the TV that plays the video as a TheoraVideo resource through a TheoraVideoComponent.
+    void CreateComponentScreen();
+    void ToggleComponentScreen();
     void InitializeTheora();
-    void AddElapsedTime(float timeStep);
+    void UpdatePlayback();
+    /// Pick the decode LOD from the output model's visibility and on-screen size.
+    void UpdateDecodeLod();
+    TheoraDecodeLod GetSurfaceLod() const;
     void ProcessAudioVideo();
     void Play();
     void Pause();
     void Stop();
+    void SeekBy(int64_t deltaMSec);
+    void ToggleLooping();
 
     bool SetOutputModel(StaticModel *model);
     void ScaleModelAccordingVideoRatio();
@@ -67,30 +77,39 @@ private:
     bool InitTexture();
     /// Construct an instruction text to the UI.
     void CreateInstructions();
+    /// Refresh the decoder stats text.
+    void UpdateStatsText();
     /// Subscribe to application-wide logic update events.
     void SubscribeToEvents();
     /// Handle the logic update event.
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
+    /// Finish the setup once the video is open, or report why it failed.
+    void HandleTheoraFirstFrame(StringHash eventType, VariantMap& eventData);
     /// Read input and moves the camera.
     void MoveCamera(float timeStep);
 
 private:
+    String videoFilename_;
     SharedPtr<Theora> theora_;
-    Vector<SharedPtr<VideoData>> videoBufferContainer_;
-    Vector<SharedPtr<AudioData>> audioBufferContainer_;
     SharedPtr<StaticModel> outputModel_;
     SharedPtr<Material> outputMaterial_;
-    SharedArrayPtr<unsigned char> framePlanarDataRGBA_;
-    SharedPtr<Texture2D> rgbaTexture_;
+    SharedPtr<TheoraPresenter> presenter_;
 
     SharedPtr<TheoraAudio> theoraAudio_;
     TheoraAVInfo theoraAVInfo_;
     WeakPtr<Node> tvNode_;
+    // TheoraVideoComponent screen, hidden and stopped until toggled
+    WeakPtr<Node> screenNode_;
     bool rescaleNode_;
 
-    float elapsedTime_;
-    int64_t elapsedTime64_;
+    TheoraClock clock_;
+    Timer lodTimer_;
     bool stopped_;
     bool paused_;
+    // between InitializeTheora() and E_THEORAFIRSTFRAME
+    bool opening_;
+    bool looping_;
     Timer inputTimer_;
+    SharedPtr<Text> statsText_;
+    Timer statsTimer_;
 };
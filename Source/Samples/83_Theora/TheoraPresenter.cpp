@@ -0,0 +1,172 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/Math/Vector4.h>
+
+#include "TheoraPresenter.h"
+#include "Theora.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+TheoraPresenter::TheoraPresenter(Context *context)
+    : Object(context)
+    , width_(0)
+    , height_(0)
+    , regionWidth_(0)
+    , regionHeight_(0)
+    , uploadFrame_(0)
+    , uploaded_(false)
+    , allocations_(0)
+    , uploads_(0)
+    , skipped_(0)
+    , baseUOffset_(Vector4(1.0f, 0.0f, 0.0f, 0.0f))
+    , baseVOffset_(Vector4(0.0f, 1.0f, 0.0f, 0.0f))
+{
+}
+
+TheoraPresenter::~TheoraPresenter()
+{
+    // leave the material as it was found
+    if (material_ && (regionWidth_ != width_ || regionHeight_ != height_))
+    {
+        SetRegion(width_, height_);
+    }
+}
+
+bool TheoraPresenter::Init(Material *material, int width, int height)
+{
+    if (!material || width <= 0 || height <= 0)
+    {
+        return false;
+    }
+
+    material_ = material;
+    width_ = width;
+    height_ = height;
+    regionWidth_ = width;
+    regionHeight_ = height;
+
+    // the region transform goes on top of whatever tiling the material has
+    const Variant &uOffset = material_->GetShaderParameter("UOffset");
+    const Variant &vOffset = material_->GetShaderParameter("VOffset");
+    if (uOffset.GetType() == VAR_VECTOR4)
+    {
+        baseUOffset_ = uOffset.GetVector4();
+    }
+    if (vOffset.GetType() == VAR_VECTOR4)
+    {
+        baseVOffset_ = vOffset.GetVector4();
+    }
+
+    texture_ = new Texture2D(context_);
+    texture_->SetNumLevels(1);
+    texture_->SetSize(width_, height_, Graphics::GetRGBAFormat(), TEXTURE_DYNAMIC);
+    texture_->SetFilterMode(FILTER_BILINEAR);
+    ++allocations_;
+
+    material_->SetTexture(TU_DIFFUSE, texture_);
+    return true;
+}
+
+Texture2D* TheoraPresenter::GetTexture() const
+{
+    return texture_;
+}
+
+bool TheoraPresenter::Update(Theora *theora, int64_t timeMSec)
+{
+    if (!texture_ || !theora)
+    {
+        return false;
+    }
+
+    // superseded frames are released as soon as a newer one is due
+    VideoData *vptr = theora->PeekVideoQueueData();
+    while (vptr && vptr->time_ <= timeMSec)
+    {
+        if (pending_)
+        {
+            ++skipped_;
+        }
+        pending_ = theora->GetVideoQueueData();
+        vptr = theora->PeekVideoQueueData();
+    }
+
+    if (!pending_)
+    {
+        return false;
+    }
+
+    // once per rendered frame, without a Time subsystem every update is one
+    Time *time = GetSubsystem<Time>();
+    unsigned frameNumber = time ? time->GetFrameNumber() : uploadFrame_ + 1;
+    if (uploaded_ && frameNumber == uploadFrame_)
+    {
+        return false;
+    }
+
+    Upload(pending_);
+    pending_.Reset();
+    uploadFrame_ = frameNumber;
+    uploaded_ = true;
+    return true;
+}
+
+void TheoraPresenter::Clear()
+{
+    pending_.Reset();
+}
+
+unsigned TheoraPresenter::GetNumAllocations() const
+{
+    return allocations_;
+}
+
+unsigned TheoraPresenter::GetNumUploads() const
+{
+    return uploads_;
+}
+
+unsigned TheoraPresenter::GetNumSkipped() const
+{
+    return skipped_;
+}
+
+void TheoraPresenter::Upload(VideoData *frame)
+{
+    int width = Min(frame->width_, width_);
+    int height = Min(frame->height_, height_);
+
+    texture_->SetData(0, 0, 0, width, height, frame->buf_);
+    ++uploads_;
+
+    if (width != regionWidth_ || height != regionHeight_)
+    {
+        SetRegion(width, height);
+    }
+}
+
+void TheoraPresenter::SetRegion(int width, int height)
+{
+    regionWidth_ = width;
+    regionHeight_ = height;
+
+    Vector4 uOffset = baseUOffset_;
+    Vector4 vOffset = baseVOffset_;
+
+    // a partial region maps onto its outer texel centers, so bilinear filtering
+    // never reaches the stale texels beside it
+    if (width != width_ || height != height_)
+    {
+        float scaleU = (float)(width - 1) / (float)width_;
+        float scaleV = (float)(height - 1) / (float)height_;
+        uOffset = Vector4(uOffset.x_ * scaleU, uOffset.y_ * scaleU, 0.0f, uOffset.w_ * scaleU + 0.5f / (float)width_);
+        vOffset = Vector4(vOffset.x_ * scaleV, vOffset.y_ * scaleV, 0.0f, vOffset.w_ * scaleV + 0.5f / (float)height_);
+    }
+
+    material_->SetShaderParameter("UOffset", uOffset);
+    material_->SetShaderParameter("VOffset", vOffset);
+}
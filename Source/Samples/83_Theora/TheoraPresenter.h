@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Math/Vector4.h>
+
+#include <stdint.h>
+
+#include "TheoraData.h"
+
+//=============================================================================
+//=============================================================================
+namespace Urho3D
+{
+class Material;
+class Texture2D;
+}
+
+using namespace Urho3D;
+
+class Theora;
+
+//=============================================================================
+// puts decoded frames on a texture
+// - the texture is created once at the video size, frames decoded at half
+//   resolution go into its top-left corner and the material's UV transform
+//   is narrowed to them
+// - of the frames due at an update only the newest is kept, the ones before it
+//   go back to the pool untouched
+// - at most one upload per rendered frame, a frame that comes due again within
+//   the same one waits for the next
+// - main thread only
+//=============================================================================
+class TheoraPresenter : public Object
+{
+    URHO3D_OBJECT(TheoraPresenter, Object);
+
+public:
+    TheoraPresenter(Context *context);
+    virtual ~TheoraPresenter();
+
+    // creates the texture and binds it to the material's diffuse unit
+    bool Init(Material *material, int width, int height);
+    Texture2D* GetTexture() const;
+
+    // takes every frame due at timeMSec off the decoder and uploads the newest,
+    // returns true if it did
+    bool Update(Theora *theora, int64_t timeMSec);
+    // drops a frame still waiting for upload, after a seek
+    void Clear();
+
+    // texture creations, one after Init() whatever is played
+    unsigned GetNumAllocations() const;
+    unsigned GetNumUploads() const;
+    // frames taken off the decoder but superseded before they were uploaded
+    unsigned GetNumSkipped() const;
+
+private:
+    void Upload(VideoData *frame);
+    void SetRegion(int width, int height);
+
+    SharedPtr<Material>  material_;
+    SharedPtr<Texture2D> texture_;
+    SharedPtr<VideoData> pending_;
+    int                  width_;
+    int                  height_;
+    // part of the texture the last upload covered
+    int                  regionWidth_;
+    int                  regionHeight_;
+    unsigned             uploadFrame_;
+    bool                 uploaded_;
+
+    unsigned             allocations_;
+    unsigned             uploads_;
+    unsigned             skipped_;
+
+    // the material's own UV transform, the region is mapped inside it
+    Vector4              baseUOffset_;
+    Vector4              baseVOffset_;
+};
@@ -0,0 +1,261 @@
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "TheoraReader.h"
+#include "TheoraMappedFile.h"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <fcntl.h>
+#include <stdio.h>
+#define THEORA_FADVISE
+#endif
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// mapped pages are touched at this stride to fault them in
+static const unsigned TouchStride = 4096;
+
+//=============================================================================
+//=============================================================================
+TheoraReader::TheoraReader()
+    : file_(0)
+    , mappedFile_(0)
+    , consumerSignal_(0)
+    , position_(0)
+    , size_(0)
+    , windowBytes_(0)
+    , advisedEnd_(0)
+    , maxChunks_(0)
+    , numChunks_(0)
+    , chunkQueue_(MaxChunks)
+    , freeQueue_(MaxChunks)
+    , enabled_(false)
+    , finished_(false)
+    , looping_(false)
+    , loopOffset_(0)
+    , bytesRead_(0)
+    , numReads_(0)
+    , readBytes_(0)
+    , consumedBytes_(0)
+    , stallUSec_(0)
+{
+}
+
+TheoraReader::~TheoraReader()
+{
+    StopReading();
+}
+
+bool TheoraReader::StartReading(File *file, const TheoraMappedFile *mappedFile, unsigned offset, unsigned windowBytes,
+                                TheoraSignal *consumerSignal)
+{
+    StopReading();
+
+    file_ = file;
+    mappedFile_ = mappedFile && mappedFile->IsOpen() ? mappedFile : 0;
+    consumerSignal_ = consumerSignal;
+    size_ = mappedFile_ ? mappedFile_->GetSize() : file_->GetSize();
+    position_ = Min(offset, size_);
+    maxChunks_ = Clamp((windowBytes + ChunkSize - 1) / ChunkSize, 1U, MaxChunks);
+    windowBytes_ = maxChunks_ * ChunkSize;
+    advisedEnd_ = position_;
+
+    // a smaller window than last time
+    if (numChunks_ > maxChunks_ && spareChunk_)
+    {
+        spareChunk_.Reset();
+        --numChunks_;
+    }
+    while (numChunks_ > maxChunks_ && freeQueue_.Pop())
+    {
+        --numChunks_;
+    }
+
+#ifdef THEORA_FADVISE
+    if (!mappedFile_ && !file_->IsPackaged() && file_->GetHandle())
+    {
+        posix_fadvise(fileno(static_cast<FILE*>(file_->GetHandle())), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    readBytes_ = 0;
+    consumedBytes_ = 0;
+    finished_ = false;
+    enabled_ = true;
+
+    return Run();
+}
+
+void TheoraReader::StopReading()
+{
+    enabled_ = false;
+
+    if (IsStarted())
+    {
+        signal_.Set();
+        Stop();
+    }
+
+    // the consumer has stopped too, everything queued goes back to the free list
+    while (SharedPtr<TheoraChunk> chunk = chunkQueue_.Pop())
+    {
+        freeQueue_.Push(chunk);
+    }
+
+    readBytes_ = 0;
+    consumedBytes_ = 0;
+}
+
+void TheoraReader::SetLooping(bool enable, unsigned offset)
+{
+    loopOffset_ = offset;
+    looping_ = enable;
+}
+
+SharedPtr<TheoraChunk> TheoraReader::Pop()
+{
+    return chunkQueue_.Pop();
+}
+
+void TheoraReader::Release(SharedPtr<TheoraChunk> &chunk)
+{
+    consumedBytes_ += chunk->size_;
+
+    // never full, there are no more chunks than slots
+    freeQueue_.Push(chunk);
+    chunk.Reset();
+    signal_.Set();
+}
+
+bool TheoraReader::IsFinished() const
+{
+    // finished_ is only set after the last push
+    return finished_ && !chunkQueue_.Size();
+}
+
+void TheoraReader::ThreadFunction()
+{
+    bool rewound = false;
+
+    while (enabled_)
+    {
+        if (position_ >= size_)
+        {
+            if (!looping_ || loopOffset_ >= size_)
+            {
+                break;
+            }
+
+            // the demuxer drops a page cut off by the end and starts over at the chunk marked
+            position_ = loopOffset_;
+            advisedEnd_ = position_;
+            rewound = true;
+            if (!mappedFile_)
+            {
+                file_->Seek(position_);
+            }
+        }
+
+        SharedPtr<TheoraChunk> chunk = spareChunk_;
+        spareChunk_.Reset();
+        if (!chunk)
+        {
+            chunk = freeQueue_.Pop();
+        }
+        if (!chunk)
+        {
+            if (numChunks_ < maxChunks_)
+            {
+                chunk = new TheoraChunk();
+                ++numChunks_;
+            }
+            else
+            {
+                // the whole window is read ahead, wait for the demuxer to hand a chunk back
+                signal_.Wait();
+                continue;
+            }
+        }
+
+        AdviseWindow();
+
+        unsigned size = Min(ChunkSize, size_ - position_);
+        HiresTimer timer;
+
+        if (mappedFile_)
+        {
+            chunk->data_ = mappedFile_->GetData() + position_;
+
+            // a byte per page, the faults happen here instead of in the demuxer
+            volatile unsigned char touched = 0;
+            for (unsigned i = 0; i < size; i += TouchStride)
+            {
+                touched = chunk->data_[i];
+            }
+            (void)touched;
+        }
+        else
+        {
+            if (!chunk->buffer_)
+            {
+                chunk->buffer_ = new unsigned char[ChunkSize];
+            }
+            chunk->data_ = chunk->buffer_.Get();
+            size = file_->Read(chunk->buffer_.Get(), size);
+            ++numReads_;
+        }
+
+        stallUSec_ += timer.GetUSec(false);
+
+        // short file or read error
+        if (!size)
+        {
+            spareChunk_ = chunk;
+            break;
+        }
+
+        chunk->offset_ = position_;
+        chunk->size_ = size;
+        chunk->rewound_ = rewound;
+        rewound = false;
+        position_ += size;
+        bytesRead_ += size;
+        readBytes_ += size;
+
+        chunkQueue_.Push(chunk);
+        consumerSignal_->Set();
+    }
+
+    finished_ = true;
+    consumerSignal_->Set();
+}
+
+void TheoraReader::AdviseWindow()
+{
+    if (position_ + windowBytes_ / 2 < advisedEnd_)
+    {
+        return;
+    }
+
+    unsigned begin = Max(position_, advisedEnd_);
+    unsigned end = Min(position_ + windowBytes_, size_);
+    if (begin >= end)
+    {
+        return;
+    }
+
+    if (mappedFile_)
+    {
+        mappedFile_->Prefetch(begin, end - begin);
+    }
+#ifdef THEORA_FADVISE
+    else if (!file_->IsPackaged() && file_->GetHandle())
+    {
+        posix_fadvise(fileno(static_cast<FILE*>(file_->GetHandle())), begin, end - begin, POSIX_FADV_WILLNEED);
+    }
+#endif
+
+    advisedEnd_ = end;
+}
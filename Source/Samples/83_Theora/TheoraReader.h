@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/ArrayPtr.h>
+
+#include <atomic>
+
+#include "TheoraRingBuffer.h"
+#include "TheoraSignal.h"
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+namespace Urho3D
+{
+class File;
+}
+
+class TheoraMappedFile;
+
+//=============================================================================
+// a span of the file read ahead, data_ points at buffer_ or into the mapping
+//=============================================================================
+class TheoraChunk : public RefCounted
+{
+public:
+    TheoraChunk() : data_(0), size_(0), offset_(0), rewound_(false)
+    {
+    }
+
+    const unsigned char             *data_;
+    unsigned                        size_;
+    unsigned                        offset_;
+    // the first chunk after reading looped back, what came before it ended with the file
+    bool                            rewound_;
+    SharedArrayPtr<unsigned char>   buffer_;
+};
+
+//=============================================================================
+// I/O stage of the decode pipeline - reads the file on its own thread up to a
+// window of bytes ahead of the demuxer, so a slow disk stalls this thread and
+// not the decoding of data already read. mapped files are faulted in here
+// - chunks travel reader -> chunk queue -> demuxer -> free queue -> reader
+//=============================================================================
+class TheoraReader : public Thread
+{
+public:
+    static const unsigned ChunkSize = 64 * 1024;
+    static const unsigned MaxChunks = 256;
+
+    TheoraReader();
+    virtual ~TheoraReader();
+
+    // reads from offset, where file is already positioned, or out of mappedFile when
+    // it is open. consumerSignal is set whenever a chunk is queued or the end reached
+    bool StartReading(File *file, const TheoraMappedFile *mappedFile, unsigned offset, unsigned windowBytes,
+                      TheoraSignal *consumerSignal);
+    // drops whatever was read ahead
+    void StopReading();
+    // at the end of the file carry on reading from offset, can be changed while reading
+    void SetLooping(bool enable, unsigned offset);
+
+    // consumer - the next chunk in file order or null, handed back with Release() when done
+    SharedPtr<TheoraChunk> Pop();
+    void Release(SharedPtr<TheoraChunk> &chunk);
+    // the end was reached and every chunk popped
+    bool IsFinished() const;
+
+    // safe to call from any thread
+    unsigned long long GetBytesRead() const { return bytesRead_; }
+    unsigned GetNumReads() const { return numReads_; }
+    // read but not yet handed back
+    unsigned GetBufferedBytes() const { return readBytes_ - consumedBytes_; }
+    // time blocked in reads or faulting in mapped pages
+    long long GetStallUSec() const { return stallUSec_; }
+
+private:
+    virtual void ThreadFunction();
+    // kernel read-ahead over the window, renewed once half of it is used
+    void AdviseWindow();
+
+    File                            *file_;
+    const TheoraMappedFile          *mappedFile_;
+    TheoraSignal                    *consumerSignal_;
+    unsigned                        position_;
+    unsigned                        size_;
+    unsigned                        windowBytes_;
+    unsigned                        advisedEnd_;
+    unsigned                        maxChunks_;
+    unsigned                        numChunks_;
+
+    TheoraRingBuffer<TheoraChunk>   chunkQueue_;
+    // the demuxer is the only producer, the reader keeps a chunk it read nothing into
+    // in spareChunk_ for its next read
+    TheoraRingBuffer<TheoraChunk>   freeQueue_;
+    SharedPtr<TheoraChunk>          spareChunk_;
+    // set by the demuxer when it hands a chunk back, and on stop
+    TheoraSignal                    signal_;
+    std::atomic<bool>               enabled_;
+    std::atomic<bool>               finished_;
+    std::atomic<bool>               looping_;
+    std::atomic<unsigned>           loopOffset_;
+
+    std::atomic<unsigned long long> bytesRead_;
+    std::atomic<unsigned>           numReads_;
+    // since StartReading(), positions go back when looping
+    std::atomic<unsigned>           readBytes_;
+    std::atomic<unsigned>           consumedBytes_;
+    std::atomic<long long>          stallUSec_;
+};
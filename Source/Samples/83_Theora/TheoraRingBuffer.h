@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Urho3D/Container/Ptr.h>
+
+#include <atomic>
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+//=============================================================================
+// bounded single-producer/single-consumer ring buffer
+// - producer (decode thread) only calls Push()
+// - consumer (main thread) only calls Front(), Pop() and Size()
+// - capacity is rounded up to a power of two
+//=============================================================================
+template <class T>
+class TheoraRingBuffer
+{
+public:
+    TheoraRingBuffer(unsigned capacity)
+        : head_(0)
+        , tail_(0)
+    {
+        capacity_ = 1;
+        while (capacity_ < capacity)
+        {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        slots_ = new SharedPtr<T>[capacity_];
+    }
+
+    ~TheoraRingBuffer()
+    {
+        delete [] slots_;
+        slots_ = NULL;
+    }
+
+    // producer - ownership moves into the queue and item is reset, so the
+    // producer holds no ref once published (refcounts are not atomic).
+    // returns false when full, item is left untouched
+    bool Push(SharedPtr<T> &item)
+    {
+        unsigned tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == capacity_)
+        {
+            return false;
+        }
+
+        slots_[tail & mask_] = item;
+        item.Reset();
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer - oldest item or NULL when empty, item remains queued
+    T* Front() const
+    {
+        unsigned head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return NULL;
+        }
+
+        return slots_[head & mask_].Get();
+    }
+
+    // consumer - removes and returns the oldest item or NULL when empty
+    SharedPtr<T> Pop()
+    {
+        SharedPtr<T> item;
+        unsigned head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return item;
+        }
+
+        // release the slot's ref before handing the slot back to the producer
+        item = slots_[head & mask_];
+        slots_[head & mask_].Reset();
+        head_.store(head + 1, std::memory_order_release);
+        return item;
+    }
+
+    unsigned Size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    unsigned Capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    // non-copyable
+    TheoraRingBuffer(const TheoraRingBuffer&);
+    TheoraRingBuffer& operator=(const TheoraRingBuffer&);
+
+    static const unsigned CacheLineSize = 64;
+
+    // head and tail padded onto separate cache lines to avoid false sharing between threads
+    std::atomic<unsigned> head_;
+    char                  padHead_[CacheLineSize - sizeof(std::atomic<unsigned>)];
+    std::atomic<unsigned> tail_;
+    char                  padTail_[CacheLineSize - sizeof(std::atomic<unsigned>)];
+    SharedPtr<T>          *slots_;
+    unsigned              capacity_;
+    unsigned              mask_;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+//=============================================================================
+// auto-reset event
+// - a Set() with no thread waiting is kept for the next Wait(), so a wake up
+//   sent between checking for work and calling Wait() is never lost
+// - Wait() blocks without polling
+//=============================================================================
+class TheoraSignal
+{
+public:
+    TheoraSignal()
+        : signaled_(false)
+    {
+    }
+
+    void Set()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            signaled_ = true;
+        }
+        condition_.notify_one();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!signaled_)
+        {
+            condition_.wait(lock);
+        }
+        signaled_ = false;
+    }
+
+private:
+    // non-copyable
+    TheoraSignal(const TheoraSignal&);
+    TheoraSignal& operator=(const TheoraSignal&);
+
+    std::mutex              mutex_;
+    std::condition_variable condition_;
+    bool                    signaled_;
+};
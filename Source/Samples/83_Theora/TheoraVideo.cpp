@@ -0,0 +1,99 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+
+#include "TheoraVideo.h"
+#include "Theora.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+TheoraVideo::TheoraVideo(Context *context)
+    : Resource(context)
+    , prepareMSec_(0.0f)
+{
+}
+
+TheoraVideo::~TheoraVideo()
+{
+}
+
+void TheoraVideo::RegisterObject(Context *context)
+{
+    context->RegisterFactory<TheoraVideo>();
+}
+
+bool TheoraVideo::BeginLoad(Deserializer &source)
+{
+    // the cache and the file loaders pass a File, the instance keeps reading it for
+    // playback. any other source is reopened by its resource name
+    File *file = dynamic_cast<File*>(&source);
+    String fileName = !GetName().Empty() ? GetName() : source.GetName();
+
+    prepared_.Reset();
+    avInfo_ = TheoraAVInfo();
+    prepareMSec_ = 0.0f;
+
+    SharedPtr<Theora> theora(new Theora());
+    int result = file ? theora->Prepare(context_, file) : theora->Prepare(context_, fileName);
+    if (result != INIT_OK)
+    {
+        URHO3D_LOGERRORF("TheoraVideo: cannot open '%s', error %d", fileName.CString(), result);
+        return false;
+    }
+
+    prepared_ = theora;
+    avInfo_ = theora->GetTheoraAVInfo();
+    prepareMSec_ = theora->GetStats().openMSec_;
+    return true;
+}
+
+bool TheoraVideo::EndLoad()
+{
+    // the prepared instance holds its first frame, the codebooks are accounted to the header cache
+    SetMemoryUse(sizeof(TheoraVideo) + avInfo_.videoFrameWidth_ * avInfo_.videoFrameHeight_ * RGBAComponentSize);
+
+    URHO3D_LOGINFOF("TheoraVideo: '%s' %ux%u, %.1f s, prepared in %.1f ms", GetName().CString(),
+                    avInfo_.videoFrameWidth_, avInfo_.videoFrameHeight_, avInfo_.durationMSec_ * 0.001f, prepareMSec_);
+    return true;
+}
+
+SharedPtr<Theora> TheoraVideo::CreateInstance()
+{
+    if (prepared_)
+    {
+        SharedPtr<Theora> theora = prepared_;
+        prepared_.Reset();
+        SetMemoryUse(sizeof(TheoraVideo));
+        return theora;
+    }
+
+    if (!avInfo_.initialized_)
+    {
+        return SharedPtr<Theora>();
+    }
+
+    SharedPtr<Theora> theora(new Theora());
+    if (!theora->InitializeAsync(context_, GetName()))
+    {
+        return SharedPtr<Theora>();
+    }
+
+    return theora;
+}
+
+const TheoraAVInfo& TheoraVideo::GetAVInfo() const
+{
+    return avInfo_;
+}
+
+bool TheoraVideo::HasPreparedInstance() const
+{
+    return prepared_.Get() != 0;
+}
+
+float TheoraVideo::GetPrepareMSec() const
+{
+    return prepareMSec_;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Urho3D/Resource/Resource.h>
+
+#include "TheoraData.h"
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+class Theora;
+
+//=============================================================================
+// an Ogg Theora/Vorbis video as a resource, found through the ResourceCache
+// resource directories and packages and loadable in the background with the
+// rest of a scene
+// - BeginLoad() opens an instance of the video ahead of playback on the File
+//   it is given: the headers are parsed into the TheoraHeaderCache, the
+//   keyframe index is mapped or its scan started, and the first frame is
+//   decoded. decoding seeks and reads the file for as long as it plays, so a
+//   source that is not a File - a MemoryBuffer, a network stream - is not read
+//   from, the video is reopened by its name instead
+// - EndLoad() only publishes what BeginLoad() found
+// - CreateInstance() hands out that instance to the first player, later ones
+//   open their own asynchronously, through the header cache
+//=============================================================================
+class TheoraVideo : public Resource
+{
+    URHO3D_OBJECT(TheoraVideo, Resource);
+
+public:
+    TheoraVideo(Context *context);
+    virtual ~TheoraVideo();
+
+    static void RegisterObject(Context *context);
+
+    // may run on the background loading thread
+    virtual bool BeginLoad(Deserializer &source);
+    // main thread
+    virtual bool EndLoad();
+
+    // an instance to play the video with, null if it can't be opened. ready to start
+    // when IsOpening() is false, else once its E_THEORAFIRSTFRAME has been sent
+    SharedPtr<Theora> CreateInstance();
+
+    const TheoraAVInfo& GetAVInfo() const;
+    // the instance opened by BeginLoad() has not been handed out yet
+    bool HasPreparedInstance() const;
+    // BeginLoad() open time, headers to first frame
+    float GetPrepareMSec() const;
+
+private:
+    SharedPtr<Theora>   prepared_;
+    TheoraAVInfo        avInfo_;
+    float               prepareMSec_;
+};
@@ -0,0 +1,321 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Audio/SoundSource.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/IO/Log.h>
+
+#include "TheoraVideoComponent.h"
+#include "TheoraVideo.h"
+#include "Theora.h"
+#include "TheoraEvents.h"
+#include "TheoraAudio.h"
+#include "TheoraPresenter.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+TheoraVideoComponent::TheoraVideoComponent(Context *context)
+    : Component(context)
+    , looping_(false)
+    , playing_(true)
+    , opening_(false)
+{
+}
+
+TheoraVideoComponent::~TheoraVideoComponent()
+{
+    Close();
+}
+
+void TheoraVideoComponent::RegisterObject(Context *context)
+{
+    context->RegisterFactory<TheoraVideoComponent>(LOGIC_CATEGORY);
+
+    URHO3D_ACCESSOR_ATTRIBUTE("Is Enabled", IsEnabled, SetEnabled, bool, true, AM_DEFAULT);
+    URHO3D_MIXED_ACCESSOR_ATTRIBUTE("Video", GetVideoAttr, SetVideoAttr, ResourceRef, ResourceRef(TheoraVideo::GetTypeStatic()), AM_DEFAULT);
+    URHO3D_MIXED_ACCESSOR_ATTRIBUTE("Material", GetMaterialAttr, SetMaterialAttr, ResourceRef, ResourceRef(Material::GetTypeStatic()), AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Is Looping", IsLooping, SetLooping, bool, false, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Is Playing", IsPlaying, SetPlayingAttr, bool, true, AM_DEFAULT);
+}
+
+void TheoraVideoComponent::OnSetEnabled()
+{
+    UpdateInstance();
+}
+
+void TheoraVideoComponent::OnSceneSet(Scene *scene)
+{
+    if (scene)
+    {
+        SubscribeToEvent(scene, E_SCENEUPDATE, URHO3D_HANDLER(TheoraVideoComponent, HandleSceneUpdate));
+    }
+    else
+    {
+        UnsubscribeFromEvent(E_SCENEUPDATE);
+    }
+
+    UpdateInstance();
+}
+
+void TheoraVideoComponent::SetVideo(TheoraVideo *video)
+{
+    if (video == video_)
+    {
+        return;
+    }
+
+    Close();
+    video_ = video;
+    UpdateInstance();
+    MarkNetworkUpdate();
+}
+
+void TheoraVideoComponent::SetMaterial(Material *material)
+{
+    if (material == material_)
+    {
+        return;
+    }
+
+    // the texture is bound to the material once, at the first frame
+    Close();
+    material_ = material;
+    UpdateInstance();
+    MarkNetworkUpdate();
+}
+
+void TheoraVideoComponent::SetLooping(bool enable)
+{
+    looping_ = enable;
+
+    if (theora_ && !opening_)
+    {
+        theora_->SetLooping(looping_);
+    }
+    MarkNetworkUpdate();
+}
+
+void TheoraVideoComponent::Play()
+{
+    playing_ = true;
+    UpdateInstance();
+    MarkNetworkUpdate();
+}
+
+void TheoraVideoComponent::Stop()
+{
+    playing_ = false;
+    UpdateInstance();
+    MarkNetworkUpdate();
+}
+
+TheoraVideo* TheoraVideoComponent::GetVideo() const
+{
+    return video_;
+}
+
+Material* TheoraVideoComponent::GetMaterial() const
+{
+    return material_;
+}
+
+bool TheoraVideoComponent::IsLooping() const
+{
+    return looping_;
+}
+
+bool TheoraVideoComponent::IsPlaying() const
+{
+    return playing_;
+}
+
+Theora* TheoraVideoComponent::GetTheora() const
+{
+    return theora_;
+}
+
+int64_t TheoraVideoComponent::GetTime() const
+{
+    return clock_.GetTime();
+}
+
+void TheoraVideoComponent::SetVideoAttr(const ResourceRef &value)
+{
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+    SetVideo(cache->GetResource<TheoraVideo>(value.name_));
+}
+
+ResourceRef TheoraVideoComponent::GetVideoAttr() const
+{
+    return GetResourceRef(video_, TheoraVideo::GetTypeStatic());
+}
+
+void TheoraVideoComponent::SetMaterialAttr(const ResourceRef &value)
+{
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+    SetMaterial(cache->GetResource<Material>(value.name_));
+}
+
+ResourceRef TheoraVideoComponent::GetMaterialAttr() const
+{
+    return GetResourceRef(material_, Material::GetTypeStatic());
+}
+
+void TheoraVideoComponent::SetPlayingAttr(bool enable)
+{
+    if (enable)
+    {
+        Play();
+    }
+    else
+    {
+        Stop();
+    }
+}
+
+void TheoraVideoComponent::UpdateInstance()
+{
+    bool active = playing_ && video_ && GetScene() && IsEnabledEffective();
+
+    if (!active)
+    {
+        Close();
+    }
+    else if (!theora_)
+    {
+        Open();
+    }
+}
+
+void TheoraVideoComponent::Open()
+{
+    if (!GetOutputMaterial())
+    {
+        URHO3D_LOGWARNINGF("TheoraVideoComponent: no material to play '%s' on", video_->GetName().CString());
+        return;
+    }
+
+    theora_ = video_->CreateInstance();
+    if (!theora_)
+    {
+        URHO3D_LOGERRORF("TheoraVideoComponent: cannot open '%s'", video_->GetName().CString());
+        return;
+    }
+
+    // the instance the resource prepared is ready, another one opens in the background
+    if (theora_->IsOpening())
+    {
+        opening_ = true;
+        SubscribeToEvent(E_THEORAFIRSTFRAME, URHO3D_HANDLER(TheoraVideoComponent, HandleTheoraFirstFrame));
+    }
+    else
+    {
+        Start();
+    }
+}
+
+void TheoraVideoComponent::Start()
+{
+    const TheoraAVInfo &info = theora_->GetTheoraAVInfo();
+
+    presenter_ = new TheoraPresenter(context_);
+    presenter_->Init(GetOutputMaterial(), info.videoFrameWidth_, info.videoFrameHeight_);
+
+    if (info.audioFrequencey_)
+    {
+        // not saved with the scene, kept for every instance played after
+        if (!soundSource_)
+        {
+            soundSource_ = node_->CreateComponent<SoundSource>(LOCAL);
+            soundSource_->SetTemporary(true);
+        }
+        audio_ = new TheoraAudio(context_);
+        audio_->Init(soundSource_, info.audioFrequencey_, info.audioSixteenBits_, info.audioStereo_);
+    }
+
+    theora_->SetLooping(looping_);
+    theora_->StartProcess();
+    clock_.Reset(0);
+    clock_.Start();
+}
+
+void TheoraVideoComponent::Close()
+{
+    if (opening_)
+    {
+        UnsubscribeFromEvent(E_THEORAFIRSTFRAME);
+        opening_ = false;
+    }
+
+    // an open still running is stopped and waited for
+    theora_.Reset();
+
+    // the sound source stays, this can run while the node changes its components
+    if (audio_)
+    {
+        audio_->Stop();
+        audio_.Reset();
+    }
+
+    // the material keeps the last frame
+    presenter_.Reset();
+    clock_.Reset(0);
+}
+
+Material* TheoraVideoComponent::GetOutputMaterial() const
+{
+    if (material_)
+    {
+        return material_;
+    }
+
+    StaticModel *model = node_ ? node_->GetComponent<StaticModel>() : 0;
+    return model ? model->GetMaterial(0) : 0;
+}
+
+void TheoraVideoComponent::HandleTheoraFirstFrame(StringHash eventType, VariantMap& eventData)
+{
+    using namespace TheoraFirstFrame;
+
+    if (eventData[P_THEORA].GetPtr() != theora_.Get())
+    {
+        return;
+    }
+
+    UnsubscribeFromEvent(E_THEORAFIRSTFRAME);
+    opening_ = false;
+
+    int result = eventData[P_RESULT].GetInt();
+    if (result != INIT_OK)
+    {
+        URHO3D_LOGERRORF("TheoraVideoComponent: cannot open '%s', error %d", video_->GetName().CString(), result);
+        theora_.Reset();
+        return;
+    }
+
+    Start();
+}
+
+void TheoraVideoComponent::HandleSceneUpdate(StringHash eventType, VariantMap& eventData)
+{
+    if (!theora_ || opening_)
+    {
+        return;
+    }
+
+    // wall time, slaved to the samples the sound source has taken
+    int64_t timeMSec = clock_.Update(audio_);
+    theora_->SetElapsedTime(timeMSec);
+
+    // only the newest due frame is uploaded
+    presenter_->Update(theora_, timeMSec);
+
+    if (audio_)
+    {
+        audio_->Update(theora_, timeMSec);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+#include "TheoraClock.h"
+
+//=============================================================================
+//=============================================================================
+namespace Urho3D
+{
+class Material;
+class SoundSource;
+}
+
+using namespace Urho3D;
+
+class Theora;
+class TheoraVideo;
+class TheoraPresenter;
+class TheoraAudio;
+
+//=============================================================================
+// plays a TheoraVideo resource onto a material's diffuse texture, with the
+// sound from a temporary SoundSource on the node
+// - the video is a resource attribute, a scene loaded asynchronously preloads
+//   it like any other resource and playback starts from the instance the
+//   resource prepared, with its first frame already decoded
+// - without a material the first one of a StaticModel on the node is used
+// - plays while enabled and in a scene, from the start each time
+// - main thread only
+//=============================================================================
+class TheoraVideoComponent : public Component
+{
+    URHO3D_OBJECT(TheoraVideoComponent, Component);
+
+public:
+    TheoraVideoComponent(Context *context);
+    virtual ~TheoraVideoComponent();
+
+    static void RegisterObject(Context *context);
+
+    virtual void OnSetEnabled();
+
+    void SetVideo(TheoraVideo *video);
+    void SetMaterial(Material *material);
+    void SetLooping(bool enable);
+    void Play();
+    void Stop();
+
+    TheoraVideo* GetVideo() const;
+    Material* GetMaterial() const;
+    bool IsLooping() const;
+    // Play() was called, also while the video is opening or the component is inactive
+    bool IsPlaying() const;
+    // the instance being played, null until Play() finds the component active
+    Theora* GetTheora() const;
+    int64_t GetTime() const;
+
+    void SetVideoAttr(const ResourceRef &value);
+    ResourceRef GetVideoAttr() const;
+    void SetMaterialAttr(const ResourceRef &value);
+    ResourceRef GetMaterialAttr() const;
+    void SetPlayingAttr(bool enable);
+
+protected:
+    virtual void OnSceneSet(Scene *scene);
+
+private:
+    // opens or closes the instance to match the requested state
+    void UpdateInstance();
+    void Open();
+    // once the instance has its first frame
+    void Start();
+    void Close();
+    Material* GetOutputMaterial() const;
+
+    void HandleTheoraFirstFrame(StringHash eventType, VariantMap& eventData);
+    void HandleSceneUpdate(StringHash eventType, VariantMap& eventData);
+
+    SharedPtr<TheoraVideo>      video_;
+    SharedPtr<Material>         material_;
+    SharedPtr<Theora>           theora_;
+    SharedPtr<TheoraPresenter>  presenter_;
+    SharedPtr<TheoraAudio>      audio_;
+    WeakPtr<SoundSource>        soundSource_;
+    TheoraClock                 clock_;
+    bool                        looping_;
+    bool                        playing_;
+    // between Open() and the instance's first frame
+    bool                        opening_;
+};
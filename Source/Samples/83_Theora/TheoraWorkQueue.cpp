@@ -0,0 +1,171 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+
+#include "TheoraWorkQueue.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+class TheoraWorker : public Thread, public RefCounted
+{
+public:
+    TheoraWorker(TheoraWorkQueue *owner, unsigned index)
+        : owner_(owner)
+        , index_(index)
+    {
+    }
+
+    virtual void ThreadFunction()
+    {
+        owner_->ProcessItems(index_);
+    }
+
+private:
+    TheoraWorkQueue *owner_;
+    unsigned        index_;
+};
+
+//=============================================================================
+//=============================================================================
+TheoraWorkQueue::TheoraWorkQueue(Context *context)
+    : Object(context)
+    , queueHead_(0)
+    , shutDown_(false)
+{
+}
+
+TheoraWorkQueue::~TheoraWorkQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        shutDown_ = true;
+    }
+    workAvailable_.notify_all();
+
+    for (unsigned i = 0; i < threads_.Size(); ++i)
+    {
+        threads_[i]->Stop();
+    }
+    threads_.Clear();
+}
+
+void TheoraWorkQueue::CreateThreads(unsigned numThreads)
+{
+    // other subsystems may already be handing out work
+    if (!threads_.Empty())
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        // 0 is the calling thread in Run()
+        SharedPtr<TheoraWorker> thread(new TheoraWorker(this, i + 1));
+        thread->Run();
+        threads_.Push(thread);
+    }
+}
+
+unsigned TheoraWorkQueue::GetNumThreads() const
+{
+    return threads_.Size();
+}
+
+void TheoraWorkQueue::Run(TheoraWorkItem *items, unsigned numItems)
+{
+    if (!numItems)
+    {
+        return;
+    }
+
+    if (numItems > 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            for (unsigned i = 1; i < numItems; ++i)
+            {
+                items[i].completed_ = false;
+                queue_.Push(&items[i]);
+            }
+        }
+        workAvailable_.notify_all();
+    }
+
+    Execute(&items[0], 0);
+
+    // help out rather than block, this also covers having no worker threads
+    while (TheoraWorkItem *item = PopItem())
+    {
+        Execute(item, 0);
+    }
+
+    if (numItems > 1)
+    {
+        // what is left is already running on the workers
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        for (unsigned i = 1; i < numItems; ++i)
+        {
+            workCompleted_.wait(lock, [&]() { return items[i].completed_.load(); });
+        }
+    }
+}
+
+TheoraWorkItem* TheoraWorkQueue::PopItem()
+{
+    std::lock_guard<std::mutex> lock(queueMutex_);
+
+    if (queueHead_ == queue_.Size())
+    {
+        return NULL;
+    }
+
+    TheoraWorkItem *item = queue_[queueHead_++];
+
+    // keep the capacity, drop the consumed entries once drained
+    if (queueHead_ == queue_.Size())
+    {
+        queue_.Clear();
+        queueHead_ = 0;
+    }
+
+    return item;
+}
+
+void TheoraWorkQueue::ProcessItems(unsigned threadIndex)
+{
+    for (;;)
+    {
+        TheoraWorkItem *item;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            workAvailable_.wait(lock, [this]() { return shutDown_ || queueHead_ != queue_.Size(); });
+
+            if (shutDown_)
+            {
+                return;
+            }
+
+            item = queue_[queueHead_++];
+            if (queueHead_ == queue_.Size())
+            {
+                queue_.Clear();
+                queueHead_ = 0;
+            }
+        }
+
+        Execute(item, threadIndex);
+    }
+}
+
+void TheoraWorkQueue::Execute(TheoraWorkItem *item, unsigned threadIndex)
+{
+    item->workFunction_(item, threadIndex);
+
+    // the owner may return from Run() and free the item as soon as it sees
+    // the completion, so it is published under the lock and not touched after
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        item->completed_ = true;
+    }
+    workCompleted_.notify_all();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Container/Vector.h>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+//=============================================================================
+//=============================================================================
+using namespace Urho3D;
+
+class TheoraWorker;
+
+//=============================================================================
+// mirrors Urho3D's WorkItem
+//=============================================================================
+struct TheoraWorkItem
+{
+    TheoraWorkItem() : workFunction_(0), aux_(0), completed_(true)
+    {
+    }
+
+    void (*workFunction_)(const TheoraWorkItem*, unsigned);
+    void *aux_;
+    std::atomic<bool> completed_;
+};
+
+//=============================================================================
+// worker pool that, unlike Urho3D's WorkQueue, accepts work from any thread,
+// so decode threads can split their work without involving the main thread
+//=============================================================================
+class TheoraWorkQueue : public Object
+{
+    URHO3D_OBJECT(TheoraWorkQueue, Object);
+
+    friend class TheoraWorker;
+
+public:
+    TheoraWorkQueue(Context *context);
+    virtual ~TheoraWorkQueue();
+
+    void CreateThreads(unsigned numThreads);
+    unsigned GetNumThreads() const;
+
+    // thread-safe - runs items[0] on the calling thread, helps with queued
+    // work and returns once every item has completed
+    void Run(TheoraWorkItem *items, unsigned numItems);
+
+private:
+    TheoraWorkItem* PopItem();
+    void ProcessItems(unsigned threadIndex);
+    void Execute(TheoraWorkItem *item, unsigned threadIndex);
+
+    Vector<SharedPtr<TheoraWorker> > threads_;
+    PODVector<TheoraWorkItem*>      queue_;
+    unsigned                        queueHead_;
+    // guards the queue, shutDown_ and the completion of queued items, both
+    // conditions are waited on with their predicate checked under it
+    std::mutex                      queueMutex_;
+    std::condition_variable         workAvailable_;
+    std::condition_variable         workCompleted_;
+    bool                            shutDown_;
+};
@@ -0,0 +1,718 @@
+#include "TheoraYuv.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define THEORA_YUV_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(THEORA_YUV_SSE2) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define THEORA_YUV_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define THEORA_TARGET_AVX2
+#else
+#define THEORA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+//=============================================================================
+//=============================================================================
+static const int YuvRound = 1 << (YuvCoeffShift - 1);
+
+// luma (Kr, Kb) weights per colorspace; Rec 470M and 470BG only differ in
+// primaries and gamma, both use the Rec 601 matrix
+struct YuvMatrix
+{
+    float kr_;
+    float kb_;
+};
+
+static const YuvMatrix Rec601Matrix = { 0.299f, 0.114f };
+
+//=============================================================================
+// reference fixed-point path - the simd paths must match it bit for bit
+//=============================================================================
+static inline unsigned char ClampByte(int x)
+{
+    return (unsigned char)(x > 255 ? 255 : (x < 0 ? 0 : x));
+}
+
+static inline void YuvToRgba(int y, int u, int v, const YuvCoeffs &c, unsigned char *rgba)
+{
+    int yy = (y - c.yOffset_) * c.yMul_ + YuvRound;
+    u -= 128;
+    v -= 128;
+
+    rgba[0] = ClampByte((yy + c.vr_ * v) >> YuvCoeffShift);
+    rgba[1] = ClampByte((yy - c.ug_ * u - c.vg_ * v) >> YuvCoeffShift);
+    rgba[2] = ClampByte((yy + c.ub_ * u) >> YuvCoeffShift);
+    rgba[3] = 0xff;
+}
+
+// ShiftX is 1 when chroma is subsampled horizontally (4:2:0, 4:2:2), 0 for 4:4:4
+template <int ShiftX>
+static void RowYuvC(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+                    unsigned char *rgba, int width, const YuvCoeffs &c)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        YuvToRgba(y[x], u[x >> ShiftX], v[x >> ShiftX], c, rgba + x * 4);
+    }
+}
+
+#ifdef THEORA_YUV_SSE2
+//=============================================================================
+// sse2 - 16 pixels per iteration
+// 16-bit lanes with saturating adds; a lane can only saturate upwards, where
+// the reference clamps to 255 as well
+//=============================================================================
+struct YuvConstsSse2
+{
+    YuvConstsSse2(const YuvCoeffs &c)
+    {
+        yOffset_ = _mm_set1_epi16(c.yOffset_);
+        yMul_ = _mm_set1_epi16(c.yMul_);
+        round_ = _mm_set1_epi16(YuvRound);
+        bias_ = _mm_set1_epi16(128);
+        vr_ = _mm_set1_epi16(c.vr_);
+        ug_ = _mm_set1_epi16(c.ug_);
+        vg_ = _mm_set1_epi16(c.vg_);
+        ub_ = _mm_set1_epi16(c.ub_);
+    }
+
+    __m128i yOffset_, yMul_, round_, bias_;
+    __m128i vr_, ug_, vg_, ub_;
+};
+
+static inline void YuvToRgb8Sse2(__m128i y, __m128i u, __m128i v, const YuvConstsSse2 &k,
+                                 __m128i &r, __m128i &g, __m128i &b)
+{
+    __m128i yy = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, k.yOffset_), k.yMul_), k.round_);
+
+    r = _mm_srai_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(v, k.vr_)), YuvCoeffShift);
+    g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(yy, _mm_mullo_epi16(u, k.ug_)), _mm_mullo_epi16(v, k.vg_)), YuvCoeffShift);
+    b = _mm_srai_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(u, k.ub_)), YuvCoeffShift);
+}
+
+static inline void StoreRgba16Sse2(__m128i r, __m128i g, __m128i b, __m128i a, unsigned char *rgba)
+{
+    __m128i rgLo = _mm_unpacklo_epi8(r, g);
+    __m128i rgHi = _mm_unpackhi_epi8(r, g);
+    __m128i baLo = _mm_unpacklo_epi8(b, a);
+    __m128i baHi = _mm_unpackhi_epi8(b, a);
+
+    _mm_storeu_si128((__m128i*)(rgba +  0), _mm_unpacklo_epi16(rgLo, baLo));
+    _mm_storeu_si128((__m128i*)(rgba + 16), _mm_unpackhi_epi16(rgLo, baLo));
+    _mm_storeu_si128((__m128i*)(rgba + 32), _mm_unpacklo_epi16(rgHi, baHi));
+    _mm_storeu_si128((__m128i*)(rgba + 48), _mm_unpackhi_epi16(rgHi, baHi));
+}
+
+// chroma for 16 pixels as two 8-lane halves
+template <int ShiftX>
+static inline void LoadChromaSse2(const unsigned char *src, const YuvConstsSse2 &k, __m128i &lo, __m128i &hi);
+
+template <>
+inline void LoadChromaSse2<1>(const unsigned char *src, const YuvConstsSse2 &k, __m128i &lo, __m128i &hi)
+{
+    // each chroma sample covers two pixels
+    __m128i c16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)src), _mm_setzero_si128()), k.bias_);
+    lo = _mm_unpacklo_epi16(c16, c16);
+    hi = _mm_unpackhi_epi16(c16, c16);
+}
+
+template <>
+inline void LoadChromaSse2<0>(const unsigned char *src, const YuvConstsSse2 &k, __m128i &lo, __m128i &hi)
+{
+    __m128i c8 = _mm_loadu_si128((const __m128i*)src);
+    lo = _mm_sub_epi16(_mm_unpacklo_epi8(c8, _mm_setzero_si128()), k.bias_);
+    hi = _mm_sub_epi16(_mm_unpackhi_epi8(c8, _mm_setzero_si128()), k.bias_);
+}
+
+template <int ShiftX>
+static void RowYuvSse2(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+                       unsigned char *rgba, int width, const YuvCoeffs &c)
+{
+    const YuvConstsSse2 k(c);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i y8 = _mm_loadu_si128((const __m128i*)(y + x));
+        __m128i uLo, uHi, vLo, vHi;
+        LoadChromaSse2<ShiftX>(u + (x >> ShiftX), k, uLo, uHi);
+        LoadChromaSse2<ShiftX>(v + (x >> ShiftX), k, vLo, vHi);
+
+        __m128i rLo, gLo, bLo, rHi, gHi, bHi;
+        YuvToRgb8Sse2(_mm_unpacklo_epi8(y8, zero), uLo, vLo, k, rLo, gLo, bLo);
+        YuvToRgb8Sse2(_mm_unpackhi_epi8(y8, zero), uHi, vHi, k, rHi, gHi, bHi);
+
+        StoreRgba16Sse2(_mm_packus_epi16(rLo, rHi), _mm_packus_epi16(gLo, gHi), _mm_packus_epi16(bLo, bHi), alpha, rgba + x * 4);
+    }
+
+    if (x < width)
+    {
+        RowYuvC<ShiftX>(y + x, u + (x >> ShiftX), v + (x >> ShiftX), rgba + x * 4, width - x, c);
+    }
+}
+#endif // THEORA_YUV_SSE2
+
+#ifdef THEORA_YUV_AVX2
+//=============================================================================
+// avx2 - 32 pixels per iteration, same arithmetic as sse2
+//=============================================================================
+THEORA_TARGET_AVX2
+static inline void YuvToRgb16Avx2(__m256i y, __m256i u, __m256i v, const YuvCoeffs &c,
+                                  __m256i &r, __m256i &g, __m256i &b)
+{
+    __m256i yy = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(c.yOffset_)),
+                                                     _mm256_set1_epi16(c.yMul_)), _mm256_set1_epi16(YuvRound));
+
+    r = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(v, _mm256_set1_epi16(c.vr_))), YuvCoeffShift);
+    g = _mm256_srai_epi16(_mm256_subs_epi16(_mm256_subs_epi16(yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(c.ug_))),
+                                            _mm256_mullo_epi16(v, _mm256_set1_epi16(c.vg_))), YuvCoeffShift);
+    b = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(c.ub_))), YuvCoeffShift);
+}
+
+// chroma for 32 pixels as two 16-lane halves
+template <int ShiftX>
+static inline void LoadChromaAvx2(const unsigned char *src, __m256i &lo, __m256i &hi);
+
+// 16 chroma samples widened and doubled up
+template <>
+THEORA_TARGET_AVX2
+inline void LoadChromaAvx2<1>(const unsigned char *src, __m256i &lo, __m256i &hi)
+{
+    const __m128i bias = _mm_set1_epi16(128);
+    __m128i c8 = _mm_loadu_si128((const __m128i*)src);
+    __m128i c16Lo = _mm_sub_epi16(_mm_cvtepu8_epi16(c8), bias);
+    __m128i c16Hi = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(c8, 8)), bias);
+
+    lo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(c16Lo, c16Lo)), _mm_unpackhi_epi16(c16Lo, c16Lo), 1);
+    hi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(c16Hi, c16Hi)), _mm_unpackhi_epi16(c16Hi, c16Hi), 1);
+}
+
+// 32 chroma samples widened
+template <>
+THEORA_TARGET_AVX2
+inline void LoadChromaAvx2<0>(const unsigned char *src, __m256i &lo, __m256i &hi)
+{
+    const __m256i bias = _mm256_set1_epi16(128);
+    __m256i c8 = _mm256_loadu_si256((const __m256i*)src);
+
+    lo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(c8)), bias);
+    hi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(c8, 1)), bias);
+}
+
+template <int ShiftX>
+THEORA_TARGET_AVX2
+static void RowYuvAvx2(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+                          unsigned char *rgba, int width, const YuvCoeffs &c)
+{
+    const __m256i alpha = _mm256_set1_epi8((char)0xff);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i y8 = _mm256_loadu_si256((const __m256i*)(y + x));
+        __m256i yLo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(y8));
+        __m256i yHi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y8, 1));
+
+        __m256i uLo, uHi, vLo, vHi;
+        LoadChromaAvx2<ShiftX>(u + (x >> ShiftX), uLo, uHi);
+        LoadChromaAvx2<ShiftX>(v + (x >> ShiftX), vLo, vHi);
+
+        __m256i rLo, gLo, bLo, rHi, gHi, bHi;
+        YuvToRgb16Avx2(yLo, uLo, vLo, c, rLo, gLo, bLo);
+        YuvToRgb16Avx2(yHi, uHi, vHi, c, rHi, gHi, bHi);
+
+        // in-lane pack: lane 0 holds pixels 0-7, 16-23 and lane 1 holds 8-15, 24-31
+        __m256i r = _mm256_packus_epi16(rLo, rHi);
+        __m256i g = _mm256_packus_epi16(gLo, gHi);
+        __m256i b = _mm256_packus_epi16(bLo, bHi);
+
+        // rgLo/baLo hold pixels 0-7 | 8-15, rgHi/baHi pixels 16-23 | 24-31
+        __m256i rgLo = _mm256_unpacklo_epi8(r, g);
+        __m256i rgHi = _mm256_unpackhi_epi8(r, g);
+        __m256i baLo = _mm256_unpacklo_epi8(b, alpha);
+        __m256i baHi = _mm256_unpackhi_epi8(b, alpha);
+
+        __m256i p0 = _mm256_unpacklo_epi16(rgLo, baLo);  // 0-3   | 8-11
+        __m256i p1 = _mm256_unpackhi_epi16(rgLo, baLo);  // 4-7   | 12-15
+        __m256i p2 = _mm256_unpacklo_epi16(rgHi, baHi);  // 16-19 | 24-27
+        __m256i p3 = _mm256_unpackhi_epi16(rgHi, baHi);  // 20-23 | 28-31
+
+        unsigned char *out = rgba + x * 4;
+        _mm256_storeu_si256((__m256i*)(out +  0), _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256((__m256i*)(out + 64), _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+
+    if (x < width)
+    {
+        RowYuvC<ShiftX>(y + x, u + (x >> ShiftX), v + (x >> ShiftX), rgba + x * 4, width - x, c);
+    }
+}
+
+static bool CpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // avx and os support for saving ymm registers
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    // no __builtin_cpu_init(), libgcc fills the model in before main() and calling it again
+    // would write it from whichever thread asks first
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif // THEORA_YUV_AVX2
+
+//=============================================================================
+//=============================================================================
+template <int ShiftX>
+static YuvRowFunc GetRowFunc(YuvConvertPath path)
+{
+    switch (path)
+    {
+#ifdef THEORA_YUV_SSE2
+    case YUV_PATH_SSE2: return RowYuvSse2<ShiftX>;
+#endif
+#ifdef THEORA_YUV_AVX2
+    case YUV_PATH_AVX2: return RowYuvAvx2<ShiftX>;
+#endif
+    default:
+        break;
+    }
+
+    return RowYuvC<ShiftX>;
+}
+
+// ShiftY is 1 when chroma is subsampled vertically (4:2:0)
+template <int ShiftY>
+static void ConvertRows(YuvRowFunc rowFunc, const th_img_plane yuv[3], unsigned char *rgba, int rgbaStride,
+                        int rowBegin, int rowEnd, const YuvCoeffs &c)
+{
+    int width = yuv[0].width;
+    rgba += rowBegin * rgbaStride;
+
+    for (int row = rowBegin; row < rowEnd; ++row)
+    {
+        int chromaRow = row >> ShiftY;
+        rowFunc(yuv[0].data + row * yuv[0].stride,
+                yuv[1].data + chromaRow * yuv[1].stride,
+                yuv[2].data + chromaRow * yuv[2].stride,
+                rgba, width, c);
+        rgba += rgbaStride;
+    }
+}
+
+//=============================================================================
+// 2x2 box filter for half resolution output - ShiftX 1 halves the width, 0 keeps
+// it, rows a and b are averaged (the same row for a plane kept at full height)
+//=============================================================================
+static void HalveRowC(const unsigned char *a, const unsigned char *b, unsigned char *dst, int width,
+                      int srcWidth, int shiftX, int from)
+{
+    for (int x = from; x < width; ++x)
+    {
+        int x0 = x << shiftX;
+        int x1 = x0 + shiftX < srcWidth ? x0 + shiftX : srcWidth - 1;
+        dst[x] = (unsigned char)((a[x0] + a[x1] + b[x0] + b[x1] + 2) >> 2);
+    }
+}
+
+#ifdef THEORA_YUV_SSE2
+// matches HalveRowC bit for bit
+static void HalveRowSse2(const unsigned char *a, const unsigned char *b, unsigned char *dst, int width,
+                         int srcWidth, int shiftX)
+{
+    int x = 0;
+
+    if (shiftX)
+    {
+        const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+        const __m128i two = _mm_set1_epi16(2);
+
+        // 32 source bytes for 16 outputs, the right edge is left to the C tail
+        for (; x + 16 <= width && (x << 1) + 32 <= srcWidth; x += 16)
+        {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(a + (x << 1)));
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(a + (x << 1) + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(b + (x << 1)));
+            __m128i b1 = _mm_loadu_si128((const __m128i*)(b + (x << 1) + 16));
+
+            __m128i sum0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, lowBytes), _mm_srli_epi16(a0, 8)),
+                                         _mm_add_epi16(_mm_and_si128(b0, lowBytes), _mm_srli_epi16(b0, 8)));
+            __m128i sum1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, lowBytes), _mm_srli_epi16(a1, 8)),
+                                         _mm_add_epi16(_mm_and_si128(b1, lowBytes), _mm_srli_epi16(b1, 8)));
+
+            sum0 = _mm_srli_epi16(_mm_add_epi16(sum0, two), 2);
+            sum1 = _mm_srli_epi16(_mm_add_epi16(sum1, two), 2);
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(sum0, sum1));
+        }
+    }
+    else
+    {
+        // (2a + 2b + 2) >> 2 is the rounded average
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(a + x));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(b + x));
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_avg_epu8(a0, b0));
+        }
+    }
+
+    HalveRowC(a, b, dst, width, srcWidth, shiftX, x);
+}
+#endif
+
+static void HalvePlane(const th_img_plane &src, th_img_plane &dst, int width, int height, unsigned char *scratch)
+{
+    int shiftX = src.width > width ? 1 : 0;
+    int shiftY = src.height > height ? 1 : 0;
+
+    // already at the half size, 4:2:0 chroma
+    if (!shiftX && !shiftY)
+    {
+        dst = src;
+        return;
+    }
+
+    dst.width = width;
+    dst.height = height;
+    dst.stride = width;
+    dst.data = scratch;
+
+    for (int row = 0; row < height; ++row)
+    {
+        int row0 = row << shiftY;
+        int row1 = row0 + shiftY < src.height ? row0 + shiftY : src.height - 1;
+        const unsigned char *a = src.data + row0 * src.stride;
+        const unsigned char *b = src.data + row1 * src.stride;
+
+#ifdef THEORA_YUV_SSE2
+        HalveRowSse2(a, b, scratch + row * width, width, src.width, shiftX);
+#else
+        HalveRowC(a, b, scratch + row * width, width, src.width, shiftX, 0);
+#endif
+    }
+}
+
+YuvConverter::YuvConverter()
+    : pixelFmt_(TH_PF_420)
+    , pictureX_(0)
+    , pictureY_(0)
+    , pictureWidth_(0)
+    , pictureHeight_(0)
+{
+    SetColorSpace(TH_CS_UNSPECIFIED);
+    SetPath(GetBestPath());
+}
+
+void YuvConverter::SetPath(YuvConvertPath path)
+{
+    path_ = IsPathSupported(path) ? path : GetBestPath();
+    UpdateFuncs();
+}
+
+void YuvConverter::SetPixelFormat(th_pixel_fmt pixelFmt)
+{
+    pixelFmt_ = pixelFmt;
+    UpdateFuncs();
+}
+
+th_pixel_fmt YuvConverter::GetPixelFormat() const
+{
+    return pixelFmt_;
+}
+
+bool YuvConverter::IsPixelFormatSupported(th_pixel_fmt pixelFmt)
+{
+    return pixelFmt == TH_PF_420 || pixelFmt == TH_PF_422 || pixelFmt == TH_PF_444;
+}
+
+const char* YuvConverter::GetPixelFormatName(th_pixel_fmt pixelFmt)
+{
+    switch (pixelFmt)
+    {
+    case TH_PF_420: return "4:2:0";
+    case TH_PF_422: return "4:2:2";
+    case TH_PF_444: return "4:4:4";
+    default:
+        break;
+    }
+
+    return "unknown";
+}
+
+void YuvConverter::SetColorSpace(th_colorspace colorSpace, YuvRange range)
+{
+    // the per-pixel cost is unchanged, only the coefficients differ
+    colorSpace_ = colorSpace;
+    range_ = range;
+    coeffs_ = ComputeCoeffs(colorSpace, range);
+}
+
+th_colorspace YuvConverter::GetColorSpace() const
+{
+    return colorSpace_;
+}
+
+YuvRange YuvConverter::GetRange() const
+{
+    return range_;
+}
+
+const YuvCoeffs& YuvConverter::GetCoeffs() const
+{
+    return coeffs_;
+}
+
+const char* YuvConverter::GetColorSpaceName(th_colorspace colorSpace)
+{
+    switch (colorSpace)
+    {
+    case TH_CS_UNSPECIFIED:   return "unspecified";
+    case TH_CS_ITU_REC_470M:  return "Rec 470M";
+    case TH_CS_ITU_REC_470BG: return "Rec 470BG";
+    default:
+        break;
+    }
+
+    return "unknown";
+}
+
+YuvCoeffs YuvConverter::ComputeCoeffs(th_colorspace colorSpace, YuvRange range)
+{
+    // every colorspace Theora defines uses the Rec 601 matrix, unknown ones fall back to it as well
+    (void)colorSpace;
+    const YuvMatrix &m = Rec601Matrix;
+    const float scale = (float)(1 << YuvCoeffShift);
+    const float kg = 1.0f - m.kr_ - m.kb_;
+
+    float yScale = 1.0f;
+    float cScale = 1.0f;
+    short yOffset = 0;
+
+    if (range == YUV_RANGE_STUDIO)
+    {
+        yScale = 255.0f / 219.0f;
+        cScale = 255.0f / 224.0f;
+        yOffset = 16;
+    }
+
+    YuvCoeffs c;
+    c.yOffset_ = yOffset;
+    c.yMul_ = (short)(yScale * scale + 0.5f);
+    c.vr_ = (short)(2.0f * (1.0f - m.kr_) * cScale * scale + 0.5f);
+    c.ug_ = (short)(2.0f * (1.0f - m.kb_) * m.kb_ / kg * cScale * scale + 0.5f);
+    c.vg_ = (short)(2.0f * (1.0f - m.kr_) * m.kr_ / kg * cScale * scale + 0.5f);
+    c.ub_ = (short)(2.0f * (1.0f - m.kb_) * cScale * scale + 0.5f);
+    return c;
+}
+
+void YuvConverter::SetPictureRegion(int x, int y, int width, int height)
+{
+    // keep luma and chroma origins on the same sample
+    int alignX = pixelFmt_ == TH_PF_444 ? 0 : x & 1;
+    int alignY = pixelFmt_ == TH_PF_420 ? y & 1 : 0;
+
+    pictureX_ = x - alignX;
+    pictureY_ = y - alignY;
+    pictureWidth_ = width + alignX;
+    pictureHeight_ = height + alignY;
+}
+
+int YuvConverter::GetPictureWidth() const
+{
+    return pictureWidth_;
+}
+
+int YuvConverter::GetPictureHeight() const
+{
+    return pictureHeight_;
+}
+
+void YuvConverter::CropPicture(const th_img_plane frame[3], th_img_plane picture[3]) const
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        picture[i] = frame[i];
+    }
+
+    if (pictureWidth_ <= 0 || pictureHeight_ <= 0)
+    {
+        return;
+    }
+
+    int shiftX = pixelFmt_ == TH_PF_444 ? 0 : 1;
+    int shiftY = pixelFmt_ == TH_PF_420 ? 1 : 0;
+
+    picture[0].width = pictureWidth_;
+    picture[0].height = pictureHeight_;
+    picture[0].data = frame[0].data + pictureY_ * frame[0].stride + pictureX_;
+
+    for (int i = 1; i < 3; ++i)
+    {
+        picture[i].width = (pictureWidth_ + shiftX) >> shiftX;
+        picture[i].height = (pictureHeight_ + shiftY) >> shiftY;
+        picture[i].data = frame[i].data + (pictureY_ >> shiftY) * frame[i].stride + (pictureX_ >> shiftX);
+    }
+}
+
+bool YuvConverter::ClipRows(int &rowBegin, int &rowEnd) const
+{
+    if (pictureWidth_ > 0 && pictureHeight_ > 0)
+    {
+        rowBegin = rowBegin > pictureY_ ? rowBegin - pictureY_ : 0;
+        rowEnd = rowEnd - pictureY_ < pictureHeight_ ? rowEnd - pictureY_ : pictureHeight_;
+    }
+
+    return rowBegin < rowEnd;
+}
+
+void YuvConverter::UpdateFuncs()
+{
+    switch (pixelFmt_)
+    {
+    case TH_PF_444:
+        rowFunc_ = GetRowFunc<0>(path_);
+        convertRows_ = ConvertRows<0>;
+        break;
+
+    case TH_PF_422:
+        rowFunc_ = GetRowFunc<1>(path_);
+        convertRows_ = ConvertRows<0>;
+        break;
+
+    default:
+        rowFunc_ = GetRowFunc<1>(path_);
+        convertRows_ = ConvertRows<1>;
+        break;
+    }
+}
+
+YuvConvertPath YuvConverter::GetPath() const
+{
+    return path_;
+}
+
+void YuvConverter::Convert(const th_img_plane yuv[3], unsigned char *rgba, int rgbaStride, int rowBegin, int rowEnd) const
+{
+    if (!yuv[0].data || !yuv[1].data || !yuv[2].data || !rgba)
+    {
+        return;
+    }
+
+    convertRows_(rowFunc_, yuv, rgba, rgbaStride, rowBegin, rowEnd, coeffs_);
+}
+
+unsigned YuvConverter::SetupBands(const th_img_plane yuv[3], unsigned char *rgba, int rgbaStride, YuvBand *bands, unsigned numBands) const
+{
+    int height = yuv[0].height;
+    int bandRows = (height + (int)numBands - 1) / (int)numBands;
+    bandRows = (bandRows + 1) & ~1;
+
+    unsigned count = 0;
+    for (int row = 0; row < height && count < numBands; row += bandRows)
+    {
+        YuvBand &band = bands[count++];
+        band.converter_ = this;
+        band.yuv_ = yuv;
+        band.rgba_ = rgba;
+        band.rgbaStride_ = rgbaStride;
+        band.rowBegin_ = row;
+        band.rowEnd_ = row + bandRows < height ? row + bandRows : height;
+    }
+
+    return count;
+}
+
+void YuvConverter::ConvertBand(const YuvBand &band)
+{
+    band.converter_->Convert(band.yuv_, band.rgba_, band.rgbaStride_, band.rowBegin_, band.rowEnd_);
+}
+
+unsigned YuvConverter::GetHalfPictureSize(int width, int height)
+{
+    unsigned planeSize = (unsigned)((width + 1) >> 1) * (unsigned)((height + 1) >> 1);
+    return planeSize * 3;
+}
+
+void YuvConverter::HalvePicture(const th_img_plane yuv[3], th_img_plane half[3], unsigned char *scratch)
+{
+    int width = (yuv[0].width + 1) >> 1;
+    int height = (yuv[0].height + 1) >> 1;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        HalvePlane(yuv[i], half[i], width, height, scratch + i * width * height);
+    }
+}
+
+bool YuvConverter::IsPathSupported(YuvConvertPath path)
+{
+    switch (path)
+    {
+    case YUV_PATH_C:
+        return true;
+
+    case YUV_PATH_SSE2:
+#ifdef THEORA_YUV_SSE2
+        return true;
+#else
+        return false;
+#endif
+
+    case YUV_PATH_AVX2:
+#ifdef THEORA_YUV_AVX2
+        {
+            static const bool hasAvx2 = CpuHasAvx2();
+            return hasAvx2;
+        }
+#else
+        return false;
+#endif
+
+    default:
+        break;
+    }
+
+    return false;
+}
+
+YuvConvertPath YuvConverter::GetBestPath()
+{
+    if (IsPathSupported(YUV_PATH_AVX2))
+    {
+        return YUV_PATH_AVX2;
+    }
+    if (IsPathSupported(YUV_PATH_SSE2))
+    {
+        return YUV_PATH_SSE2;
+    }
+    return YUV_PATH_C;
+}
+
+const char* YuvConverter::GetPathName(YuvConvertPath path)
+{
+    static const char* names[MAX_YUV_PATHS] = { "C", "SSE2", "AVX2" };
+    return path < MAX_YUV_PATHS ? names[path] : "unknown";
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <theora/codec.h>
+
+//=============================================================================
+//=============================================================================
+enum YuvConvertPath
+{
+    YUV_PATH_C = 0,
+    YUV_PATH_SSE2,
+    YUV_PATH_AVX2,
+    MAX_YUV_PATHS
+};
+
+// fixed-point conversion coefficients, scaled by 1 << YuvCoeffShift
+struct YuvCoeffs
+{
+    short yOffset_;
+    short yMul_;
+    short vr_;
+    short ug_;
+    short vg_;
+    short ub_;
+};
+
+static const int YuvCoeffShift = 6;
+
+enum YuvRange
+{
+    // Y in 16-235, chroma in 16-240 - what Theora streams carry
+    YUV_RANGE_STUDIO = 0,
+    // all components in 0-255
+    YUV_RANGE_FULL
+};
+
+// converts one row of yuv into rgba8888, chroma full or half width depending on the layout
+typedef void (*YuvRowFunc)(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+                           unsigned char *rgba, int width, const YuvCoeffs &coeffs);
+// converts a range of rows, picking the chroma row for each luma row
+typedef void (*YuvRowsFunc)(YuvRowFunc rowFunc, const th_img_plane yuv[3], unsigned char *rgba, int rgbaStride,
+                            int rowBegin, int rowEnd, const YuvCoeffs &coeffs);
+
+class YuvConverter;
+
+// a horizontal band of rows, converted independently of the others
+struct YuvBand
+{
+    const YuvConverter *converter_;
+    const th_img_plane *yuv_;
+    unsigned char      *rgba_;
+    int                rgbaStride_;
+    int                rowBegin_;
+    int                rowEnd_;
+};
+
+//=============================================================================
+//=============================================================================
+class YuvConverter
+{
+public:
+    YuvConverter();
+
+    // unsupported paths fall back to the best one available
+    void SetPath(YuvConvertPath path);
+    YuvConvertPath GetPath() const;
+    // chroma layout, 4:2:0 by default
+    void SetPixelFormat(th_pixel_fmt pixelFmt);
+    th_pixel_fmt GetPixelFormat() const;
+    // matrix and range, Rec 601 studio range by default
+    void SetColorSpace(th_colorspace colorSpace, YuvRange range = YUV_RANGE_STUDIO);
+    th_colorspace GetColorSpace() const;
+    YuvRange GetRange() const;
+    const YuvCoeffs& GetCoeffs() const;
+    // visible rectangle inside the padded frame, call after SetPixelFormat(). the origin is
+    // rounded down to a whole chroma sample, growing the picture by at most one column/row
+    void SetPictureRegion(int x, int y, int width, int height);
+    int GetPictureWidth() const;
+    int GetPictureHeight() const;
+
+    // view of the picture region of a decoded frame, the whole frame if no region is set
+    void CropPicture(const th_img_plane frame[3], th_img_plane picture[3]) const;
+    // maps frame rows [rowBegin, rowEnd) onto picture rows, returns false if none are visible
+    bool ClipRows(int &rowBegin, int &rowEnd) const;
+
+    // converts luma rows [rowBegin, rowEnd) into rgba with rgbaStride bytes per row
+    void Convert(const th_img_plane yuv[3], unsigned char *rgba, int rgbaStride, int rowBegin, int rowEnd) const;
+
+    // splits the frame into at most numBands bands starting on chroma row pairs, returns the number of bands
+    unsigned SetupBands(const th_img_plane yuv[3], unsigned char *rgba, int rgbaStride, YuvBand *bands, unsigned numBands) const;
+    static void ConvertBand(const YuvBand &band);
+
+    // 2x2 box filtered picture at half the width and height, rounded up, with every plane at that
+    // size for a TH_PF_444 converter. planes already at that size (4:2:0 chroma) are not copied,
+    // scratch holds GetHalfPictureSize() of the full picture size
+    static unsigned GetHalfPictureSize(int width, int height);
+    static void HalvePicture(const th_img_plane yuv[3], th_img_plane half[3], unsigned char *scratch);
+
+    static bool IsPathSupported(YuvConvertPath path);
+    static YuvConvertPath GetBestPath();
+    static const char* GetPathName(YuvConvertPath path);
+    static bool IsPixelFormatSupported(th_pixel_fmt pixelFmt);
+    static const char* GetPixelFormatName(th_pixel_fmt pixelFmt);
+    static const char* GetColorSpaceName(th_colorspace colorSpace);
+    // fixed-point coefficients for the colorspace matrix, scaled for the range
+    static YuvCoeffs ComputeCoeffs(th_colorspace colorSpace, YuvRange range);
+
+private:
+    void UpdateFuncs();
+
+    YuvConvertPath path_;
+    th_pixel_fmt   pixelFmt_;
+    th_colorspace  colorSpace_;
+    YuvRange       range_;
+    int            pictureX_;
+    int            pictureY_;
+    int            pictureWidth_;
+    int            pictureHeight_;
+    YuvRowFunc     rowFunc_;
+    YuvRowsFunc    convertRows_;
+    YuvCoeffs      coeffs_;
+};
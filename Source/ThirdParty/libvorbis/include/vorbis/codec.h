@@ -211,6 +211,7 @@ extern int      vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb);
 extern int      vorbis_synthesis_pcmout(vorbis_dsp_state *v,float ***pcm);
 extern int      vorbis_synthesis_lapout(vorbis_dsp_state *v,float ***pcm);
 extern int      vorbis_synthesis_read(vorbis_dsp_state *v,int samples);
+extern int      vorbis_synthesis_pcmout_int16(vorbis_dsp_state *v,short *out,int samples);
 extern long     vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op);
 
 extern int      vorbis_synthesis_halfrate(vorbis_info *v,int flag);
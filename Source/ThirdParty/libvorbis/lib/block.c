@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <ogg/ogg.h>
 #include "vorbis/codec.h"
 #include "codec_internal.h"
@@ -30,6 +31,23 @@
 #include "registry.h"
 #include "misc.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VORBIS_PCM_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(VORBIS_PCM_SSE2) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define VORBIS_PCM_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define VORBIS_TARGET_AVX2
+#else
+#define VORBIS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+static int pcm_cpu_has_avx2(void);
+#endif
+
 /* pcm accumulator examples (not exhaustive):
 
  <-------------- lW ---------------->
@@ -710,6 +728,9 @@ int vorbis_synthesis_init(vorbis_dsp_state *v,vorbis_info *vi){
     vorbis_dsp_clear(v);
     return 1;
   }
+#ifdef VORBIS_PCM_AVX2
+  ((private_state *)(v->backend_state))->pcm_avx2=pcm_cpu_has_avx2();
+#endif
   vorbis_synthesis_restart(v);
   return 0;
 }
@@ -955,6 +976,154 @@ int vorbis_synthesis_read(vorbis_dsp_state *v,int n){
   return(0);
 }
 
+/* float to 16 bit pcm: floor(x*32767), clamped to the 16 bit range.
+   the clamp is done on the float so the conversion can't overflow;
+   every path below produces the same samples */
+static short pcm_to_int16(float x){
+  float f=x*32767.f;
+  if(f>32767.f)f=32767.f;
+  else if(!(f>=-32768.f))f=-32768.f; /* and NaN */
+  return (short)(int)floorf(f);
+}
+
+static void pcm_interleave_c(float **pcm,short *out,int channels,
+                             int from,int to){
+  int i,j;
+  out+=from*channels;
+  for(i=from;i<to;i++)
+    for(j=0;j<channels;j++)
+      *out++=pcm_to_int16(pcm[j][i]);
+}
+
+#ifdef VORBIS_PCM_SSE2
+/* sse2 has no floor; truncate, then step down where that rounded up */
+static __m128i pcm_to_int32_sse2(const float *p){
+  __m128 f=_mm_mul_ps(_mm_loadu_ps(p),_mm_set1_ps(32767.f));
+  __m128i t;
+  /* max first, it returns the bound for NaN like the scalar clamp */
+  f=_mm_min_ps(_mm_max_ps(f,_mm_set1_ps(-32768.f)),_mm_set1_ps(32767.f));
+  t=_mm_cvttps_epi32(f);
+  return _mm_add_epi32(t,_mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t),f)));
+}
+
+/* 8 samples per channel per iteration from sample i, returns where the
+   scalar tail starts. only mono and stereo, other layouts are all tail */
+static int pcm_interleave_sse2(float **pcm,short *out,int channels,
+                               int i,int n){
+  if(channels==1){
+    for(;i+8<=n;i+=8)
+      _mm_storeu_si128((__m128i *)(out+i),
+                       _mm_packs_epi32(pcm_to_int32_sse2(pcm[0]+i),
+                                       pcm_to_int32_sse2(pcm[0]+i+4)));
+  }else if(channels==2){
+    for(;i+8<=n;i+=8){
+      __m128i l=_mm_packs_epi32(pcm_to_int32_sse2(pcm[0]+i),
+                                pcm_to_int32_sse2(pcm[0]+i+4));
+      __m128i r=_mm_packs_epi32(pcm_to_int32_sse2(pcm[1]+i),
+                                pcm_to_int32_sse2(pcm[1]+i+4));
+      _mm_storeu_si128((__m128i *)(out+i*2),_mm_unpacklo_epi16(l,r));
+      _mm_storeu_si128((__m128i *)(out+i*2+8),_mm_unpackhi_epi16(l,r));
+    }
+  }
+  return i;
+}
+#endif
+
+#ifdef VORBIS_PCM_AVX2
+VORBIS_TARGET_AVX2
+static __m256i pcm_to_int32_avx2(const float *p){
+  __m256 f=_mm256_mul_ps(_mm256_loadu_ps(p),_mm256_set1_ps(32767.f));
+  f=_mm256_min_ps(_mm256_max_ps(f,_mm256_set1_ps(-32768.f)),
+                  _mm256_set1_ps(32767.f));
+  return _mm256_cvttps_epi32(_mm256_floor_ps(f));
+}
+
+/* 16 samples per channel per iteration. packs works per 128 bit lane,
+   which leaves a0-3 b0-3 | a4-7 b4-7 */
+VORBIS_TARGET_AVX2
+static int pcm_interleave_avx2(float **pcm,short *out,int channels,
+                               int i,int n){
+  if(channels==1){
+    for(;i+16<=n;i+=16){
+      __m256i s=_mm256_packs_epi32(pcm_to_int32_avx2(pcm[0]+i),
+                                   pcm_to_int32_avx2(pcm[0]+i+8));
+      _mm256_storeu_si256((__m256i *)(out+i),
+                          _mm256_permute4x64_epi64(s,0xd8));
+    }
+  }else if(channels==2){
+    /* l0 r0 l1 r1 .. within each lane */
+    const __m256i lr=_mm256_setr_epi8(0,1,8,9,2,3,10,11,4,5,12,13,6,7,14,15,
+                                      0,1,8,9,2,3,10,11,4,5,12,13,6,7,14,15);
+    for(;i+16<=n;i+=16){
+      __m256i s0=_mm256_shuffle_epi8(_mm256_packs_epi32(
+                   pcm_to_int32_avx2(pcm[0]+i),pcm_to_int32_avx2(pcm[1]+i)),lr);
+      __m256i s1=_mm256_shuffle_epi8(_mm256_packs_epi32(
+                   pcm_to_int32_avx2(pcm[0]+i+8),pcm_to_int32_avx2(pcm[1]+i+8)),lr);
+      _mm256_storeu_si256((__m256i *)(out+i*2),s0);
+      _mm256_storeu_si256((__m256i *)(out+i*2+16),s1);
+    }
+  }
+  return i;
+}
+
+static int pcm_cpu_has_avx2(void){
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info,0);
+  if(info[0]<7)return 0;
+
+  /* avx and os support for saving ymm registers */
+  __cpuid(info,1);
+  if((info[2]&(1<<27))==0 || (info[2]&(1<<28))==0 || (_xgetbv(0)&6)!=6)
+    return 0;
+
+  __cpuidex(info,7,0);
+  return (info[1]&(1<<5))!=0;
+#else
+  /* no __builtin_cpu_init(): libgcc fills the model in before main()
+     and calling it again would write it from decode threads */
+  return __builtin_cpu_supports("avx2")!=0;
+#endif
+}
+#endif
+
+/* writes up to samples pending samples per channel to out as interleaved,
+   clamped 16 bit pcm and consumes them, as vorbis_synthesis_pcmout()
+   followed by vorbis_synthesis_read() would without the float copy.
+   out holds samples*channels shorts; returns the samples per channel
+   written */
+int vorbis_synthesis_pcmout_int16(vorbis_dsp_state *v,short *out,
+                                  int samples){
+  vorbis_info *vi=v->vi;
+  float **pcm=v->pcmret;
+  int i,n,done=0;
+#ifdef VORBIS_PCM_AVX2
+  private_state *b=v->backend_state;
+#endif
+
+  if(v->pcm_returned<0 || v->pcm_returned>=v->pcm_current || samples<=0)
+    return(0);
+
+  n=v->pcm_current-v->pcm_returned;
+  if(n>samples)n=samples;
+  for(i=0;i<vi->channels;i++)
+    pcm[i]=v->pcm[i]+v->pcm_returned;
+
+#ifdef VORBIS_PCM_AVX2
+  /* a state set up by hand rather than vorbis_synthesis_init() has no
+     backend; the detection itself only reads the cpu model */
+  if(b ? b->pcm_avx2 : pcm_cpu_has_avx2())
+    done=pcm_interleave_avx2(pcm,out,vi->channels,done,n);
+#endif
+#ifdef VORBIS_PCM_SSE2
+  done=pcm_interleave_sse2(pcm,out,vi->channels,done,n);
+#endif
+  pcm_interleave_c(pcm,out,vi->channels,done,n);
+
+  v->pcm_returned+=n;
+  return(n);
+}
+
 /* intended for use with a specific vorbisfile feature; we want access
    to the [usually synthetic/postextrapolated] buffer and lapping at
    the end of a decode cycle, specifically, a half-short-block worth.
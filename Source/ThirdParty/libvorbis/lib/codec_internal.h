@@ -81,6 +81,10 @@ typedef struct private_state {
   bitrate_manager_state bms;
 
   ogg_int64_t sample_count;
+
+  /* cpu features of the int16 pcm output, detected once at synthesis
+     init so decode threads only ever read them */
+  int pcm_avx2;
 } private_state;
 
 /* codec_setup_info contains all the setup information specific to the